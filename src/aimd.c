@@ -0,0 +1,208 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Control of the number of queries in flight to one server.
+ *
+ * The window starts at one query and grows by one query per window of
+ * replies (additive increase) until it reaches the ceiling.  A timeout,
+ * or a reply that took several times the shortest round trip seen, is
+ * taken to mean the server or the network is saturated, and halves the
+ * window (multiplicative decrease).  Only one decrease is made per round
+ * trip: losses of queries sent before the last decrease are ignored, as
+ * they are the same congestion event.  A server that stays busy settles
+ * at the largest window it can sustain.
+ *
+ * Independently of the window, a token bucket holding up to one second
+ * of tokens caps the rate at which queries are sent.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "aimd.h"
+
+#define AIMD_RTT_FACTOR 4       /* rtt this many times the minimum ... */
+#define AIMD_RTT_FLOOR  0.005   /* ... or this many seconds, is congestion */
+
+#define AIMD_MAGIC 0x41494d44
+struct aimd_struct {
+    int     a_magic;
+    double  a_window;           /* queries allowed in flight */
+    int     a_ceiling;          /* maximum window */
+    int     a_inflight;         /* queries in flight */
+    double  a_rtt_min;          /* shortest round trip seen, 0 if none */
+    double  a_cut;              /* time of the last decrease */
+    double  a_rate;             /* queries per second, 0 = no limit */
+    double  a_tokens;           /* queries that may be sent now */
+    double  a_filled;           /* time a_tokens was last topped up */
+};
+
+/* Create a controller allowing at most ceiling queries in flight and rate
+ * queries per second (0 for no limit).
+ */
+aimd_t
+aimd_create(int ceiling, double rate)
+{
+    aimd_t a = xmalloc(sizeof(struct aimd_struct));
+
+    assert(ceiling > 0);
+    memset(a, 0, sizeof(struct aimd_struct));
+    a->a_magic = AIMD_MAGIC;
+    a->a_window = 1;
+    a->a_ceiling = ceiling;
+    a->a_cut = -1;
+    a->a_rate = rate;
+    a->a_tokens = 1;
+    a->a_filled = -1;
+    return a;
+}
+
+void
+aimd_destroy(aimd_t a)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    a->a_magic = 0;
+    free(a);
+}
+
+/* Start from a window learned earlier rather than from one query.
+ */
+void
+aimd_set_window(aimd_t a, double window)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    if (window > a->a_ceiling)
+        window = a->a_ceiling;
+    if (window >= 1)
+        a->a_window = window;
+}
+
+static double
+burst(aimd_t a)
+{
+    return a->a_rate > 1 ? a->a_rate : 1;
+}
+
+/* Return 0 if a query may be sent at time now, the number of seconds
+ * until one may if the rate limit is holding it back, or -1 if the window
+ * is full and a reply must come first.
+ */
+double
+aimd_wait(aimd_t a, double now)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    if (a->a_inflight >= (int)a->a_window)
+        return -1;
+    if (a->a_rate <= 0)
+        return 0;
+    if (a->a_filled >= 0) {
+        a->a_tokens += (now - a->a_filled) * a->a_rate;
+        if (a->a_tokens > burst(a))
+            a->a_tokens = burst(a);
+    }
+    a->a_filled = now;
+    if (a->a_tokens >= 1)
+        return 0;
+    return (1 - a->a_tokens) / a->a_rate;
+}
+
+/* Account for a query sent at time now, after aimd_wait() returned 0.
+ */
+void
+aimd_sent(aimd_t a, double now)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    a->a_inflight++;
+    if (a->a_rate > 0)
+        a->a_tokens -= 1;
+}
+
+static void
+decrease(aimd_t a, double sent, double now)
+{
+    if (sent < a->a_cut)
+        return;
+    a->a_window /= 2;
+    if (a->a_window < 1)
+        a->a_window = 1;
+    a->a_cut = now;
+}
+
+/* Account for the reply to a query sent at time sent, which took rtt
+ * seconds.
+ */
+void
+aimd_reply(aimd_t a, double sent, double rtt)
+{
+    double limit;
+
+    assert(a->a_magic == AIMD_MAGIC);
+    assert(a->a_inflight > 0);
+    a->a_inflight--;
+    if (a->a_rtt_min == 0 || rtt < a->a_rtt_min)
+        a->a_rtt_min = rtt;
+    limit = AIMD_RTT_FACTOR * a->a_rtt_min;
+    if (limit < AIMD_RTT_FLOOR)
+        limit = AIMD_RTT_FLOOR;
+    if (rtt > limit)
+        decrease(a, sent, sent + rtt);
+    else if ((a->a_window += 1 / a->a_window) > a->a_ceiling)
+        a->a_window = a->a_ceiling;
+}
+
+/* Account for a query sent at time sent that the server did not answer
+ * by time now.
+ */
+void
+aimd_timeout(aimd_t a, double sent, double now)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    assert(a->a_inflight > 0);
+    a->a_inflight--;
+    decrease(a, sent, now);
+}
+
+double
+aimd_window(aimd_t a)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    return a->a_window;
+}
+
+int
+aimd_inflight(aimd_t a)
+{
+    assert(a->a_magic == AIMD_MAGIC);
+    return a->a_inflight;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,43 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Control of the number of queries in flight to one server.
+ */
+
+typedef struct aimd_struct *aimd_t;
+
+aimd_t  aimd_create(int ceiling, double rate);
+void    aimd_destroy(aimd_t a);
+void    aimd_set_window(aimd_t a, double window);
+double  aimd_wait(aimd_t a, double now);
+void    aimd_sent(aimd_t a, double now);
+void    aimd_reply(aimd_t a, double sent, double rtt);
+void    aimd_timeout(aimd_t a, double sent, double now);
+double  aimd_window(aimd_t a);
+int     aimd_inflight(aimd_t a);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
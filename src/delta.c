@@ -0,0 +1,206 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Compare the results of a sweep with a previous snapshot.
+ *
+ * Both sides are walked once in uid order (the results after sorting by
+ * uid, the snapshot through its uid index), so the join is linear in the
+ * number of records.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "outbuf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "report.h"
+#include "snapshot.h"
+#include "delta.h"
+
+static void
+delta_destroy(struct delta *d)
+{
+    quota_destroy(d->d_quota);
+    free(d);
+}
+
+static inline unsigned long long
+magnitude(long long val)
+{
+    return val < 0 ? -(unsigned long long)val : val;
+}
+
+/* helper for delta_join() - add a delta for q to dlist if it qualifies,
+ * taking ownership of q.
+ */
+static void
+add_delta(List dlist, quota_t q, long long dbytes, long long dfiles,
+          unsigned long long minbytes, unsigned long long minfiles)
+{
+    struct delta *d;
+
+    if ((dbytes == 0 && dfiles == 0) || magnitude(dbytes) < minbytes
+                                     || magnitude(dfiles) < minfiles) {
+        quota_destroy(q);
+        return;
+    }
+    d = xmalloc(sizeof(struct delta));
+    d->d_quota = q;
+    d->d_bytes = dbytes;
+    d->d_files = dfiles;
+    list_append(dlist, d);
+}
+
+/* helper for delta_join() - a user in the old snapshot but not in the
+ * current results, reported with zero usage.
+ */
+static quota_t
+gone_quota(snap_t old, int rec, int getusername)
+{
+    const char *name;
+    quota_t q;
+
+    q = quota_create((char *)snap_label(old), (char *)snap_rhost(old),
+                     (char *)snap_rpath(old), snap_thresh(old));
+    snap_quota(old, rec, q);
+    q->q_bytes_used = 0;
+    q->q_bytes_state = qstate_get(0, q->q_bytes_softlim, q->q_bytes_hardlim, 0);
+    q->q_files_used = 0;
+    q->q_files_state = qstate_get(0, q->q_files_softlim, q->q_files_hardlim, 0);
+    if (getusername && (name = snap_name(old, rec)))
+        quota_adduser(q, (char *)name);
+    return q;
+}
+
+/* Return a list of struct delta, in uid order, for the users in qlist
+ * (which must be sorted by uid) and old whose usage changed by at least
+ * minbytes and minfiles.  The quotas in qlist are moved to the new list
+ * or destroyed, leaving qlist empty.
+ */
+List
+delta_join(List qlist, snap_t old, int getusername,
+           unsigned long long minbytes, unsigned long long minfiles)
+{
+    const struct snap_index *index = snap_column(old, SNAP_COL_INDEX);
+    const uint64_t *obytes = snap_column(old, SNAP_COL_BYTES_USED);
+    const uint64_t *ofiles = snap_column(old, SNAP_COL_FILES_USED);
+    List dlist = list_create((ListDelF)delta_destroy);
+    ListIterator itr;
+    quota_t q;
+    int i = 0, n = snap_count(old);
+    uint32_t rec;
+
+    itr = list_iterator_create(qlist);
+    while ((q = list_next(itr))) {
+        assert(q->q_magic == QUOTA_MAGIC);
+        while (i < n && index[i].ix_uid < q->q_uid) {
+            rec = index[i++].ix_record;
+            add_delta(dlist, gone_quota(old, rec, getusername),
+                      -(long long)obytes[rec], -(long long)ofiles[rec],
+                      minbytes, minfiles);
+        }
+        list_remove(itr);
+        if (i < n && index[i].ix_uid == q->q_uid) {
+            rec = index[i++].ix_record;
+            add_delta(dlist, q,
+                      (long long)(q->q_bytes_used - obytes[rec]),
+                      (long long)(q->q_files_used - ofiles[rec]),
+                      minbytes, minfiles);
+        } else
+            add_delta(dlist, q, q->q_bytes_used, q->q_files_used,
+                      minbytes, minfiles);
+    }
+    list_iterator_destroy(itr);
+    while (i < n) {
+        rec = index[i++].ix_record;
+        add_delta(dlist, gone_quota(old, rec, getusername),
+                  -(long long)obytes[rec], -(long long)ofiles[rec],
+                  minbytes, minfiles);
+    }
+    return dlist;
+}
+
+int
+delta_report(struct delta *d, report_t r)
+{
+    return report_row_delta(d->d_quota, d->d_bytes, d->d_files, r);
+}
+
+/* list_sort() comparators.  Deltas are created in uid order.
+ */
+int
+delta_cmp_uid_reverse(struct delta *x, struct delta *y)
+{
+    return quota_cmp_uid_reverse(x->d_quota, y->d_quota);
+}
+
+int
+delta_cmp_bytes(struct delta *x, struct delta *y)
+{
+    if (x->d_bytes < y->d_bytes)
+        return -1;
+    if (x->d_bytes == y->d_bytes)
+        return 0;
+    return 1;
+}
+
+int
+delta_cmp_bytes_reverse(struct delta *x, struct delta *y)
+{
+    return delta_cmp_bytes(y, x);
+}
+
+int
+delta_cmp_files(struct delta *x, struct delta *y)
+{
+    if (x->d_files < y->d_files)
+        return -1;
+    if (x->d_files == y->d_files)
+        return 0;
+    return 1;
+}
+
+int
+delta_cmp_files_reverse(struct delta *x, struct delta *y)
+{
+    return delta_cmp_files(y, x);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,47 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Changes in usage between two sweeps.
+ */
+
+struct delta {
+    quota_t     d_quota;    /* current result (zero usage if user is gone) */
+    long long   d_bytes;    /* change in bytes used */
+    long long   d_files;    /* change in files used */
+};
+
+List delta_join(List qlist, snap_t old, int getusername,
+                unsigned long long minbytes, unsigned long long minfiles);
+int  delta_report(struct delta *d, report_t r);
+
+int  delta_cmp_uid_reverse(struct delta *x, struct delta *y);
+int  delta_cmp_bytes(struct delta *x, struct delta *y);
+int  delta_cmp_bytes_reverse(struct delta *x, struct delta *y);
+int  delta_cmp_files(struct delta *x, struct delta *y);
+int  delta_cmp_files_reverse(struct delta *x, struct delta *y);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
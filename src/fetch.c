@@ -0,0 +1,599 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Query a set of users on several file systems at once.
+ *
+ * The queries for each server (the file systems sharing an rhost) are
+ * handed out to a pool of worker processes.  A worker runs one query at
+ * a time and writes each result back down a pipe as a fixed-size binary
+ * record, which the parent turns back into a quota_t.  A query is for one
+ * uid until a server is seen to answer in bulk, then for up to
+ * FETCH_BATCH uid's of one file system, run with quota_get_many().
+ * Processes rather than threads are used because the rpcgen client stubs
+ * and getpw* are not reentrant.  The number of queries in flight to each
+ * server is adjusted by aimd.c to what that server can sustain, up to a
+ * ceiling, and workers are only forked as the window grows.  A query that
+ * times out is retried once, after the window has backed off.
+ *
+ * With statistics from earlier runs, each server starts at the window it
+ * settled at before, and the servers are served longest expected time
+ * first: when the total number of workers runs short, the server that
+ * would take longest gets its workers first and the quick ones fit in
+ * around it, so all finish as early as possible.  The statistics are
+ * updated from this run.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "filter.h"
+#include "aimd.h"
+#include "srvstat.h"
+#include "fetch.h"
+
+extern char *prog;
+extern int debug;
+
+#define FETCH_BATCH 800     /* most uid's in one query */
+
+/* Query passed from parent to worker.
+ */
+struct fetch_req {
+    int32_t             fq_fs;          /* index into conf array */
+    int32_t             fq_idx;         /* index into uid array */
+    int32_t             fq_count;       /* uid's fq_idx .. + fq_count - 1 */
+    int32_t             fq_try;         /* 0, or 1 for a retry */
+};
+
+enum { FETCH_OK, FETCH_NONE, FETCH_TIMEDOUT };
+
+/* Result passed from worker to parent.  Both ends are the same binary,
+ * so native byte order and padding are fine.
+ */
+struct fetch_rec {
+    int32_t             fr_status;      /* FETCH_OK: the fields are valid */
+    int32_t             fr_bulk;        /* query was answered together */
+    int32_t             fr_bytes_state;
+    int32_t             fr_files_state;
+    double              fr_rtt;         /* seconds taken by the query */
+    unsigned long long  fr_bytes_used;
+    unsigned long long  fr_bytes_softlim;
+    unsigned long long  fr_bytes_hardlim;
+    unsigned long long  fr_bytes_secleft;
+    unsigned long long  fr_files_used;
+    unsigned long long  fr_files_softlim;
+    unsigned long long  fr_files_hardlim;
+    unsigned long long  fr_files_secleft;
+};
+
+struct worker {
+    pid_t               w_pid;
+    int                 w_req;          /* write end of request pipe, or -1 */
+    int                 w_fd;           /* read end of reply pipe, or -1 */
+    int                 w_busy;         /* w_cur is in flight */
+    struct fetch_req    w_cur;
+    int                 w_got;          /* records of w_cur received */
+    int                 w_timedout;     /* some of them timed out */
+    double              w_sent;         /* time w_cur was sent */
+    size_t              w_len;          /* bytes in w_buf */
+    char                w_buf[sizeof(struct fetch_rec)];
+};
+
+struct server {
+    char               *s_rhost;
+    int                *s_fs;           /* file systems on this server */
+    int                *s_idx;          /* next uid index of each */
+    int                 s_nfs;
+    int                 s_nuid;
+    int                 s_rr;           /* file system to take from next */
+    int                 s_batch;        /* uid's per query */
+    long                s_next;         /* uid's sent of s_ntask */
+    long                s_ntask;
+    struct fetch_req   *s_retry;        /* queries to be retried */
+    int                 s_nretry;
+    aimd_t              s_aimd;
+    struct worker      *s_w;            /* workers, live or not */
+    int                 s_nw;
+    int                 s_nlive;        /* workers with w_fd open */
+    long                s_queries;
+    long                s_timeouts;
+    double              s_cost;         /* expected seconds, 0 if unknown */
+    double              s_rttsum;       /* seconds taken by s_answered */
+    long                s_answered;     /* queries answered in full */
+    long                s_replies;      /* uid's answered */
+    double              s_first;        /* time of first query sent */
+    double              s_last;         /* time of last reply */
+};
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1E-6;
+}
+
+/* Worker: run each query read from rfd and send a result for each of
+ * its uid's to wfd.  The query context of each of the server's file
+ * systems is made on its first query.
+ */
+static void
+fetch_worker(struct server *s, confent_t **conf, uid_t *uid,
+             struct qfilter *filter, int rfd, int wfd)
+{
+    quota_fs_t *fs = xmalloc(s->s_nfs * sizeof(quota_fs_t));
+    struct fetch_rec *rec = xmalloc(FETCH_BATCH * sizeof(struct fetch_rec));
+    quota_t qv[FETCH_BATCH];
+    int rcv[FETCH_BATCH];
+    struct fetch_req req;
+    quota_t q;
+    double t0, rtt;
+    int rc, bulk, i, j;
+
+    memset(fs, 0, s->s_nfs * sizeof(quota_fs_t));
+    for (;;) {
+        if ((rc = read_all(rfd, &req, sizeof(req))) <= 0)
+            _exit(rc < 0);
+        assert(req.fq_count > 0 && req.fq_count <= FETCH_BATCH);
+        for (i = 0; s->s_fs[i] != req.fq_fs; i++)
+            ;
+        if (!fs[i])
+            fs[i] = quota_fs_create_conf(conf[req.fq_fs]);
+        t0 = now();
+        bulk = quota_get_many(fs[i], uid + req.fq_idx, qv, rcv, req.fq_count);
+        rtt = now() - t0;
+        memset(rec, 0, req.fq_count * sizeof(struct fetch_rec));
+        for (j = 0; j < req.fq_count; j++) {
+            q = qv[j];
+            rec[j].fr_rtt = rtt;
+            rec[j].fr_bulk = bulk;
+            if (rcv[j] == QUOTA_TIMEDOUT)
+                rec[j].fr_status = FETCH_TIMEDOUT;
+            else if (rcv[j] != 0 || !qfilter_match(q, filter))
+                rec[j].fr_status = FETCH_NONE;
+            else {
+                rec[j].fr_status = FETCH_OK;
+                rec[j].fr_bytes_state = q->q_bytes_state;
+                rec[j].fr_files_state = q->q_files_state;
+                rec[j].fr_bytes_used = q->q_bytes_used;
+                rec[j].fr_bytes_softlim = q->q_bytes_softlim;
+                rec[j].fr_bytes_hardlim = q->q_bytes_hardlim;
+                rec[j].fr_bytes_secleft = q->q_bytes_secleft;
+                rec[j].fr_files_used = q->q_files_used;
+                rec[j].fr_files_softlim = q->q_files_softlim;
+                rec[j].fr_files_hardlim = q->q_files_hardlim;
+                rec[j].fr_files_secleft = q->q_files_secleft;
+            }
+            quota_destroy(q);
+        }
+        if (write_all(wfd, rec, req.fq_count * sizeof(struct fetch_rec)) < 0)
+            _exit(1);
+    }
+}
+
+/* Fork a worker for server s.  The worker must not hold any other
+ * worker's pipes open, or they would not see EOF when the parent closes
+ * them.
+ */
+static void
+spawn(struct server *sv, int nsv, struct server *s, confent_t **conf,
+      uid_t *uid, struct qfilter *filter)
+{
+    struct worker *w;
+    int req[2], rep[2];
+    int i, j;
+
+    if (pipe(req) < 0 || pipe(rep) < 0) {
+        fprintf(stderr, "%s: pipe: %s\n", prog, strerror(errno));
+        exit(1);
+    }
+    s->s_w = xrealloc(s->s_w, (s->s_nw + 1) * sizeof(struct worker));
+    w = &s->s_w[s->s_nw];
+    fflush(stdout);
+    fflush(stderr);
+    switch ((w->w_pid = fork())) {
+        case -1:
+            fprintf(stderr, "%s: fork: %s\n", prog, strerror(errno));
+            exit(1);
+        case 0:
+            close(req[1]);
+            close(rep[0]);
+            for (i = 0; i < nsv; i++) {
+                for (j = 0; j < sv[i].s_nw; j++) {
+                    if (sv[i].s_w[j].w_req >= 0)
+                        close(sv[i].s_w[j].w_req);
+                    if (sv[i].s_w[j].w_fd >= 0)
+                        close(sv[i].s_w[j].w_fd);
+                }
+            }
+            fetch_worker(s, conf, uid, filter, req[0], rep[1]);
+            /*NOTREACHED*/
+    }
+    close(req[0]);
+    close(rep[1]);
+    w->w_req = req[1];
+    w->w_fd = rep[0];
+    w->w_busy = 0;
+    w->w_len = 0;
+    s->s_nw++;
+    s->s_nlive++;
+}
+
+static int
+pending(struct server *s)
+{
+    return s->s_nretry > 0 || s->s_next < s->s_ntask;
+}
+
+/* Take the next query: a retry, else up to s_batch uid's from each file
+ * system in turn.
+ */
+static struct fetch_req
+next_req(struct server *s)
+{
+    struct fetch_req req;
+    int f;
+
+    if (s->s_nretry > 0)
+        return s->s_retry[--s->s_nretry];
+    while (s->s_idx[s->s_rr] == s->s_nuid)
+        s->s_rr = (s->s_rr + 1) % s->s_nfs;
+    f = s->s_rr;
+    req.fq_fs = s->s_fs[f];
+    req.fq_idx = s->s_idx[f];
+    req.fq_count = s->s_nuid - s->s_idx[f];
+    if (req.fq_count > s->s_batch)
+        req.fq_count = s->s_batch;
+    req.fq_try = 0;
+    s->s_idx[f] += req.fq_count;
+    s->s_next += req.fq_count;
+    s->s_rr = (f + 1) % s->s_nfs;
+    return req;
+}
+
+static void
+requeue(struct server *s, struct fetch_req *req, int try)
+{
+    s->s_retry = xrealloc(s->s_retry, (s->s_nretry + 1) * sizeof(*req));
+    s->s_retry[s->s_nretry] = *req;
+    s->s_retry[s->s_nretry++].fq_try = try;
+}
+
+/* A worker has exited or failed: stop using it.
+ */
+static void
+retire(struct server *s, struct worker *w)
+{
+    if (w->w_req >= 0)
+        close(w->w_req);
+    close(w->w_fd);
+    w->w_req = w->w_fd = -1;
+    s->s_nlive--;
+}
+
+/* Send server s as many queries as its window and rate limit allow.
+ * Return the seconds until the rate limit allows the next, or -1.
+ */
+static double
+dispatch(struct server *sv, int nsv, struct server *s, confent_t **conf,
+         uid_t *uid, struct qfilter *filter, int ceiling)
+{
+    struct fetch_req req;
+    struct worker *w;
+    double wait, t;
+    int i, j, total;
+
+    /* Free the slots of idle workers the window no longer needs.
+     */
+    for (i = 0; i < s->s_nw && s->s_nlive > (int)aimd_window(s->s_aimd); i++)
+        if (s->s_w[i].w_fd >= 0 && !s->s_w[i].w_busy)
+            retire(s, &s->s_w[i]);
+
+    while (pending(s)) {
+        t = now();
+        if ((wait = aimd_wait(s->s_aimd, t)) != 0)
+            return wait;
+        for (i = 0; i < s->s_nw; i++)
+            if (s->s_w[i].w_fd >= 0 && !s->s_w[i].w_busy)
+                break;
+        if (i == s->s_nw) {
+            for (j = 0, total = 0; j < nsv; j++)
+                total += sv[j].s_nlive;
+            if (s->s_nlive >= ceiling || total >= FETCH_WORKERS)
+                return -1;
+            spawn(sv, nsv, s, conf, uid, filter);
+        }
+        w = &s->s_w[i];
+        req = next_req(s);
+        if (write_all(w->w_req, &req, sizeof(req)) < 0) {
+            requeue(s, &req, req.fq_try);
+            retire(s, w);
+            continue;
+        }
+        w->w_cur = req;
+        w->w_sent = t;
+        w->w_busy = 1;
+        w->w_got = 0;
+        w->w_timedout = 0;
+        aimd_sent(s->s_aimd, t);
+        if (s->s_queries++ == 0)
+            s->s_first = t;
+    }
+    return -1;
+}
+
+/* Handle the result in w's buffer, for the next uid of w's query.  A
+ * uid that timed out is retried once on its own.  When the last result
+ * is in, the query counts as one reply, or one timeout, to the window,
+ * and its time, which is that of the whole batch, once to the mean.
+ */
+static void
+deliver(struct server *s, struct worker *w, confent_t **conf, uid_t *uid,
+        fetch_f fn, void *arg)
+{
+    struct fetch_rec rec;
+    struct fetch_req retry;
+    confent_t *cp = conf[w->w_cur.fq_fs];
+    int idx = w->w_cur.fq_idx + w->w_got;
+    quota_t q;
+
+    memcpy(&rec, w->w_buf, sizeof(rec));
+    w->w_len = 0;
+    if (++w->w_got == w->w_cur.fq_count) {
+        w->w_busy = 0;
+        if (w->w_timedout || rec.fr_status == FETCH_TIMEDOUT)
+            aimd_timeout(s->s_aimd, w->w_sent, now());
+        else
+            aimd_reply(s->s_aimd, w->w_sent, rec.fr_rtt);
+        s->s_rttsum += rec.fr_rtt;
+        s->s_answered++;
+    }
+    s->s_batch = rec.fr_bulk ? FETCH_BATCH : 1;
+    s->s_replies++;
+    s->s_last = now();
+    if (rec.fr_status == FETCH_TIMEDOUT) {
+        w->w_timedout = 1;
+        s->s_timeouts++;
+        if (w->w_cur.fq_try == 0) {
+            retry = w->w_cur;
+            retry.fq_idx = idx;
+            retry.fq_count = 1;
+            requeue(s, &retry, 1);
+        }
+        return;
+    }
+    if (rec.fr_status != FETCH_OK)
+        return;
+    q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, cp->cf_thresh);
+    q->q_uid = uid[idx];
+    q->q_bytes_state = rec.fr_bytes_state;
+    q->q_files_state = rec.fr_files_state;
+    q->q_bytes_used = rec.fr_bytes_used;
+    q->q_bytes_softlim = rec.fr_bytes_softlim;
+    q->q_bytes_hardlim = rec.fr_bytes_hardlim;
+    q->q_bytes_secleft = rec.fr_bytes_secleft;
+    q->q_files_used = rec.fr_files_used;
+    q->q_files_softlim = rec.fr_files_softlim;
+    q->q_files_hardlim = rec.fr_files_hardlim;
+    q->q_files_secleft = rec.fr_files_secleft;
+    fn(w->w_cur.fq_fs, idx, q, arg);
+}
+
+/* Longest expected time first, unknown servers before all.
+ */
+static int
+cmp_cost(const void *a, const void *b)
+{
+    const struct server *x = a, *y = b;
+
+    if ((x->s_cost == 0) != (y->s_cost == 0))
+        return x->s_cost == 0 ? -1 : 1;
+    return x->s_cost > y->s_cost ? -1 : x->s_cost < y->s_cost ? 1 : 0;
+}
+
+/* Query uid[0..nuid-1] on each of conf[0..nconf-1] concurrently, subject
+ * to opts.  For each result that passes filter, call fn with the file
+ * system index, the uid index, and a quota_t that fn takes ownership of.
+ * Results arrive in no particular order.  Return 0 on success, -1 if any
+ * worker process failed.
+ */
+int
+fetch_all(confent_t **conf, int nconf, uid_t *uid, int nuid,
+          struct qfilter *filter, struct fetch_opts *opts, fetch_f fn,
+          void *arg)
+{
+    struct server *sv = xmalloc(nconf * sizeof(struct server));
+    int ceiling = opts->fo_ceiling;
+    double rtt, qps, window;
+    struct pollfd *pfd = NULL;
+    struct server **ps = NULL;
+    struct worker **pw = NULL;
+    void (*sigpipe)(int);
+    double wait, w;
+    int i, j, k, n, nsv = 0, npfd, status, rc = 0;
+
+    assert(ceiling > 0);
+    memset(sv, 0, nconf * sizeof(struct server));
+    for (i = 0; i < nconf; i++) {
+        for (j = 0; j < nsv; j++)
+            if (!strcmp(sv[j].s_rhost, conf[i]->cf_rhost))
+                break;
+        if (j == nsv) {
+            sv[nsv].s_rhost = conf[i]->cf_rhost;
+            sv[nsv].s_fs = xmalloc(nconf * sizeof(int));
+            sv[nsv].s_idx = xmalloc(nconf * sizeof(int));
+            memset(sv[nsv].s_idx, 0, nconf * sizeof(int));
+            sv[nsv].s_nuid = nuid;
+            sv[nsv].s_batch = 1;
+            sv[nsv].s_aimd = aimd_create(ceiling, opts->fo_rate);
+            nsv++;
+        }
+        sv[j].s_fs[sv[j].s_nfs++] = i;
+    }
+    for (j = 0; j < nsv; j++) {
+        sv[j].s_ntask = (long)sv[j].s_nfs * nuid;
+        if (opts->fo_stats && srvstat_get(opts->fo_stats, sv[j].s_rhost,
+                                          &rtt, &qps, &window) == 0) {
+            aimd_set_window(sv[j].s_aimd, window);
+            if (qps > 0)
+                sv[j].s_cost = sv[j].s_ntask / qps;
+            else if (rtt > 0)
+                sv[j].s_cost = sv[j].s_ntask * rtt;
+        }
+    }
+    qsort(sv, nsv, sizeof(struct server), cmp_cost);
+
+    sigpipe = signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        /* Keep each server's window full.  A server with nothing more to
+         * send and nothing in flight has its workers told to exit.
+         */
+        wait = -1;
+        npfd = 0;
+        for (j = 0; j < nsv; j++) {
+            w = dispatch(sv, nsv, &sv[j], conf, uid, filter, ceiling);
+            if (w >= 0 && (wait < 0 || w < wait))
+                wait = w;
+            if (!pending(&sv[j]) && aimd_inflight(sv[j].s_aimd) == 0) {
+                for (i = 0; i < sv[j].s_nw; i++) {
+                    if (sv[j].s_w[i].w_req >= 0) {
+                        close(sv[j].s_w[i].w_req);
+                        sv[j].s_w[i].w_req = -1;
+                    }
+                }
+            }
+            npfd += sv[j].s_nlive;
+        }
+        if (npfd == 0 && wait < 0)
+            break;
+
+        pfd = xrealloc(pfd, (npfd + 1) * sizeof(struct pollfd));
+        ps = xrealloc(ps, (npfd + 1) * sizeof(struct server *));
+        pw = xrealloc(pw, (npfd + 1) * sizeof(struct worker *));
+        for (j = 0, k = 0; j < nsv; j++) {
+            for (i = 0; i < sv[j].s_nw; i++) {
+                if (sv[j].s_w[i].w_fd < 0)
+                    continue;
+                pfd[k].fd = sv[j].s_w[i].w_fd;
+                pfd[k].events = POLLIN;
+                pfd[k].revents = 0;
+                ps[k] = &sv[j];
+                pw[k++] = &sv[j].s_w[i];
+            }
+        }
+        if (poll(pfd, npfd, wait < 0 ? -1 : (int)(wait * 1000) + 1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "%s: poll: %s\n", prog, strerror(errno));
+            exit(1);
+        }
+        for (k = 0; k < npfd; k++) {
+            if (pfd[k].revents == 0)
+                continue;
+            n = read(pw[k]->w_fd, pw[k]->w_buf + pw[k]->w_len,
+                     sizeof(pw[k]->w_buf) - pw[k]->w_len);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                if (n < 0 || pw[k]->w_busy) {
+                    if (pw[k]->w_busy) {
+                        aimd_timeout(ps[k]->s_aimd, pw[k]->w_sent, now());
+                        pw[k]->w_busy = 0;
+                    }
+                    rc = -1;
+                }
+                retire(ps[k], pw[k]);
+                continue;
+            }
+            if ((pw[k]->w_len += n) == sizeof(pw[k]->w_buf) && pw[k]->w_busy)
+                deliver(ps[k], pw[k], conf, uid, fn, arg);
+        }
+    }
+    signal(SIGPIPE, sigpipe);
+
+    for (j = 0; j < nsv; j++) {
+        for (i = 0; i < sv[j].s_nw; i++) {
+            while (waitpid(sv[j].s_w[i].w_pid, &status, 0) < 0
+                                    && errno == EINTR)
+                ;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "%s: %s: query process failed\n",
+                        prog, sv[j].s_rhost);
+                rc = -1;
+            }
+        }
+        if (debug)
+            fprintf(stderr, "%s: %s: %ld queries, %ld timed out, "
+                    "%d workers, window %.1f\n", prog, sv[j].s_rhost,
+                    sv[j].s_queries, sv[j].s_timeouts, sv[j].s_nw,
+                    aimd_window(sv[j].s_aimd));
+        if (opts->fo_stats && sv[j].s_answered > 0)
+            srvstat_put(opts->fo_stats, sv[j].s_rhost,
+                        sv[j].s_rttsum / sv[j].s_answered,
+                        sv[j].s_last > sv[j].s_first
+                        ? sv[j].s_replies / (sv[j].s_last - sv[j].s_first) : 0,
+                        aimd_window(sv[j].s_aimd), time(NULL));
+        aimd_destroy(sv[j].s_aimd);
+        free(sv[j].s_fs);
+        free(sv[j].s_idx);
+        if (sv[j].s_retry)
+            free(sv[j].s_retry);
+        if (sv[j].s_w)
+            free(sv[j].s_w);
+    }
+    if (pfd)
+        free(pfd);
+    if (ps)
+        free(ps);
+    if (pw)
+        free(pw);
+    free(sv);
+    return rc;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
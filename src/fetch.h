@@ -0,0 +1,46 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Query a set of users on several file systems at once.
+ */
+
+typedef void (*fetch_f)(int fs, int idx, quota_t q, void *arg);
+
+#define FETCH_CEILING   8       /* default queries in flight per server */
+#define FETCH_WORKERS   64      /* worker processes at most, in all */
+
+struct fetch_opts {
+    int         fo_ceiling;     /* queries in flight per server at most */
+    double      fo_rate;        /* queries per second per server, 0 = any */
+    srvstat_t   fo_stats;       /* learned on earlier runs, or NULL */
+};
+
+int fetch_all(confent_t **conf, int nconf, uid_t *uid, int nuid,
+              struct qfilter *filter, struct fetch_opts *opts, fetch_f fn,
+              void *arg);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,162 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Record filters for repquota, tested on each record as it is fetched
+ * so that records which fail are dropped before the user name lookup,
+ * sort and formatting.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "filter.h"
+
+int
+qfilter_active(struct qfilter *f)
+{
+    return (f->f_oversoft || f->f_overpct || f->f_hasstate
+                || f->f_minbytes || f->f_nonzero);
+}
+
+/* Return 1 if q passes all of the filters in f, given whether its space
+ * and files have reached f->f_overpct percent of their hard limits.
+ */
+static int
+match(quota_t q, struct qfilter *f, int overbytes, int overfiles)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    if (f->f_nonzero && !q->q_bytes_used && !q->q_files_used)
+        return 0;
+    if (q->q_bytes_used < f->f_minbytes)
+        return 0;
+    if (f->f_oversoft
+            && !(q->q_bytes_softlim && q->q_bytes_used > q->q_bytes_softlim)
+            && !(q->q_files_softlim && q->q_files_used > q->q_files_softlim))
+        return 0;
+    if (f->f_overpct && !(q->q_bytes_hardlim && overbytes)
+                     && !(q->q_files_hardlim && overfiles))
+        return 0;
+    if (f->f_hasstate && q->q_bytes_state != f->f_state
+                      && q->q_files_state != f->f_state)
+        return 0;
+    return 1;
+}
+
+/* Return 1 if q passes all of the filters in f.
+ */
+int
+qfilter_match(quota_t q, struct qfilter *f)
+{
+    int overbytes = 0, overfiles = 0;
+
+    if (f->f_overpct) {
+        overbytes = qstate_over_thresh(q->q_bytes_used, q->q_bytes_hardlim,
+                                       f->f_overpct);
+        overfiles = qstate_over_thresh(q->q_files_used, q->q_files_hardlim,
+                                       f->f_overpct);
+    }
+    return match(q, f, overbytes, overfiles);
+}
+
+/* Set keep[i] to 1 for each of the n records in qv[] that was found
+ * (rcv[i] == 0) and passes all of the filters in f, else to 0.  The
+ * f_overpct test is made over the whole batch with qstate_classify().
+ */
+void
+qfilter_match_many(quota_t *qv, int *rcv, int n, struct qfilter *f,
+                   unsigned char *keep)
+{
+    unsigned long long *used, *hard, *zero;
+    unsigned char *overbytes, *overfiles;
+    long long *left;
+    qstate_t *state;
+    int i;
+
+    if (!f->f_overpct) {
+        for (i = 0; i < n; i++)
+            keep[i] = !rcv[i] && match(qv[i], f, 0, 0);
+        return;
+    }
+    used = xmalloc(n * sizeof(*used));
+    hard = xmalloc(n * sizeof(*hard));
+    zero = xmalloc(n * sizeof(*zero));
+    left = xmalloc(n * sizeof(*left));
+    state = xmalloc(n * sizeof(*state));
+    overbytes = xmalloc(n);
+    overfiles = xmalloc(n);
+    memset(zero, 0, n * sizeof(*zero));
+    memset(left, 0, n * sizeof(*left));
+    for (i = 0; i < n; i++) {
+        used[i] = qv[i]->q_bytes_used;
+        hard[i] = qv[i]->q_bytes_hardlim;
+    }
+    qstate_classify(n, used, zero, hard, left, f->f_overpct, state,
+                    overbytes);
+    for (i = 0; i < n; i++) {
+        used[i] = qv[i]->q_files_used;
+        hard[i] = qv[i]->q_files_hardlim;
+    }
+    qstate_classify(n, used, zero, hard, left, f->f_overpct, state,
+                    overfiles);
+    for (i = 0; i < n; i++)
+        keep[i] = !rcv[i] && match(qv[i], f, overbytes[i], overfiles[i]);
+    free(used);
+    free(hard);
+    free(zero);
+    free(left);
+    free(state);
+    free(overbytes);
+    free(overfiles);
+}
+
+/* Parse a state name as printed by qstate_str().
+ * Return 0 on success, -1 if not recognized.
+ */
+int
+qfilter_parse_state(char *s, qstate_t *state)
+{
+    qstate_t st;
+
+    for (st = NONE; st <= EXPIRED; st++) {
+        if (!strcmp(s, qstate_str(st))) {
+            *state = st;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
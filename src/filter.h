@@ -0,0 +1,47 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Record filters for repquota.  A record passes if it matches every
+ * filter that is set.  A zeroed struct passes everything.
+ */
+
+struct qfilter {
+    int                 f_oversoft;     /* over a soft limit */
+    int                 f_overpct;      /* >= pct of a hard limit (0=unset) */
+    int                 f_hasstate;     /* f_state is set */
+    qstate_t            f_state;        /* space or files in this state */
+    unsigned long long  f_minbytes;     /* at least this much space used */
+    int                 f_nonzero;      /* some space or files used */
+};
+
+int qfilter_active(struct qfilter *f);
+int qfilter_match(quota_t q, struct qfilter *f);
+void qfilter_match_many(quota_t *qv, int *rcv, int n, struct qfilter *f,
+                        unsigned char *keep);
+int qfilter_parse_state(char *s, qstate_t *state);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
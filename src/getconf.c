@@ -60,7 +60,8 @@ next_field(char **str, char sep)
     while (**str != '\0' && **str != sep && **str != '\n')
         (*str)++;
 
-    *(*str)++ = '\0';
+    if (**str != '\0')     /* don't run off the end on missing fields */
+        *(*str)++ = '\0';
 
     return rv;
 }
@@ -83,6 +84,28 @@ zap_trailing_spaces(char *str)
         *p-- = '\0';
 }
 
+/*
+ * Helper for getconfent().  Parse the comma-separated flags field.
+ * Unrecognized flags are ignored.
+ */
+static void
+parse_flags(confent_t *e, char *flags)
+{
+    char *flag;
+
+    while (*flags) {
+        flag = next_field(&flags, ',');
+        if (!strcmp(flag, "nolimit"))
+            e->cf_nolimit = 1;
+        else if (!strncmp(flag, "snapshot=", 9) && flag[9]) {
+            if (e->cf_snapshot)
+                free(e->cf_snapshot);
+            e->cf_snapshot = xstrdup(flag + 9);
+        } else if (!strncmp(flag, "maxage=", 7))
+            e->cf_maxage = strtoul(flag + 7, NULL, 10);
+    }
+}
+
 /*
  * Read/parse the next configuration file entry.
  * 	RETURN		config file entry (caller must free)
@@ -110,7 +133,10 @@ getconfent(FILE *f)
             e->cf_rhost = xstrdup(rhost);
             e->cf_rpath = xstrdup(rpath);
             e->cf_thresh = thresh ? strtoul(thresh, NULL, 10) : 0;
-            e->cf_nolimit = !strcmp(flags, "nolimit") ? 1 : 0;
+            e->cf_nolimit = 0;
+            e->cf_snapshot = NULL;
+            e->cf_maxage = CONF_DEFAULT_MAXAGE;
+            parse_flags(e, flags);
             break;
         }
     }
@@ -128,6 +154,8 @@ freeconfent(confent_t *e)
             free(e->cf_rhost);
         if (e->cf_rpath)
             free(e->cf_rpath);
+        if (e->cf_snapshot)
+            free(e->cf_snapshot);
         free(e);
     }
 }
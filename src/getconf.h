@@ -22,14 +22,18 @@
  *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
 \*****************************************************************************/
 
-typedef struct {
+typedef struct confent_struct {
     char *cf_label;
     char *cf_rhost;
     char *cf_rpath;
     int   cf_thresh;
     int   cf_nolimit;
+    char *cf_snapshot;      /* snapshot to answer quota(1) from, or NULL */
+    int   cf_maxage;        /* seconds before cf_snapshot is stale */
 } confent_t;
 
+#define CONF_DEFAULT_MAXAGE (24*60*60)
+
 #ifndef _PATH_QUOTA_CONF
 #define _PATH_QUOTA_CONF "/etc/quota.conf"
 #endif
@@ -37,11 +37,86 @@
 
 #include "list.h"
 #include "util.h"
+#include "getconf.h"
 #include "getquota.h"
+#include "qstate.h"
 #include "getquota_private.h"
 
 extern char *prog;
 
+static int quota_get_test(uid_t uid, quota_t q);
+static int quota_get_failed(uid_t uid, quota_t q);
+
+static struct quota_backend backend_test = {
+    "test", NULL, quota_get_test, NULL, NULL
+};
+
+/* The context of a file system whose backend could not be initialized.
+ */
+static struct quota_backend backend_failed = {
+    NULL, NULL, quota_get_failed, NULL, NULL
+};
+
+static struct quota_backend *backends[] = {
+    &backend_test,
+    &quota_backend_lustre,
+    NULL
+};
+
+/* Create the context for querying a file system.  Its backend is chosen
+ * here, once, by rhost.
+ */
+quota_fs_t
+quota_fs_create(char *label, char *rhost, char *rpath, int thresh)
+{
+    quota_fs_t fs = xmalloc(sizeof(struct quota_fs_struct));
+    int i;
+
+    memset(fs, 0, sizeof(struct quota_fs_struct));
+    fs->fs_magic = QUOTA_FS_MAGIC;
+    fs->fs_refs = 1;
+    fs->fs_label = xstrdup(label);
+    fs->fs_rhost = xstrdup(rhost);
+    fs->fs_rpath = xstrdup(rpath);
+    fs->fs_thresh = thresh;
+    fs->fs_ops = &quota_backend_nfs;
+    for (i = 0; backends[i] != NULL; i++) {
+        if (!strcmp(rhost, backends[i]->qb_name)) {
+            fs->fs_ops = backends[i];
+            break;
+        }
+    }
+    if (fs->fs_ops->qb_init && fs->fs_ops->qb_init(fs) < 0)
+        fs->fs_ops = &backend_failed;
+    return fs;
+}
+
+/* Create the context for querying the file system of a quota.conf entry.
+ */
+quota_fs_t
+quota_fs_create_conf(confent_t *cp)
+{
+    return quota_fs_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath,
+                           cp->cf_thresh);
+}
+
+/* Drop a reference to fs; each quota_t made from it holds one too.
+ */
+void
+quota_fs_destroy(quota_fs_t fs)
+{
+    assert(fs->fs_magic == QUOTA_FS_MAGIC);
+    if (--fs->fs_refs > 0)
+        return;
+    if (fs->fs_ops->qb_fini)
+        fs->fs_ops->qb_fini(fs);
+    free(fs->fs_label);
+    free(fs->fs_rhost);
+    free(fs->fs_rpath);
+    memset(fs, 0, sizeof(struct quota_fs_struct));
+    free(fs);
+}
+
 quota_t
 quota_create(char *label, char *rhost, char *rpath, int thresh)
 {
@@ -58,10 +133,27 @@ quota_create(char *label, char *rhost, char *rpath, int thresh)
     return q;
 }
 
+/* Create a quota that can be passed to quota_get() for file system fs.
+ */
+quota_t
+quota_create_fs(quota_fs_t fs)
+{
+    quota_t q;
+
+    assert(fs->fs_magic == QUOTA_FS_MAGIC);
+    q = quota_create(fs->fs_label, fs->fs_rhost, fs->fs_rpath, fs->fs_thresh);
+    q->q_fs = fs;
+    fs->fs_refs++;
+
+    return q;
+}
+
 void
 quota_destroy(quota_t q)
 {
     assert(q->q_magic == QUOTA_MAGIC);
+    if (q->q_fs)
+        quota_fs_destroy(q->q_fs);
     if (q->q_name)
         free(q->q_name);
     if (q->q_label)
@@ -74,10 +166,10 @@ quota_destroy(quota_t q)
     free(q);
 }
 
-#ifndef NDEBUG
 static int
 quota_get_test(uid_t uid, quota_t q)
 {
+#ifndef NDEBUG
     int rc = 0;
 
     q->q_uid = uid;
@@ -147,35 +239,62 @@ quota_get_test(uid_t uid, quota_t q)
             break;
     }
     return rc;
-}
+#else
+    fprintf(stderr, "%s: compiled with -DNDEBUG\n", prog);
+    return 1;
 #endif
+}
+
+static int
+quota_get_failed(uid_t uid, quota_t q)
+{
+    return 1;
+}
 
+/* Query uid's quota into q, which must come from quota_create_fs().
+ */
 int 
 quota_get(uid_t uid, quota_t q)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    assert(q->q_fs != NULL);
+    return q->q_fs->fs_ops->qb_get(uid, q);
+}
+
+/* quota_get(), but QUOTA_TIMEDOUT if the server did not answer.
+ */
+int
+quota_get_status(uid_t uid, quota_t q)
 {
     int rc;
 
-    assert(q->q_magic == QUOTA_MAGIC);
-    if (!strcmp(q->q_rhost, "test")) {
-#ifndef NDEBUG
-        rc = quota_get_test(uid, q);
-#else
-        fprintf(stderr, "%s: compiled with -DNDEBUG\n", prog);
-        rc = 1;
-#endif
-    } else if (!strcmp(q->q_rhost, "lustre")) {
-#if HAVE_LIBLUSTREAPI
-        rc = quota_get_lustre(uid, q);        
-#else
-        fprintf(stderr, "%s: not configured with lustre support\n", prog);
-        rc = 1;
-#endif
-    } else {
-        rc = quota_get_nfs(uid, q);        
-    }
+    errno = 0;
+    if ((rc = quota_get(uid, q)) != 0 && errno == ETIMEDOUT)
+        rc = QUOTA_TIMEDOUT;
     return rc;
 }
 
+/* Query the quotas of uid[0..n-1] on fs.  qv[i] is set to a new quota
+ * for uid[i], and rcv[i] to 0 if it was found, QUOTA_TIMEDOUT if the
+ * server did not answer, else nonzero; the caller destroys the quotas.
+ * The backend may answer them all at once, else they are queried one at
+ * a time.  Returns 1 if they were answered together, else 0.
+ */
+int
+quota_get_many(quota_fs_t fs, uid_t *uid, quota_t *qv, int *rcv, int n)
+{
+    int i;
+
+    assert(fs->fs_magic == QUOTA_FS_MAGIC);
+    for (i = 0; i < n; i++)
+        qv[i] = quota_create_fs(fs);
+    if (fs->fs_ops->qb_get_batch)
+        return fs->fs_ops->qb_get_batch(uid, qv, rcv, n);
+    for (i = 0; i < n; i++)
+        rcv[i] = quota_get_status(uid[i], qv[i]);
+    return 0;
+}
+
 void
 quota_adduser(quota_t q, char *name)
 {
@@ -183,6 +302,20 @@ quota_adduser(quota_t q, char *name)
     q->q_name = xstrdup(name);
 }
 
+unsigned long long
+quota_bytes_used(quota_t q)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    return q->q_bytes_used;
+}
+
+unsigned long long
+quota_files_used(quota_t q)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    return q->q_files_used;
+}
+
 int
 quota_match_uid(quota_t x, uid_t *key)
 {
@@ -269,103 +402,6 @@ quota_cmp_files_reverse(quota_t x, quota_t y)
     return -1;
 }
 
-void
-quota_report_heading(void)
-{
-    printf("%-10s %-11s %-11s %-11s %-12s %-12s %-12s\n", "User", 
-            "Space-used", "Space-soft", "Space-hard",
-            "Files-used", "Files-soft", "Files-hard");
-}
-
-void
-quota_report_heading_usageonly(void)
-{
-    printf("%-10s %-11s %-12s\n", "User", "Space-used", "Files-used");
-}
-
-int
-quota_report(quota_t x, unsigned long *bsize)
-{
-    assert(x->q_magic == QUOTA_MAGIC);
-    if (x->q_name) {
-        printf("%-10s %-11llu %-11llu %-11llu %-12llu %-12llu %-12llu\n",
-            x->q_name, 
-            x->q_bytes_used    / *bsize,
-            x->q_bytes_softlim / *bsize,
-            x->q_bytes_hardlim / *bsize,
-            x->q_files_used,
-            x->q_files_softlim,
-            x->q_files_hardlim);
-    } else {
-        printf("%-10u %-11llu %-11llu %-11llu %-12llu %-12llu %-12llu\n",
-            x->q_uid, 
-            x->q_bytes_used    / *bsize,
-            x->q_bytes_softlim / *bsize,
-            x->q_bytes_hardlim / *bsize,
-            x->q_files_used,
-            x->q_files_softlim,
-            x->q_files_hardlim);
-    }
-    return 0;
-}
-
-int
-quota_report_h(quota_t x, unsigned long *bsize)
-{
-    char used[64], soft[64], hard[64];
-
-    assert(x->q_magic == QUOTA_MAGIC);
-
-    size2str(x->q_bytes_used, used, sizeof(used));
-    size2str(x->q_bytes_softlim, soft, sizeof(soft));
-    size2str(x->q_bytes_hardlim, hard, sizeof(hard));
-
-    if (x->q_name) {
-        printf("%-10s %-11s %-11s %-11s %-12llu %-12llu %-12llu\n", x->q_name,
-            used, soft, hard,
-            x->q_files_used,
-            x->q_files_softlim,
-            x->q_files_hardlim);
-    } else {
-        printf("%-10u %-11s %-11s %-11s %-12llu %-12llu %-12llu\n", x->q_uid, 
-            used, soft, hard,
-            x->q_files_used,
-            x->q_files_softlim,
-            x->q_files_hardlim);
-    }
-    return 0;
-}
-
-int
-quota_report_usageonly(quota_t x, unsigned long *bsize)
-{
-    assert(x->q_magic == QUOTA_MAGIC);
-    if (x->q_name) {
-        printf("%-10s %-11llu %-12llu\n", x->q_name, 
-            x->q_bytes_used / *bsize, x->q_files_used);
-    } else {
-        printf("%-10u %-11llu %-12llu\n", x->q_uid, 
-            x->q_bytes_used / *bsize, x->q_files_used);
-    }
-    return 0;
-}
-
-int
-quota_report_usageonly_h(quota_t x, unsigned long *bsize)
-{
-    char used[64];
-
-    assert(x->q_magic == QUOTA_MAGIC);
-
-    size2str(x->q_bytes_used, used, sizeof(used));
-
-    if (x->q_name)
-        printf("%-10s %-11s %-12llu\n", x->q_name, used, x->q_files_used);
-    else
-        printf("%-10u %-11s %-12llu\n", x->q_uid, used, x->q_files_used);
-    return 0;
-}
-
 void
 quota_print_heading(char *name)
 {
@@ -399,15 +435,6 @@ daystr(qstate_t state, unsigned long long secs, char *str, int len)
     }
 }
 
-/* helper for quota_print() */
-static int
-over_thresh(unsigned long long used, unsigned long long hard, int thresh)
-{
-    if (thresh && used >= hard * (thresh/100.0))
-        return 1;
-    return 0;
-}
-
 /* helper for quota_print() */
 static int
 report_warning(quota_t q, char *label, char *prefix)
@@ -419,7 +446,8 @@ report_warning(quota_t q, char *label, char *prefix)
         case NONE:
             break;
         case UNDER:
-            if (over_thresh(q->q_bytes_used, q->q_bytes_hardlim, q->q_thresh)) {
+            if (qstate_over_thresh(q->q_bytes_used, q->q_bytes_hardlim,
+                                   q->q_thresh)) {
                 printf("%sBlock usage on %s has exceeded %d%% of quota.\n",
                     prefix, label, q->q_thresh);
                 msg++;
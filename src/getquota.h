@@ -23,12 +23,24 @@
 \*****************************************************************************/
 
 typedef struct quota_struct *quota_t;
+typedef struct quota_fs_struct *quota_fs_t;
+struct confent_struct;
+
+quota_fs_t quota_fs_create(char *label, char *rhost, char *rpath, int thresh);
+quota_fs_t quota_fs_create_conf(struct confent_struct *cp);
+void quota_fs_destroy(quota_fs_t fs);
 
 quota_t quota_create(char *label, char *rhost, char *rpath, int thresh);
+quota_t quota_create_fs(quota_fs_t fs);
 void quota_destroy(quota_t q);
 
+#define QUOTA_TIMEDOUT (-2)     /* quota_get_many(): server did not answer */
+
 int quota_get(uid_t uid, quota_t q);
+int quota_get_many(quota_fs_t fs, uid_t *uid, quota_t *qv, int *rcv, int n);
 void quota_adduser(quota_t q, char *name);
+unsigned long long quota_bytes_used(quota_t q);
+unsigned long long quota_files_used(quota_t q);
 
 int quota_match_uid(quota_t x, uid_t *key);
 int quota_cmp_uid(quota_t x, quota_t y);
@@ -38,13 +50,6 @@ int quota_cmp_bytes_reverse(quota_t x, quota_t y);
 int quota_cmp_files(quota_t x, quota_t y);
 int quota_cmp_files_reverse(quota_t x, quota_t y);
 
-void quota_report_heading(void);
-void quota_report_heading_usageonly(void);
-int quota_report(quota_t x, unsigned long *bsize);
-int quota_report_usageonly(quota_t x, unsigned long *bsize);
-int quota_report_h(quota_t x, unsigned long *bsize);
-int quota_report_usageonly_h(quota_t x, unsigned long *bsize);
-
 void quota_print_heading(char *name);
 int quota_print(quota_t x, void *arg);
 int quota_print_realpath(quota_t x, void *arg);
@@ -25,11 +25,13 @@
 #if HAVE_CONFIG_H
 #include "config.h"
 #endif
-#if HAVE_LIBLUSTREAPI
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <assert.h>
+#if HAVE_LIBLUSTREAPI
 #include <sys/vfs.h>
 #include <time.h>
 #include <errno.h>
@@ -38,57 +40,50 @@
 #ifndef QUOTABLOCK_SIZE
 #define QUOTABLOCK_SIZE (1 << 10)
 #endif
-#include <assert.h>
+#endif
 
 #include "list.h"
 #include "util.h"
 #include "getquota.h"
+#include "qstate.h"
 #include "getquota_private.h"
 
 extern char *prog;
 
-static qstate_t
-set_state(unsigned long long used, unsigned long long soft,
-          unsigned long long hard, unsigned long long xtim, time_t now)
+#if HAVE_LIBLUSTREAPI
+/* liblustreapi is loaded once per file system, when its context is created.
+ */
+struct lustre_state {
+    void *ls_dso;
+    int (*ls_quotactl)(char *mnt, struct if_quotactl *qctl);
+};
+
+static int
+lustre_init(quota_fs_t fs)
 {
-    qstate_t state;
-
-    if (!hard && !soft)
-        state = NONE;
-    else if (hard && used > hard)
-        state = EXPIRED;
-    else if (soft && used > soft)
-        state = xtim > now ? STARTED : NOTSTARTED;
-    else
-        state = UNDER;
-
-    return state;
+    struct lustre_state *ls = xmalloc(sizeof(struct lustre_state));
+
+    memset(ls, 0, sizeof(struct lustre_state));
+    if ((ls->ls_dso = dlopen("liblustreapi.so", RTLD_LAZY | RTLD_LOCAL)))
+        ls->ls_quotactl = dlsym(ls->ls_dso, "llapi_quotactl");
+    fs->fs_state = ls;
+    return 0;
 }
 
-int llapi_quotactl(char *mnt, struct if_quotactl *qctl)
+static void
+lustre_fini(quota_fs_t fs)
 {
-    void *dso = NULL;
-    int (*fun)(char *mnt, struct if_quotactl *qctl);
-    int rc = -1;
+    struct lustre_state *ls = fs->fs_state;
 
-    if (!(dso = dlopen("liblustreapi.so", RTLD_LAZY | RTLD_LOCAL))) {
-        errno = EINVAL;
-        goto done;
-    }
-    if (!(fun = dlsym (dso, "llapi_quotactl"))) {
-        errno = EINVAL;
-        goto done;
-    }
-    rc = fun(mnt, qctl);
-done:
-    if (dso)
-        dlclose(dso);
-    return rc;
+    if (ls->ls_dso)
+        dlclose(ls->ls_dso);
+    free(ls);
 }
 
-int
+static int
 quota_get_lustre(uid_t uid, quota_t q)
 {
+    struct lustre_state *ls;
     time_t now = 0;
     struct if_quotactl qctl;
     struct statfs f;
@@ -115,7 +110,13 @@ quota_get_lustre(uid_t uid, quota_t q)
     memset(&qctl, 0, sizeof(qctl));
     qctl.qc_cmd = LUSTRE_Q_GETQUOTA;
     qctl.qc_id = uid;
-    rc = llapi_quotactl(q->q_rpath, &qctl);
+    ls = q->q_fs->fs_state;
+    if (ls->ls_quotactl)
+        rc = ls->ls_quotactl(q->q_rpath, &qctl);
+    else {
+        errno = EINVAL;
+        rc = -1;
+    }
     if (rc) {
         fprintf(stderr, "%s: llapi_quotactl %s: %s\n", 
                         prog, q->q_rpath, strerror(errno));
@@ -129,21 +130,38 @@ quota_get_lustre(uid_t uid, quota_t q)
         q->q_bytes_used     = dqb->dqb_curspace;
         q->q_bytes_softlim  = dqb->dqb_bsoftlimit * QUOTABLOCK_SIZE;
         q->q_bytes_hardlim  = dqb->dqb_bhardlimit * QUOTABLOCK_SIZE;
-        q->q_bytes_state = set_state(q->q_bytes_used, q->q_bytes_softlim,
-                                     q->q_bytes_hardlim, dqb->dqb_btime, now);
+        q->q_bytes_state = qstate_get(q->q_bytes_used, q->q_bytes_softlim,
+                                      q->q_bytes_hardlim,
+                                      (long long)(dqb->dqb_btime - now));
         if (q->q_bytes_state == STARTED)
             q->q_bytes_secleft = dqb->dqb_btime - now;
 
         q->q_files_used     = dqb->dqb_curinodes;
         q->q_files_softlim  = dqb->dqb_isoftlimit;
         q->q_files_hardlim  = dqb->dqb_ihardlimit;
-        q->q_files_state = set_state(q->q_files_used, q->q_files_softlim,
-                                     q->q_files_hardlim, dqb->dqb_itime, now);
+        q->q_files_state = qstate_get(q->q_files_used, q->q_files_softlim,
+                                      q->q_files_hardlim,
+                                      (long long)(dqb->dqb_itime - now));
         if (q->q_files_state == STARTED)
             q->q_files_secleft = dqb->dqb_itime - now;
     }
     return 0;
 }
+
+struct quota_backend quota_backend_lustre = {
+    "lustre", lustre_init, quota_get_lustre, NULL, lustre_fini
+};
+#else
+static int
+quota_get_lustre(uid_t uid, quota_t q)
+{
+    fprintf(stderr, "%s: not configured with lustre support\n", prog);
+    return 1;
+}
+
+struct quota_backend quota_backend_lustre = {
+    "lustre", NULL, quota_get_lustre, NULL, NULL
+};
 #endif /* HAVE_LIBLUSTREAPI */
 
 /*
@@ -34,7 +34,14 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <rpc/pmap_prot.h>
+#include <rpc/pmap_clnt.h>
 #include <netdb.h>
+#include <poll.h>
+#include <stdint.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -42,11 +49,74 @@
 #include "list.h"
 #include "util.h"
 #include "getquota.h"
+#include "qstate.h"
 #include "getquota_private.h"
 
 #define QUIRK_NETAPP  1 /* (uint32_t)(-1) for any limit == no quota */
 #define QUIRK_DEC     0 /* 2 block block limits == no quota */
 
+#define HEDGE_MAXHOSTS  8       /* hosts in a list at most */
+#define HEDGE_DELAY     0.1     /* seconds before trying the next host ... */
+#define HEDGE_PCT       0.95    /* ... until it can be this percentile */
+#define HEDGE_MINSAMPLES 8      /*     of the latencies of this many ... */
+#define HEDGE_SAMPLES   64      /*     or at most this many replies */
+#define HEDGE_LISTS     16      /* host lists with latencies remembered */
+#define HEDGE_PORTS     32      /* hosts with rquotad's port remembered */
+#define NFS_CLIENTS     32      /* hosts with an RPC client kept open */
+
+#define RPC_RETRY       5.0     /* seconds between retransmissions */
+#define RPC_TIMEOUT     25.0    /* seconds before giving up */
+#define RPC_BUFSIZE     (RQ_PATHLEN + 512)
+#define BULK_BUFSIZE    65536   /* a datagram */
+#define BULK_MISSING    1       /* rcv[]: uid not in the bulk reply */
+
+/* RPC clients kept open between queries, so a process that asks one
+ * server many times looks up its port and creates the client only once.
+ * A host may have one for GETQUOTA and one for the bulk extension.  A
+ * client is not shared with the children of the process that created it.
+ */
+static struct nfs_client {
+    char               *nc_rhost;
+    CLIENT             *nc_client;
+    int                 nc_bulk;    /* for the bulk extension */
+    pid_t               nc_pid;
+} clients[NFS_CLIENTS];
+
+/* Servers found not to offer the bulk extension.
+ */
+static char *nobulk[NFS_CLIENTS];
+static int nnobulk = 0;
+
+/* One host's share of a hedged query.
+ */
+struct call {
+    char               *c_host;
+    int                 c_port;     /* from host@port, else 0 */
+    int                 c_fd;       /* UDP socket, -1 if not in progress */
+    int                 c_pmap;     /* asking the portmapper for the port */
+    uint32_t            c_xid;
+    double              c_start;    /* time the query was started */
+    double              c_sent;     /* time of the last transmission */
+    struct sockaddr_in  c_addr;
+    size_t              c_len;
+    char                c_buf[RPC_BUFSIZE];  /* encoded request */
+};
+
+/* Latencies of recent replies from each host list.
+ */
+static struct latency {
+    char               *l_rhost;
+    double              l_val[HEDGE_SAMPLES];
+    int                 l_count;
+} latency[HEDGE_LISTS];
+
+/* rquotad's port on each host, as learned from the portmapper.
+ */
+static struct port {
+    char               *p_host;
+    int                 p_port;
+} ports[HEDGE_PORTS];
+
 extern char *prog;
 extern int debug;
 
@@ -87,32 +157,454 @@ workaround_quirks(struct rquota *rq)
 #endif
 }
 
-static qstate_t
-set_state(unsigned long long used, unsigned long long soft,
-          unsigned long long hard, unsigned long timeleft)
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1E-6;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static struct latency *
+find_latency(char *rhost)
+{
+    int i;
+
+    for (i = 0; i < HEDGE_LISTS && latency[i].l_rhost; i++)
+        if (!strcmp(latency[i].l_rhost, rhost))
+            return &latency[i];
+    if (i == HEDGE_LISTS)
+        return NULL;
+    latency[i].l_rhost = xstrdup(rhost);
+    return &latency[i];
+}
+
+/* Seconds to wait for a host in rhost's list before asking the next: a
+ * high percentile of its recent latencies, so that only the slowest few
+ * queries are duplicated.
+ */
+static double
+hedge_delay(char *rhost)
+{
+    struct latency *l = find_latency(rhost);
+    double val[HEDGE_SAMPLES];
+    int n;
+
+    if (!l || l->l_count < HEDGE_MINSAMPLES)
+        return HEDGE_DELAY;
+    n = l->l_count < HEDGE_SAMPLES ? l->l_count : HEDGE_SAMPLES;
+    memcpy(val, l->l_val, n * sizeof(double));
+    qsort(val, n, sizeof(double), cmp_double);
+    return val[(int)(HEDGE_PCT * (n - 1))];
+}
+
+static void
+hedge_record(char *rhost, double t)
+{
+    struct latency *l = find_latency(rhost);
+
+    if (l)
+        l->l_val[l->l_count++ % HEDGE_SAMPLES] = t;
+}
+
+static struct port *
+find_port(char *host, int create)
+{
+    int i;
+
+    for (i = 0; i < HEDGE_PORTS && ports[i].p_host; i++)
+        if (!strcmp(ports[i].p_host, host))
+            return &ports[i];
+    if (i == HEDGE_PORTS || !create)
+        return NULL;
+    ports[i].p_host = xstrdup(host);
+    return &ports[i];
+}
+
+/* Create a client for the bulk extension on rhost (host or host@port),
+ * or return NULL if it is not offered there.
+ */
+static CLIENT *
+bulk_create(char *rhost)
+{
+    struct timeval wait = { RPC_RETRY, 0 };
+    char host[MAXHOSTNAMELEN + 1];
+    struct addrinfo hints, *res;
+    struct sockaddr_in sin;
+    int sock = RPC_ANYSOCK;
+    int port = 0;
+    char *p;
+
+    snprintf(host, sizeof(host), "%s", rhost);
+    if ((p = strchr(host, '@'))) {
+        *p++ = '\0';
+        port = strtoul(p, NULL, 10);
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0)
+        return NULL;
+    memcpy(&sin, res->ai_addr, sizeof(sin));
+    freeaddrinfo(res);
+    if (!port)
+        port = pmap_getport(&sin, RQUOTABULKPROG, RQUOTABULKVERS,
+                            IPPROTO_UDP);
+    if (!port)
+        return NULL;
+    sin.sin_port = htons(port);
+    return clntudp_bufcreate(&sin, RQUOTABULKPROG, RQUOTABULKVERS, wait,
+                             &sock, BULK_BUFSIZE, BULK_BUFSIZE);
+}
+
+/* Return an open client for rhost, for the bulk extension if bulk is
+ * set, creating it if need be, or NULL.
+ */
+static CLIENT *
+get_client(char *rhost, int bulk)
 {
-    qstate_t state;
+    struct nfs_client *c = NULL;
+    pid_t pid = getpid();
+    int i;
 
-    if (!hard && !soft)
-        state = NONE;
-    else if (hard && used > hard)
-        state = EXPIRED;
-    else if (soft && used > soft)
-        state = (long)timeleft > 0 ? STARTED : NOTSTARTED;
+    for (i = 0; i < NFS_CLIENTS; i++) {
+        if (clients[i].nc_client && clients[i].nc_pid != pid) {
+            clnt_destroy(clients[i].nc_client);
+            clients[i].nc_client = NULL;
+        }
+        if (clients[i].nc_client && clients[i].nc_bulk == bulk
+                                 && !strcmp(clients[i].nc_rhost, rhost))
+            return clients[i].nc_client;
+        if (!clients[i].nc_client && !c)
+            c = &clients[i];
+    }
+    if (!c) {
+        c = &clients[0];
+        clnt_destroy(c->nc_client);
+        c->nc_client = NULL;
+    }
+    if (bulk)
+        c->nc_client = bulk_create(rhost);
     else
-        state = UNDER;
+        c->nc_client = clnt_create(rhost, RQUOTAPROG, RQUOTAVERS, "udp");
+    if (!c->nc_client)
+        return NULL;
+    auth_destroy(c->nc_client->cl_auth);
+    c->nc_client->cl_auth = NULL;
+    if (c->nc_rhost)
+        free(c->nc_rhost);
+    c->nc_rhost = xstrdup(rhost);
+    c->nc_bulk = bulk;
+    c->nc_pid = pid;
+    return c->nc_client;
+}
+
+/* Close the client for rhost after a failure, so the next query starts
+ * afresh.
+ */
+static void
+drop_client(CLIENT *cl)
+{
+    int i;
+
+    for (i = 0; i < NFS_CLIENTS; i++) {
+        if (clients[i].nc_client == cl) {
+            clnt_destroy(cl);
+            clients[i].nc_client = NULL;
+        }
+    }
+}
+
+/* Encode an RPC call into c's buffer with a new xid.
+ */
+static int
+encode_call(struct call *c, u_long prog, u_long vers, u_long proc,
+            AUTH *auth, xdrproc_t xargs, void *args)
+{
+    static uint32_t xid = 0;
+    struct rpc_msg msg;
+    XDR x;
+    int rc = 0;
+
+    if (xid == 0)
+        xid = (uint32_t)getpid() ^ (uint32_t)time(NULL) << 8;
+    memset(&msg, 0, sizeof(msg));
+    msg.rm_xid = c->c_xid = ++xid;
+    msg.rm_direction = CALL;
+    msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    msg.rm_call.cb_prog = prog;
+    msg.rm_call.cb_vers = vers;
+    msg.rm_call.cb_proc = proc;
+    msg.rm_call.cb_cred = auth->ah_cred;
+    msg.rm_call.cb_verf = auth->ah_verf;
+    xdrmem_create(&x, c->c_buf, sizeof(c->c_buf), XDR_ENCODE);
+    if (!xdr_callmsg(&x, &msg) || !xargs(&x, args))
+        rc = -1;
+    c->c_len = xdr_getpos(&x);
+    xdr_destroy(&x);
+    return rc;
+}
+
+/* Decode a reply to the call with the given xid into res.  Returns 1 on
+ * success, 0 if the reply is to some other call, -1 if the call failed.
+ */
+static int
+decode_reply(char *buf, int len, uint32_t xid, xdrproc_t xres, void *res)
+{
+    struct rpc_msg msg;
+    uint32_t rxid;
+    XDR x;
+    int rc;
+
+    if (len < sizeof(rxid))
+        return 0;
+    memcpy(&rxid, buf, sizeof(rxid));
+    if (ntohl(rxid) != xid)
+        return 0;
+    memset(&msg, 0, sizeof(msg));
+    msg.acpted_rply.ar_verf = _null_auth;
+    msg.acpted_rply.ar_results.where = res;
+    msg.acpted_rply.ar_results.proc = xres;
+    xdrmem_create(&x, buf, len, XDR_DECODE);
+    rc = xdr_replymsg(&x, &msg) && msg.rm_reply.rp_stat == MSG_ACCEPTED
+                                && msg.acpted_rply.ar_stat == SUCCESS ? 1 : -1;
+    xdr_destroy(&x);
+    return rc;
+}
+
+/* Connect c's socket to port and send the call in c's buffer.
+ */
+static int
+send_call(struct call *c, int port, double t)
+{
+    c->c_addr.sin_port = htons(port);
+    if (connect(c->c_fd, (struct sockaddr *)&c->c_addr,
+                sizeof(c->c_addr)) < 0
+            || send(c->c_fd, c->c_buf, c->c_len, 0) < 0) {
+        if (debug)
+            printf("hedge: %s: %s\n", c->c_host, strerror(errno));
+        return -1;
+    }
+    c->c_sent = t;
+    return 0;
+}
+
+/* Start the query of c: ask rquotad directly if its port is known,
+ * otherwise ask the portmapper first.
+ */
+static int
+start_call(struct call *c, AUTH *auth, getquota_args *args, double t)
+{
+    struct addrinfo hints, *res;
+    struct pmap pm;
+    struct port *p;
+    int port;
 
-    return state;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(c->c_host, NULL, &hints, &res) != 0) {
+        if (debug)
+            printf("hedge: %s: unknown host\n", c->c_host);
+        return -1;
+    }
+    memcpy(&c->c_addr, res->ai_addr, sizeof(c->c_addr));
+    freeaddrinfo(res);
+    if ((c->c_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return -1;
+    c->c_start = t;
+    if ((port = c->c_port) || ((p = find_port(c->c_host, 0))
+                                && (port = p->p_port))) {
+        c->c_pmap = 0;
+        if (encode_call(c, RQUOTAPROG, RQUOTAVERS, RQUOTAPROC_GETQUOTA, auth,
+                        (xdrproc_t)xdr_getquota_args, args) < 0)
+            goto fail;
+    } else {
+        c->c_pmap = 1;
+        port = PMAPPORT;
+        pm.pm_prog = RQUOTAPROG;
+        pm.pm_vers = RQUOTAVERS;
+        pm.pm_prot = IPPROTO_UDP;
+        pm.pm_port = 0;
+        if (encode_call(c, PMAPPROG, PMAPVERS, PMAPPROC_GETPORT, auth,
+                        (xdrproc_t)xdr_pmap, &pm) < 0)
+            goto fail;
+    }
+    if (send_call(c, port, t) == 0)
+        return 0;
+fail:
+    close(c->c_fd);
+    c->c_fd = -1;
+    return -1;
+}
+
+/* Read a reply for c.  Returns 1 if it is the answer, 0 to keep waiting,
+ * -1 if this host has failed.
+ */
+static int
+recv_call(struct call *c, AUTH *auth, getquota_args *args,
+          getquota_rslt *result, double t)
+{
+    char buf[RPC_BUFSIZE];
+    u_long port = 0;
+    struct port *p;
+    int n, rc;
+
+    if ((n = recv(c->c_fd, buf, sizeof(buf), 0)) < 0) {
+        /* A remembered port may be stale after rquotad restarted.
+         */
+        if (errno == ECONNREFUSED && !c->c_pmap && !c->c_port
+                                  && (p = find_port(c->c_host, 0))) {
+            p->p_port = 0;
+            close(c->c_fd);
+            return start_call(c, auth, args, t);
+        }
+        if (debug)
+            printf("hedge: %s: %s\n", c->c_host, strerror(errno));
+        return -1;
+    }
+    if (!c->c_pmap) {
+        memset(result, 0, sizeof(*result));
+        return decode_reply(buf, n, c->c_xid, (xdrproc_t)xdr_getquota_rslt,
+                            result);
+    }
+    if ((rc = decode_reply(buf, n, c->c_xid, (xdrproc_t)xdr_u_long,
+                           &port)) <= 0)
+        return rc;
+    if (port == 0) {
+        if (debug)
+            printf("hedge: %s: rquotad not registered\n", c->c_host);
+        return -1;
+    }
+    if ((p = find_port(c->c_host, 1)))
+        p->p_port = port;
+    c->c_pmap = 0;
+    if (encode_call(c, RQUOTAPROG, RQUOTAVERS, RQUOTAPROC_GETQUOTA, auth,
+                    (xdrproc_t)xdr_getquota_args, args) < 0)
+        return -1;
+    return send_call(c, port, t);
 }
 
+/* Query the hosts in q->q_rhost, a comma-separated list of servers of
+ * the same file system, each optionally host@port.  The first host is
+ * asked, and each of the others in turn if no answer has come by the
+ * hedge delay, or at once if those asked so far have failed.  The first
+ * answer wins, and the other queries are abandoned.
+ */
+static int
+hedged_getquota(quota_t q, AUTH *auth, getquota_args *args,
+                getquota_rslt *result)
+{
+    struct call c[HEDGE_MAXHOSTS];
+    struct pollfd pfd[HEDGE_MAXHOSTS];
+    int idx[HEDGE_MAXHOSTS];
+    char *hosts = xstrdup(q->q_rhost);
+    char *tok, *port, *save = NULL;
+    double t, t0 = now(), last = t0, wake;
+    double delay = hedge_delay(q->q_rhost);
+    int i, k, n = 0, next = 0, active = 0, rc = -1;
+
+    for (tok = strtok_r(hosts, ",", &save); tok && n < HEDGE_MAXHOSTS;
+                    tok = strtok_r(NULL, ",", &save)) {
+        memset(&c[n], 0, sizeof(c[n]));
+        c[n].c_fd = -1;
+        c[n].c_host = tok;
+        if ((port = strchr(tok, '@'))) {
+            *port++ = '\0';
+            c[n].c_port = strtoul(port, NULL, 10);
+        }
+        n++;
+    }
+
+    for (;;) {
+        t = now();
+        while (next < n && (active == 0 || t >= last + delay)) {
+            if (debug && next > 0)
+                printf("hedge: %s: asking %s\n", q->q_rhost, c[next].c_host);
+            if (start_call(&c[next++], auth, args, t) == 0) {
+                active++;
+                last = t;
+            }
+        }
+        if (active == 0) {
+            fprintf(stderr, "%s: %s: no server could be reached\n",
+                    prog, q->q_rhost);
+            break;
+        }
+        if (t >= t0 + RPC_TIMEOUT) {
+            fprintf(stderr, "%s: %s: RPC: Timed out\n", prog, q->q_rhost);
+            errno = ETIMEDOUT;
+            break;
+        }
+        wake = t0 + RPC_TIMEOUT;
+        if (next < n && last + delay < wake)
+            wake = last + delay;
+        for (i = 0, k = 0; i < next; i++) {
+            if (c[i].c_fd < 0)
+                continue;
+            if (t >= c[i].c_sent + RPC_RETRY)
+                send_call(&c[i], ntohs(c[i].c_addr.sin_port), t);
+            if (c[i].c_sent + RPC_RETRY < wake)
+                wake = c[i].c_sent + RPC_RETRY;
+            pfd[k].fd = c[i].c_fd;
+            pfd[k].events = POLLIN;
+            pfd[k].revents = 0;
+            idx[k++] = i;
+        }
+        if (poll(pfd, k, (int)((wake - t) * 1000) + 1) < 0 && errno != EINTR)
+            break;
+        t = now();
+        for (i = 0; i < k && rc < 0; i++) {
+            if (pfd[i].revents == 0)
+                continue;
+            switch (recv_call(&c[idx[i]], auth, args, result, t)) {
+                case 1:
+                    hedge_record(q->q_rhost, t - c[idx[i]].c_start);
+                    if (debug)
+                        printf("hedge: %s: answered by %s in %.3fs\n",
+                               q->q_rhost, c[idx[i]].c_host, t - t0);
+                    rc = 0;
+                    break;
+                case -1:
+                    close(c[idx[i]].c_fd);
+                    c[idx[i]].c_fd = -1;
+                    active--;
+                    break;
+            }
+        }
+        if (rc == 0)
+            break;
+    }
+    for (i = 0; i < next; i++)
+        if (c[i].c_fd >= 0)
+            close(c[i].c_fd);
+    free(hosts);
+    return rc;
+}
+
+/* Query the server for uid's quota.  On failure, errno is ETIMEDOUT if
+ * the server did not answer, so callers can tell an overloaded server
+ * from a refusal.
+ */
 int
 quota_get_nfs(uid_t uid, quota_t q)
 {
     static char lhost[MAXHOSTNAMELEN+1] = "";
     uid_t myuid = geteuid();
     getquota_args args;
-    getquota_rslt *result;
+    getquota_rslt *result, hres;
+    struct rpc_err err;
     CLIENT *cl = NULL;
+    AUTH *auth = NULL;
     int rc = -1; /* fail */
 
     assert(q->q_magic == QUOTA_MAGIC);
@@ -129,29 +621,53 @@ quota_get_nfs(uid_t uid, quota_t q)
         }
     }
 
-    cl = clnt_create(q->q_rhost, RQUOTAPROG, RQUOTAVERS, "udp");
+    args.gqa_pathp  = q->q_rpath;
+    args.gqa_uid    = uid;
+
+    /* A list of servers, or a server at a given port, is queried by
+     * hedged_getquota() rather than the rpcgen stubs.
+     */
+    if (strpbrk(q->q_rhost, ",@")) {
+        if (!(auth = authunix_create(lhost, uid, getgid(), 0, NULL))) {
+            fprintf(stderr, "%s: authunix_create failed\n", prog);
+            goto done;
+        }
+        if (hedged_getquota(q, auth, &args, &hres) < 0)
+            goto done;
+        result = &hres;
+        goto reply;
+    }
+
+    cl = get_client(q->q_rhost, 0);
     if (cl == NULL) {
         fprintf(stderr, "%s: %s\n", prog, clnt_spcreateerror(q->q_rhost));
+        if (rpc_createerr.cf_stat == RPC_TIMEDOUT)
+            errno = ETIMEDOUT;
         goto done;
     }
 
     /* Gnat48: authunix_create_default() fails if in >16 groups (Tru64),
      * so call authunix_create() with empty supplementary group list.
      */
-    cl->cl_auth = authunix_create(lhost, uid, getgid(), 0, NULL);
-    if (cl->cl_auth == NULL) {
+    auth = authunix_create(lhost, uid, getgid(), 0, NULL);
+    if (auth == NULL) {
         fprintf(stderr, "%s: %s\n", prog, clnt_sperror(cl, "authunix"));
         goto done;
     }
 
-    args.gqa_pathp  = q->q_rpath;
-    args.gqa_uid    = uid;
+    cl->cl_auth = auth;
     result = rquotaproc_getquota_1(&args, cl);
+    cl->cl_auth = NULL;
 
     if (result == NULL) {
         fprintf(stderr, "%s: %s\n", prog, clnt_sperror(cl, q->q_rhost));
+        clnt_geterr(cl, &err);
+        drop_client(cl);
+        if (err.re_status == RPC_TIMEDOUT)
+            errno = ETIMEDOUT;
         goto done;
     }
+reply:
     if (result->gqr_status == Q_NOQUOTA) {
         fprintf(stderr, "%s: rquota %s:%s: no quota\n", prog, 
                 q->q_rhost, q->q_rpath);
@@ -196,29 +712,215 @@ quota_get_nfs(uid_t uid, quota_t q)
         q->q_bytes_used = (unsigned long long)rq->rq_curblocks*rq->rq_bsize;
         q->q_bytes_softlim = (unsigned long long)rq->rq_bsoftlimit*rq->rq_bsize;
         q->q_bytes_hardlim = (unsigned long long)rq->rq_bhardlimit*rq->rq_bsize;
-        q->q_bytes_state = set_state(q->q_bytes_used, q->q_bytes_softlim, 
-                                     q->q_bytes_hardlim, rq->rq_btimeleft);
+        q->q_bytes_state = qstate_get(q->q_bytes_used, q->q_bytes_softlim, 
+                                      q->q_bytes_hardlim,
+                                      (long)rq->rq_btimeleft);
         if (q->q_bytes_state == STARTED)
             q->q_bytes_secleft  = rq->rq_btimeleft;
 
         q->q_files_used     = rq->rq_curfiles;
         q->q_files_softlim  = rq->rq_fsoftlimit;
         q->q_files_hardlim  = rq->rq_fhardlimit;
-        q->q_files_state = set_state(q->q_files_used, q->q_files_softlim, 
-                                     q->q_files_hardlim, rq->rq_ftimeleft);
+        q->q_files_state = qstate_get(q->q_files_used, q->q_files_softlim, 
+                                      q->q_files_hardlim,
+                                      (long)rq->rq_ftimeleft);
         if (q->q_files_state == STARTED)
             q->q_files_secleft  = rq->rq_ftimeleft;
     }
 
 done:
-    if (cl != NULL) {
-        if (cl->cl_auth != NULL)
-            auth_destroy(cl->cl_auth);
-        clnt_destroy(cl);
-    }
+    if (auth != NULL)
+        auth_destroy(auth);
     return rc;
 }
 
+static void
+fill_bulk(quota_t q, uid_t uid, rquota_bulk *r)
+{
+    q->q_uid = uid;
+    q->q_bytes_used = r->rqb_bytes_used;
+    q->q_bytes_softlim = r->rqb_bytes_softlim;
+    q->q_bytes_hardlim = r->rqb_bytes_hardlim;
+    q->q_files_used = r->rqb_files_used;
+    q->q_files_softlim = r->rqb_files_softlim;
+    q->q_files_hardlim = r->rqb_files_hardlim;
+}
+
+/* Set the space and file states of the n quotas in qv[], filled from the
+ * bulk records rv[], with one qstate_classify() pass over each.
+ */
+static void
+classify_bulk(quota_t *qv, rquota_bulk **rv, int n)
+{
+    unsigned long long used[RQ_BULKMAX], soft[RQ_BULKMAX], hard[RQ_BULKMAX];
+    long long left[RQ_BULKMAX];
+    qstate_t state[RQ_BULKMAX];
+    unsigned char over[RQ_BULKMAX];
+    int i;
+
+    assert(n <= RQ_BULKMAX);
+    for (i = 0; i < n; i++) {
+        used[i] = qv[i]->q_bytes_used;
+        soft[i] = qv[i]->q_bytes_softlim;
+        hard[i] = qv[i]->q_bytes_hardlim;
+        left[i] = (long)rv[i]->rqb_bytes_timeleft;
+    }
+    qstate_classify(n, used, soft, hard, left, 0, state, over);
+    for (i = 0; i < n; i++) {
+        qv[i]->q_bytes_state = state[i];
+        if (state[i] == STARTED)
+            qv[i]->q_bytes_secleft = rv[i]->rqb_bytes_timeleft;
+    }
+    for (i = 0; i < n; i++) {
+        used[i] = qv[i]->q_files_used;
+        soft[i] = qv[i]->q_files_softlim;
+        hard[i] = qv[i]->q_files_hardlim;
+        left[i] = (long)rv[i]->rqb_files_timeleft;
+    }
+    qstate_classify(n, used, soft, hard, left, 0, state, over);
+    for (i = 0; i < n; i++) {
+        qv[i]->q_files_state = state[i];
+        if (state[i] == STARTED)
+            qv[i]->q_files_secleft = rv[i]->rqb_files_timeleft;
+    }
+}
+
+/* Ask cl for the quotas of n uids, at most RQ_BULKMAX.  Returns 0 with
+ * rcv[] filled in, BULK_MISSING for any uid the reply left out, or the
+ * RPC error if the call failed.
+ */
+static enum clnt_stat
+bulk_call(CLIENT *cl, uid_t *uid, quota_t *qv, int *rcv, int n)
+{
+    struct timeval total = { RPC_TIMEOUT, 0 };
+    getquota_bulk_args args;
+    getquota_bulk_rslt res;
+    enum clnt_stat stat;
+    rquota_bulk *r, *okr[RQ_BULKMAX];
+    quota_t okq[RQ_BULKMAX];
+    u_int *ids = NULL;
+    int i, j, k = 0;
+
+    memset(&args, 0, sizeof(args));
+    args.gqba_pathp = qv[0]->q_rpath;
+    for (i = 1; i < n; i++)
+        if (uid[i] != uid[0] + i)
+            break;
+    if (i == n) {
+        args.gqba_first = uid[0];
+        args.gqba_count = n;
+    } else {
+        ids = xmalloc(n * sizeof(u_int));
+        for (i = 0; i < n; i++)
+            ids[i] = uid[i];
+        args.gqba_uids.gqba_uids_len = n;
+        args.gqba_uids.gqba_uids_val = ids;
+    }
+    memset(&res, 0, sizeof(res));
+    stat = clnt_call(cl, RQUOTAPROC_GETQUOTA_BULK,
+                     (xdrproc_t)xdr_getquota_bulk_args, (caddr_t)&args,
+                     (xdrproc_t)xdr_getquota_bulk_rslt, (caddr_t)&res, total);
+    if (ids)
+        free(ids);
+    if (stat != RPC_SUCCESS)
+        return stat;
+    for (i = j = 0; i < n; i++) {
+        r = j < res.getquota_bulk_rslt_len ? &res.getquota_bulk_rslt_val[j]
+                                           : NULL;
+        if (!r || r->rqb_uid != uid[i]) {
+            rcv[i] = BULK_MISSING;
+            continue;
+        }
+        j++;
+        if (r->rqb_status == Q_OK) {
+            fill_bulk(qv[i], uid[i], r);
+            okq[k] = qv[i];
+            okr[k++] = r;
+            rcv[i] = 0;
+            continue;
+        }
+        if (r->rqb_status == Q_NOQUOTA)
+            fprintf(stderr, "%s: rquota %s:%s: no quota\n", prog,
+                    qv[i]->q_rhost, qv[i]->q_rpath);
+        else if (r->rqb_status == Q_EPERM)
+            fprintf(stderr, "%s: rquota %s:%s: permission denied\n",
+                    prog, qv[i]->q_rhost, qv[i]->q_rpath);
+        else
+            fprintf(stderr, "%s: rquota %s:%s: unknown error: %d\n",
+                    prog, qv[i]->q_rhost, qv[i]->q_rpath, r->rqb_status);
+        rcv[i] = -1;
+    }
+    classify_bulk(okq, okr, k);
+    xdr_free((xdrproc_t)xdr_getquota_bulk_rslt, (char *)&res);
+    return RPC_SUCCESS;
+}
+
+/* Query the server for the quotas of n uids on one file system, into
+ * qv[], with the bulk extension if the server offers it, otherwise one
+ * uid at a time.  rcv[i] is set as quota_get_many() describes.  Only
+ * root can use the bulk extension.  Returns 1 if it was used for all.
+ */
+int
+quota_get_nfs_bulk(uid_t *uid, quota_t *qv, int *rcv, int n)
+{
+    char lhost[MAXHOSTNAMELEN + 1];
+    enum clnt_stat stat;
+    CLIENT *cl = NULL;
+    AUTH *auth = NULL;
+    int i = 0, k;
+
+    if (n == 0)
+        return 0;
+    assert(qv[0]->q_magic == QUOTA_MAGIC);
+    if (geteuid() != 0 || strchr(qv[0]->q_rhost, ','))
+        goto fallback;
+    for (k = 0; k < nnobulk; k++)
+        if (!strcmp(nobulk[k], qv[0]->q_rhost))
+            goto fallback;
+    if (gethostname(lhost, sizeof(lhost)) < 0
+            || !(auth = authunix_create(lhost, 0, 0, 0, NULL))
+            || !(cl = get_client(qv[0]->q_rhost, 1)))
+        goto fallback;
+    cl->cl_auth = auth;
+    for (; i < n; i += k) {
+        k = n - i < RQ_BULKMAX ? n - i : RQ_BULKMAX;
+        if ((stat = bulk_call(cl, uid + i, qv + i, rcv + i, k))
+                                                    != RPC_SUCCESS) {
+            if (debug)
+                printf("%s: bulk: %s\n", qv[0]->q_rhost, clnt_sperrno(stat));
+            if (stat != RPC_TIMEDOUT && nnobulk < NFS_CLIENTS)
+                nobulk[nnobulk++] = xstrdup(qv[0]->q_rhost);
+            break;
+        }
+    }
+    cl->cl_auth = NULL;
+    if (i < n)
+        drop_client(cl);
+fallback:
+    if (auth)
+        auth_destroy(auth);
+
+    /* Query the uids left out of a reply only now, as doing so may close
+     * cl to make room for another client.
+     */
+    for (k = 0; k < i; k++)
+        if (rcv[k] == BULK_MISSING)
+            rcv[k] = quota_get_status(uid[k], qv[k]);
+    if (i == n)
+        return 1;
+    for (; i < n; i++)
+        rcv[i] = quota_get_status(uid[i], qv[i]);
+    return 0;
+}
+
+/* Servers are shared between file systems, so the client handles and
+ * what is known of each server are kept per host above rather than per
+ * file system.
+ */
+struct quota_backend quota_backend_nfs = {
+    NULL, NULL, quota_get_nfs, quota_get_nfs_bulk, NULL
+};
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
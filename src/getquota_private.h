@@ -22,10 +22,10 @@
  *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
 \*****************************************************************************/
 
-typedef enum { NONE, UNDER, NOTSTARTED, STARTED, EXPIRED } qstate_t;
 #define QUOTA_MAGIC 0x3434aaaf
 struct quota_struct {
     int                q_magic;
+    quota_fs_t         q_fs;           /* for quota_get(), else NULL */
     uid_t              q_uid;
     char              *q_name;
     char              *q_label;        /* assumed to be local mount point */
@@ -45,8 +45,39 @@ struct quota_struct {
     qstate_t           q_files_state;
 };
 
-int quota_get_lustre(uid_t uid, quota_t q);
+/* A backend answers quota queries for the file systems whose rhost
+ * selects it.  init and fini are called once per query context, and
+ * may keep per-file system state in fs_state; either may be NULL.
+ * get_batch fills qv[0..n-1] and rcv[0..n-1] as quota_get_many() does,
+ * and returns 1 if the server answered them together, else 0; if NULL,
+ * get is called for each uid.
+ */
+struct quota_backend {
+    char  *qb_name;         /* rhost that selects it, NULL = any other */
+    int  (*qb_init)(quota_fs_t fs);
+    int  (*qb_get)(uid_t uid, quota_t q);
+    int  (*qb_get_batch)(uid_t *uid, quota_t *qv, int *rcv, int n);
+    void (*qb_fini)(quota_fs_t fs);
+};
+
+#define QUOTA_FS_MAGIC 0x3434aab0
+struct quota_fs_struct {
+    int                fs_magic;
+    int                fs_refs;        /* creator + quota_t's using it */
+    char              *fs_label;
+    char              *fs_rhost;
+    char              *fs_rpath;
+    int                fs_thresh;
+    struct quota_backend *fs_ops;
+    void              *fs_state;       /* backend's own */
+};
+
+extern struct quota_backend quota_backend_lustre;
+extern struct quota_backend quota_backend_nfs;
+
+int quota_get_status(uid_t uid, quota_t q);
 int quota_get_nfs(uid_t uid, quota_t q);
+int quota_get_nfs_bulk(uid_t *uid, quota_t *qv, int *rcv, int n);
 
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
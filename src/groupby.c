@@ -0,0 +1,473 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Per-group aggregation of usage.
+ *
+ * Each record is mapped to a group key derived from the user's passwd
+ * entry or from a mapping file, and its usage is added to that group's
+ * entry in a hash table, so only one entry per group is kept however
+ * many users there are.  Supported keys:
+ *
+ *   gid        primary group (named with getgrgid at report time)
+ *   gecos[:N]  the Nth comma-separated GECOS subfield (default 1)
+ *   map:FILE   FILE lists "uid-or-user group" per line; # starts a comment
+ *
+ * Users with no passwd entry, an empty GECOS subfield, or no mapping are
+ * counted in the group "[none]".
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+#include <assert.h>
+
+#include "util.h"
+#include "outbuf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "groupby.h"
+
+extern char *prog;
+
+#define GROUP_NONE      "[none]"
+#define GROUP_MINSIZE   64              /* must be a power of 2 */
+
+typedef enum { KEY_GID, KEY_GECOS, KEY_MAP } keytype_t;
+
+struct gtotal {
+    char               *g_name;
+    unsigned long       g_users;
+    unsigned long long  g_bytes;
+    unsigned long long  g_files;
+};
+
+struct mapent {
+    uid_t               m_uid;
+    int                 m_line;
+    char               *m_group;
+};
+
+#define GROUPBY_MAGIC 0x6b0e9a11
+struct groupby_struct {
+    int                 g_magic;
+    keytype_t           g_type;
+    int                 g_field;        /* KEY_GECOS: 1-based subfield */
+    int                 g_getname;      /* KEY_GID: map gid to group name */
+    struct mapent      *g_map;          /* KEY_MAP: sorted on uid */
+    int                 g_nmap;
+    struct gtotal      **g_tab;          /* open addressing hash table */
+    int                 g_size;
+    int                 g_count;
+};
+
+static inline unsigned int
+hash(const char *s, int size)
+{
+    unsigned int h = 2166136261U;       /* FNV-1a */
+
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 16777619U;
+    return h & (size - 1);
+}
+
+/* Return a pointer to the slot holding name, or to the empty slot
+ * where it would go.
+ */
+static struct gtotal **
+lookup(struct gtotal **tab, int size, const char *name)
+{
+    unsigned int i = hash(name, size);
+
+    while (tab[i] && strcmp(tab[i]->g_name, name) != 0)
+        i = (i + 1) & (size - 1);
+    return &tab[i];
+}
+
+static void
+grow(groupby_t g)
+{
+    int size = g->g_size * 2;
+    struct gtotal **tab = xmalloc(size * sizeof(struct gtotal *));
+    int i;
+
+    memset(tab, 0, size * sizeof(struct gtotal *));
+    for (i = 0; i < g->g_size; i++) {
+        if (g->g_tab[i])
+            *lookup(tab, size, g->g_tab[i]->g_name) = g->g_tab[i];
+    }
+    free(g->g_tab);
+    g->g_tab = tab;
+    g->g_size = size;
+}
+
+static struct gtotal *
+get_group(groupby_t g, const char *name)
+{
+    struct gtotal **slot = lookup(g->g_tab, g->g_size, name);
+    struct gtotal *gp = *slot;
+
+    if (!gp) {
+        gp = xmalloc(sizeof(struct gtotal));
+        gp->g_name = xstrdup((char *)name);
+        gp->g_users = 0;
+        gp->g_bytes = 0;
+        gp->g_files = 0;
+        *slot = gp;
+        if (++g->g_count * 2 > g->g_size)
+            grow(g);
+    }
+    return gp;
+}
+
+static int
+cmp_mapent(const void *a, const void *b)
+{
+    const struct mapent *x = a, *y = b;
+
+    if (x->m_uid != y->m_uid)
+        return x->m_uid < y->m_uid ? -1 : 1;
+    return x->m_line - y->m_line;
+}
+
+/* Load a uid to group mapping file.  Where a uid is listed more than
+ * once the first entry wins.
+ */
+static int
+load_map(groupby_t g, char *path)
+{
+    FILE *f;
+    char buf[1024], user[256], group[256];
+    struct passwd *pw;
+    unsigned long uid;
+    char *end;
+    int line = 0, size = 0, i, n;
+
+    if (!(f = fopen(path, "r"))) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        if ((end = strchr(buf, '#')))
+            *end = '\0';
+        n = sscanf(buf, "%255s %255s", user, group);
+        if (n <= 0)
+            continue;
+        if (n != 2) {
+            fprintf(stderr, "%s: %s:%d: expected user and group\n",
+                    prog, path, line);
+            fclose(f);
+            return -1;
+        }
+        uid = strtoul(user, &end, 10);
+        if (*end != '\0') {
+            if (!(pw = getpwnam(user))) {
+                fprintf(stderr, "%s: %s:%d: unknown user %s\n",
+                        prog, path, line, user);
+                fclose(f);
+                return -1;
+            }
+            uid = pw->pw_uid;
+        }
+        if (g->g_nmap == size) {
+            size = size ? size * 2 : 256;
+            g->g_map = xrealloc(g->g_map, size * sizeof(struct mapent));
+        }
+        g->g_map[g->g_nmap].m_uid = uid;
+        g->g_map[g->g_nmap].m_line = line;
+        g->g_map[g->g_nmap].m_group = xstrdup(group);
+        g->g_nmap++;
+    }
+    fclose(f);
+
+    qsort(g->g_map, g->g_nmap, sizeof(struct mapent), cmp_mapent);
+    for (i = n = 0; i < g->g_nmap; i++) {
+        if (n > 0 && g->g_map[n - 1].m_uid == g->g_map[i].m_uid)
+            free(g->g_map[i].m_group);
+        else
+            g->g_map[n++] = g->g_map[i];
+    }
+    g->g_nmap = n;
+    return 0;
+}
+
+/* Create an aggregator for key (see above).  On error, print a message
+ * and return NULL.
+ */
+groupby_t
+groupby_create(char *key, int getgroupname)
+{
+    groupby_t g = xmalloc(sizeof(struct groupby_struct));
+    char *end;
+
+    memset(g, 0, sizeof(struct groupby_struct));
+    g->g_magic = GROUPBY_MAGIC;
+    g->g_getname = getgroupname;
+    g->g_size = GROUP_MINSIZE;
+    g->g_tab = xmalloc(g->g_size * sizeof(struct gtotal *));
+    memset(g->g_tab, 0, g->g_size * sizeof(struct gtotal *));
+
+    if (!strcmp(key, "gid"))
+        g->g_type = KEY_GID;
+    else if (!strcmp(key, "gecos")) {
+        g->g_type = KEY_GECOS;
+        g->g_field = 1;
+    } else if (!strncmp(key, "gecos:", 6)) {
+        g->g_type = KEY_GECOS;
+        g->g_field = strtoul(key + 6, &end, 10);
+        if (g->g_field < 1 || *end != '\0')
+            goto badkey;
+    } else if (!strncmp(key, "map:", 4) && key[4] != '\0') {
+        g->g_type = KEY_MAP;
+        if (load_map(g, key + 4) < 0) {
+            groupby_destroy(g);
+            return NULL;
+        }
+    } else
+        goto badkey;
+    return g;
+badkey:
+    fprintf(stderr, "%s: group-by: unknown key '%s'\n", prog, key);
+    groupby_destroy(g);
+    return NULL;
+}
+
+void
+groupby_destroy(groupby_t g)
+{
+    int i;
+
+    assert(g->g_magic == GROUPBY_MAGIC);
+    g->g_magic = 0;
+    for (i = 0; i < g->g_size; i++) {
+        if (g->g_tab[i]) {
+            free(g->g_tab[i]->g_name);
+            free(g->g_tab[i]);
+        }
+    }
+    for (i = 0; i < g->g_nmap; i++)
+        free(g->g_map[i].m_group);
+    free(g->g_map);
+    free(g->g_tab);
+    free(g);
+}
+
+/* Copy the field'th comma-separated subfield of gecos to buf.
+ */
+static void
+gecos_field(const char *gecos, int field, char *buf, int len)
+{
+    const char *end;
+    int n;
+
+    while (--field > 0 && gecos) {
+        if ((gecos = strchr(gecos, ',')))
+            gecos++;
+    }
+    if (!gecos) {
+        buf[0] = '\0';
+        return;
+    }
+    end = strchr(gecos, ',');
+    n = end ? end - gecos : strlen(gecos);
+    while (n > 0 && isspace((unsigned char)*gecos)) {
+        gecos++;
+        n--;
+    }
+    while (n > 0 && isspace((unsigned char)gecos[n - 1]))
+        n--;
+    if (n >= len)
+        n = len - 1;
+    memcpy(buf, gecos, n);
+    buf[n] = '\0';
+}
+
+static const char *
+map_lookup(groupby_t g, uid_t uid)
+{
+    int lo = 0, hi = g->g_nmap - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (g->g_map[mid].m_uid == uid)
+            return g->g_map[mid].m_group;
+        if (g->g_map[mid].m_uid < uid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+/* Add q's usage to its group.  Usable as a ListForF.
+ */
+int
+groupby_add(quota_t q, groupby_t g)
+{
+    struct passwd *pw;
+    struct gtotal *gp;
+    const char *name = NULL;
+    char buf[256];
+
+    assert(q->q_magic == QUOTA_MAGIC);
+    assert(g->g_magic == GROUPBY_MAGIC);
+    switch (g->g_type) {
+        case KEY_GID:
+            if ((pw = getpwuid(q->q_uid))) {
+                snprintf(buf, sizeof(buf), "%lu", (unsigned long)pw->pw_gid);
+                name = buf;
+            }
+            break;
+        case KEY_GECOS:
+            if ((pw = getpwuid(q->q_uid)) && pw->pw_gecos) {
+                gecos_field(pw->pw_gecos, g->g_field, buf, sizeof(buf));
+                if (buf[0] != '\0')
+                    name = buf;
+            }
+            break;
+        case KEY_MAP:
+            name = map_lookup(g, q->q_uid);
+            break;
+    }
+    gp = get_group(g, name ? name : GROUP_NONE);
+    gp->g_users++;
+    gp->g_bytes += q->q_bytes_used;
+    gp->g_files += q->q_files_used;
+    return 0;
+}
+
+int
+groupby_count(groupby_t g)
+{
+    assert(g->g_magic == GROUPBY_MAGIC);
+    return g->g_count;
+}
+
+static int
+cmp_name(const void *a, const void *b)
+{
+    const struct gtotal *x = *(struct gtotal **)a, *y = *(struct gtotal **)b;
+
+    return strcmp(x->g_name, y->g_name);
+}
+
+static int
+cmp_bytes(const void *a, const void *b)
+{
+    const struct gtotal *x = *(struct gtotal **)a, *y = *(struct gtotal **)b;
+
+    if (x->g_bytes != y->g_bytes)
+        return x->g_bytes < y->g_bytes ? -1 : 1;
+    return strcmp(x->g_name, y->g_name);
+}
+
+static int
+cmp_files(const void *a, const void *b)
+{
+    const struct gtotal *x = *(struct gtotal **)a, *y = *(struct gtotal **)b;
+
+    if (x->g_files != y->g_files)
+        return x->g_files < y->g_files ? -1 : 1;
+    return strcmp(x->g_name, y->g_name);
+}
+
+/* Replace numeric gid keys with group names where known.  Done once per
+ * group here rather than once per user in groupby_add().
+ */
+static void
+name_groups(struct gtotal **v, int n)
+{
+    struct group *gr;
+    char *end;
+    unsigned long gid;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        gid = strtoul(v[i]->g_name, &end, 10);
+        if (*end != '\0' || end == v[i]->g_name)
+            continue;
+        if ((gr = getgrgid((gid_t)gid))) {
+            free(v[i]->g_name);
+            v[i]->g_name = xstrdup(gr->gr_name);
+        }
+    }
+}
+
+void
+groupby_report(groupby_t g, outbuf_t ob, unsigned long bsize, int human,
+               int order, int reverse, int heading)
+{
+    struct gtotal **v = xmalloc((g->g_count + 1) * sizeof(struct gtotal *));
+    int i, n = 0;
+
+    assert(g->g_magic == GROUPBY_MAGIC);
+    for (i = 0; i < g->g_size; i++) {
+        if (g->g_tab[i])
+            v[n++] = g->g_tab[i];
+    }
+    if (g->g_type == KEY_GID && g->g_getname)
+        name_groups(v, n);
+    if (order == GROUPBY_BYTES)
+        qsort(v, n, sizeof(struct gtotal *), cmp_bytes);
+    else if (order == GROUPBY_FILES)
+        qsort(v, n, sizeof(struct gtotal *), cmp_files);
+    else
+        qsort(v, n, sizeof(struct gtotal *), cmp_name);
+
+    if (heading) {
+        outbuf_putstr(ob, "Group", 16);
+        outbuf_putstr(ob, "Users", 8);
+        outbuf_putstr(ob, "Space-used", 16);
+        outbuf_putstr(ob, "Files-used", 0);
+        outbuf_putc(ob, '\n');
+    }
+    for (i = 0; i < n; i++) {
+        struct gtotal *gp = v[reverse ? n - 1 - i : i];
+
+        outbuf_putstr(ob, gp->g_name, 15);
+        outbuf_putc(ob, ' ');
+        outbuf_putull(ob, gp->g_users, 8);
+        if (human)
+            outbuf_putsize(ob, gp->g_bytes, 16);
+        else
+            outbuf_putull(ob, gp->g_bytes / bsize, 16);
+        outbuf_putull(ob, gp->g_files, 0);
+        outbuf_putc(ob, '\n');
+    }
+    free(v);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,641 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Write and query quota usage history archives (see history.h).
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "history.h"
+
+extern char *prog;
+
+#define ALIGN8(n)   (((n) + 7) & ~(uint64_t)7)
+
+/* The largest encoded record: three varints. */
+#define MAXRECLEN   (5 + 10 + 10)
+
+#define HIST_MAGIC_STRUCT 0x415cb001
+struct hist_struct {
+    int                  h_magic;
+    char                *h_map;
+    size_t               h_len;
+    const char          *h_label;
+    const char          *h_rhost;
+    const char          *h_rpath;
+    struct hist_block  **h_blocks;      /* the block index */
+    int                  h_nblocks;
+    size_t               h_end;         /* end of last complete block */
+};
+
+/* One user's usage, as encoded in a block. */
+struct hist_ent {
+    uint32_t    he_uid;
+    uint64_t    he_bytes;
+    uint64_t    he_files;
+};
+
+/*
+ * Encoding helpers
+ */
+
+static inline unsigned char *
+put_varint(unsigned char *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/* Returns the position after the varint, or NULL if it runs past end. */
+static inline const unsigned char *
+get_varint(const unsigned char *p, const unsigned char *end, uint64_t *vp)
+{
+    uint64_t v = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        v |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *vp = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint64_t
+zigzag(uint64_t delta)
+{
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline uint64_t
+unzigzag(uint64_t v)
+{
+    return (v >> 1) ^ -(v & 1);
+}
+
+static inline const struct hist_sparse *
+block_sparse(const struct hist_block *b)
+{
+    return (const struct hist_sparse *)(b + 1);
+}
+
+static inline const unsigned char *
+block_recs(const struct hist_block *b)
+{
+    return (const unsigned char *)(block_sparse(b) + b->hb_nsparse);
+}
+
+static inline const unsigned char *
+block_end(const struct hist_block *b)
+{
+    return (const unsigned char *)(b + 1) + b->hb_len;
+}
+
+/*
+ * Reading
+ */
+
+/* Validate the archive mapped at h->h_map and build the block index.
+ * A truncated or corrupt block ends the archive.  Returns 0 on success,
+ * -1 if this is not an archive.
+ */
+static int
+scan(hist_t h)
+{
+    struct hist_header *hh = (struct hist_header *)h->h_map;
+    struct hist_block *b;
+    const char *s, *end;
+    size_t off;
+    int size = 0;
+
+    if (h->h_len < sizeof(*hh) || hh->hh_magic != HIST_MAGIC
+                               || hh->hh_version != HIST_VERSION
+                               || hh->hh_strlen == 0
+                               || hh->hh_strlen > h->h_len - sizeof(*hh))
+        return -1;
+    s = h->h_map + sizeof(*hh);
+    end = s + hh->hh_strlen;
+    if (end[-1] != '\0')
+        return -1;
+    h->h_label = s;
+    s += strlen(s) + 1;
+    h->h_rhost = s;
+    if (s >= end)
+        return -1;
+    s += strlen(s) + 1;
+    h->h_rpath = s;
+    if (s >= end)
+        return -1;
+
+    h->h_blocks = NULL;
+    h->h_nblocks = 0;
+    off = ALIGN8(sizeof(*hh) + hh->hh_strlen);
+    while (off <= h->h_len && h->h_len - off >= sizeof(struct hist_block)) {
+        b = (struct hist_block *)(h->h_map + off);
+        if (b->hb_magic != HIST_BLKMAGIC || (b->hb_len & 7)
+                || b->hb_len > h->h_len - off - sizeof(*b)
+                || b->hb_nsparse * sizeof(struct hist_sparse) > b->hb_len
+                || b->hb_count > b->hb_len
+                || b->hb_nsparse != (b->hb_count + HIST_SPARSE - 1)
+                                    / HIST_SPARSE)
+            break;
+        if (h->h_nblocks == size) {
+            size = size ? size * 2 : 64;
+            h->h_blocks = xrealloc(h->h_blocks, size * sizeof(b));
+        }
+        h->h_blocks[h->h_nblocks++] = b;
+        off += sizeof(*b) + b->hb_len;
+    }
+    h->h_end = off < h->h_len ? off : h->h_len;
+    return 0;
+}
+
+/* helper for hist_open()/hist_append() - map fd and scan it */
+static hist_t
+map_archive(int fd, size_t len)
+{
+    hist_t h;
+    void *map;
+
+    if ((map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        return NULL;
+    h = xmalloc(sizeof(struct hist_struct));
+    h->h_magic = HIST_MAGIC_STRUCT;
+    h->h_map = map;
+    h->h_len = len;
+    if (scan(h) < 0) {
+        munmap(map, len);
+        free(h);
+        errno = EINVAL;
+        return NULL;
+    }
+    return h;
+}
+
+/* Map an archive into memory.  Returns NULL with errno set on failure
+ * (EINVAL if the file is not an archive).
+ */
+hist_t
+hist_open(char *path)
+{
+    struct stat sb;
+    hist_t h;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (sb.st_size < sizeof(struct hist_header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    h = map_archive(fd, sb.st_size);
+    close(fd);
+    return h;
+}
+
+void
+hist_close(hist_t h)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    h->h_magic = 0;
+    munmap(h->h_map, h->h_len);
+    if (h->h_blocks)
+        free(h->h_blocks);
+    free(h);
+}
+
+const char *
+hist_label(hist_t h)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    return h->h_label;
+}
+
+const char *
+hist_rhost(hist_t h)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    return h->h_rhost;
+}
+
+const char *
+hist_rpath(hist_t h)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    return h->h_rpath;
+}
+
+int
+hist_count(hist_t h)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    return h->h_nblocks;
+}
+
+time_t
+hist_time(hist_t h, int blk)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    assert(blk >= 0 && blk < h->h_nblocks);
+    return h->h_blocks[blk]->hb_time;
+}
+
+/* Return the number of users and their total usage in block blk.
+ * Only the block header is read.
+ */
+void
+hist_totals(hist_t h, int blk, unsigned long *users,
+            unsigned long long *bytes, unsigned long long *files)
+{
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    assert(blk >= 0 && blk < h->h_nblocks);
+    *users = h->h_blocks[blk]->hb_count;
+    *bytes = h->h_blocks[blk]->hb_bytes;
+    *files = h->h_blocks[blk]->hb_files;
+}
+
+/* helper for hist_uid() - find uid's raw record values in block b */
+static int
+find_uid(const struct hist_block *b, uid_t uid, uint64_t *vb, uint64_t *vf)
+{
+    const struct hist_sparse *sp = block_sparse(b);
+    const unsigned char *p, *end = block_end(b);
+    uint64_t gap, cur = 0;
+    int lo = 0, hi = b->hb_nsparse - 1, mid, k = -1, i, n;
+
+    while (lo <= hi) {
+        mid = lo + (hi - lo) / 2;
+        if (sp[mid].hs_uid <= uid) {
+            k = mid;
+            lo = mid + 1;
+        } else
+            hi = mid - 1;
+    }
+    if (k < 0 || sp[k].hs_offset >= end - block_recs(b))
+        return 0;
+    p = block_recs(b) + sp[k].hs_offset;
+    n = b->hb_count - k * HIST_SPARSE;
+    if (n > HIST_SPARSE)
+        n = HIST_SPARSE;
+    for (i = 0; i < n; i++) {
+        if (!(p = get_varint(p, end, &gap)) || !(p = get_varint(p, end, vb))
+                                            || !(p = get_varint(p, end, vf)))
+            return 0;
+        cur += gap;
+        if (cur >= uid)
+            return cur == uid;
+    }
+    return 0;
+}
+
+/* Fill u[0..hist_count(h)-1] with uid's usage at each sweep.  Each block
+ * is searched through its sparse index, so this does not decode the
+ * archive.
+ */
+void
+hist_uid(hist_t h, uid_t uid, struct hist_usage *u)
+{
+    const struct hist_block *b;
+    uint64_t vb, vf, bytes = 0, files = 0;
+    int i, present = 0;
+
+    assert(h->h_magic == HIST_MAGIC_STRUCT);
+    for (i = 0; i < h->h_nblocks; i++) {
+        b = h->h_blocks[i];
+        if (find_uid(b, uid, &vb, &vf)) {
+            if ((b->hb_flags & HIST_KEYFRAME)) {
+                bytes = vb;
+                files = vf;
+            } else {
+                if (!present)
+                    bytes = files = 0;
+                bytes += unzigzag(vb);
+                files += unzigzag(vf);
+            }
+            present = 1;
+        } else
+            present = 0;
+        u[i].hu_present = present;
+        u[i].hu_bytes = present ? bytes : 0;
+        u[i].hu_files = present ? files : 0;
+    }
+}
+
+/*
+ * Writing
+ */
+
+/* helper for decode_state() - decode block b, given the previous block's
+ * entries, into out (which has room for b->hb_count entries).
+ */
+static int
+decode_block(const struct hist_block *b, const struct hist_ent *prev,
+             int nprev, struct hist_ent *out)
+{
+    const unsigned char *p = block_recs(b), *end = block_end(b);
+    uint64_t gap, vb, vf, uid = 0;
+    int i, j = 0;
+
+    for (i = 0; i < b->hb_count; i++) {
+        if (i % HIST_SPARSE == 0)
+            uid = 0;
+        if (!(p = get_varint(p, end, &gap)) || !(p = get_varint(p, end, &vb))
+                                            || !(p = get_varint(p, end, &vf)))
+            return -1;
+        uid += gap;
+        out[i].he_uid = uid;
+        if ((b->hb_flags & HIST_KEYFRAME)) {
+            out[i].he_bytes = vb;
+            out[i].he_files = vf;
+        } else {
+            while (j < nprev && prev[j].he_uid < uid)
+                j++;
+            if (j < nprev && prev[j].he_uid == uid) {
+                out[i].he_bytes = prev[j].he_bytes + unzigzag(vb);
+                out[i].he_files = prev[j].he_files + unzigzag(vf);
+            } else {
+                out[i].he_bytes = unzigzag(vb);
+                out[i].he_files = unzigzag(vf);
+            }
+        }
+    }
+    return 0;
+}
+
+/* helper for hist_append() - decode the last block, starting from the
+ * keyframe before it.  Returns the number of entries in *entp, or -1 if
+ * a block could not be decoded.
+ */
+static int
+decode_state(hist_t h, struct hist_ent **entp)
+{
+    struct hist_ent *prev = NULL, *cur;
+    int i, k, nprev = 0;
+
+    for (k = h->h_nblocks - 1; k > 0; k--)
+        if ((h->h_blocks[k]->hb_flags & HIST_KEYFRAME))
+            break;
+    for (i = k; i < h->h_nblocks; i++) {
+        cur = xmalloc((h->h_blocks[i]->hb_count + 1) * sizeof(*cur));
+        if (decode_block(h->h_blocks[i], prev, nprev, cur) < 0) {
+            free(cur);
+            if (prev)
+                free(prev);
+            return -1;
+        }
+        nprev = h->h_blocks[i]->hb_count;
+        if (prev)
+            free(prev);
+        prev = cur;
+    }
+    *entp = prev;
+    return nprev;
+}
+
+static int
+cmp_ent(const void *a, const void *b)
+{
+    const struct hist_ent *x = a;
+    const struct hist_ent *y = b;
+
+    if (x->he_uid < y->he_uid)
+        return -1;
+    if (x->he_uid > y->he_uid)
+        return 1;
+    return 0;
+}
+
+/* helper for hist_append() - encode one block, returning its length */
+static size_t
+encode_block(struct hist_ent *cur, int n, struct hist_ent *prev, int nprev,
+             int keyframe, time_t when, char **bufp)
+{
+    int nsparse = (n + HIST_SPARSE - 1) / HIST_SPARSE;
+    size_t size = sizeof(struct hist_block)
+                + nsparse * sizeof(struct hist_sparse) + n * MAXRECLEN + 8;
+    char *buf = xmalloc(size);
+    struct hist_block *b = (struct hist_block *)buf;
+    struct hist_sparse *sp = (struct hist_sparse *)(b + 1);
+    unsigned char *recs = (unsigned char *)(sp + nsparse);
+    unsigned char *p = recs;
+    uint64_t pb, pf;
+    uint32_t uid = 0;
+    int i, j = 0;
+
+    memset(buf, 0, size);
+    b->hb_magic = HIST_BLKMAGIC;
+    b->hb_flags = keyframe ? HIST_KEYFRAME : 0;
+    b->hb_time = when;
+    b->hb_count = n;
+    b->hb_nsparse = nsparse;
+    for (i = 0; i < n; i++) {
+        if (i % HIST_SPARSE == 0) {
+            sp[i / HIST_SPARSE].hs_uid = cur[i].he_uid;
+            sp[i / HIST_SPARSE].hs_offset = p - recs;
+            uid = 0;
+        }
+        p = put_varint(p, cur[i].he_uid - uid);
+        uid = cur[i].he_uid;
+        if (keyframe) {
+            p = put_varint(p, cur[i].he_bytes);
+            p = put_varint(p, cur[i].he_files);
+        } else {
+            while (j < nprev && prev[j].he_uid < uid)
+                j++;
+            pb = pf = 0;
+            if (j < nprev && prev[j].he_uid == uid) {
+                pb = prev[j].he_bytes;
+                pf = prev[j].he_files;
+            }
+            p = put_varint(p, zigzag(cur[i].he_bytes - pb));
+            p = put_varint(p, zigzag(cur[i].he_files - pf));
+        }
+        b->hb_bytes += cur[i].he_bytes;
+        b->hb_files += cur[i].he_files;
+    }
+    b->hb_len = ALIGN8((char *)p - (char *)(b + 1));
+    *bufp = buf;
+    return sizeof(*b) + b->hb_len;
+}
+
+/* helper for hist_append() - write all of buf to fd at off */
+static int
+pwrite_all(int fd, const char *buf, size_t len, off_t off)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = pwrite(fd, buf, len, off)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+/* Append the usage in qlist to the archive at path as a new block,
+ * creating the archive if needed.  Appenders are serialized with
+ * flock(2).  A partial block left by an interrupted append is discarded.
+ * Returns 0 on success, -1 on failure.
+ */
+int
+hist_append(char *path, char *label, char *rhost, char *rpath, time_t when,
+            List qlist)
+{
+    struct hist_ent *prev = NULL, *cur;
+    struct hist_header hh;
+    struct stat sb;
+    ListIterator itr;
+    hist_t h;
+    quota_t q;
+    char *buf = NULL;
+    size_t len, end;
+    int fd, i, j, n, nprev = 0, keyframe = 1, rc = -1;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) < 0 || fstat(fd, &sb) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    if (sb.st_size == 0) {
+        memset(&hh, 0, sizeof(hh));
+        hh.hh_magic = HIST_MAGIC;
+        hh.hh_version = HIST_VERSION;
+        hh.hh_strlen = strlen(label) + strlen(rhost) + strlen(rpath) + 3;
+        end = ALIGN8(sizeof(hh) + hh.hh_strlen);
+        buf = xmalloc(end);
+        memset(buf, 0, end);
+        memcpy(buf, &hh, sizeof(hh));
+        len = sizeof(hh);
+        strcpy(buf + len, label);
+        len += strlen(label) + 1;
+        strcpy(buf + len, rhost);
+        len += strlen(rhost) + 1;
+        strcpy(buf + len, rpath);
+        if (pwrite_all(fd, buf, end, 0) < 0) {
+            fprintf(stderr, "%s: write %s: %s\n", prog, path, strerror(errno));
+            goto done;
+        }
+        free(buf);
+        buf = NULL;
+    } else {
+        if (!(h = map_archive(fd, sb.st_size))) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, errno == EINVAL
+                    ? "not a quota history archive" : strerror(errno));
+            goto done;
+        }
+        if (strcmp(h->h_rhost, rhost) || strcmp(h->h_rpath, rpath)) {
+            fprintf(stderr, "%s: %s: archive is of %s:%s, not %s:%s\n",
+                    prog, path, h->h_rhost, h->h_rpath, rhost, rpath);
+            hist_close(h);
+            goto done;
+        }
+        keyframe = (h->h_nblocks % HIST_KEYINTERVAL == 0);
+        if (!keyframe && (nprev = decode_state(h, &prev)) < 0) {
+            keyframe = 1;   /* start afresh rather than build on bad data */
+            nprev = 0;
+        }
+        end = h->h_end;
+        hist_close(h);
+        if (end < sb.st_size && ftruncate(fd, end) < 0) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+            goto done;
+        }
+    }
+
+    cur = xmalloc((list_count(qlist) + 1) * sizeof(*cur));
+    n = 0;
+    itr = list_iterator_create(qlist);
+    while ((q = list_next(itr))) {
+        assert(q->q_magic == QUOTA_MAGIC);
+        cur[n].he_uid = q->q_uid;
+        cur[n].he_bytes = q->q_bytes_used;
+        cur[n].he_files = q->q_files_used;
+        n++;
+    }
+    list_iterator_destroy(itr);
+    qsort(cur, n, sizeof(*cur), cmp_ent);
+    for (i = 0, j = 0; i < n; i++)  /* drop duplicate uid's */
+        if (j == 0 || cur[i].he_uid != cur[j - 1].he_uid)
+            cur[j++] = cur[i];
+    n = j;
+
+    len = encode_block(cur, n, prev, nprev, keyframe, when, &buf);
+    free(cur);
+    if (pwrite_all(fd, buf, len, end) < 0 || fsync(fd) < 0) {
+        fprintf(stderr, "%s: write %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    rc = 0;
+done:
+    if (prev)
+        free(prev);
+    if (buf)
+        free(buf);
+    close(fd);
+    return rc;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,97 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Append-only quota usage history archive.
+ *
+ * An archive holds the bytes and files used by each user of one file
+ * system at each sweep.  It is a header naming the file system followed
+ * by one block per sweep.  Each block has a fixed header with the sweep
+ * time and usage totals, a sparse uid index, and one record per user in
+ * uid order.  A record is a varint uid gap followed by the bytes and files
+ * used: as varints in a keyframe block, or as zigzag varint deltas from
+ * the user's values in the previous block (0 if absent) otherwise.
+ * Every HIST_SPARSE'th record stores its uid in full (gap from 0) and
+ * has an entry in the sparse index, so one user can be found by decoding
+ * at most HIST_SPARSE records per block.
+ *
+ * All multi-byte header fields are in native byte order and every
+ * block is padded to a multiple of 8 bytes.
+ */
+
+#define HIST_MAGIC          0x52514849  /* "RQHI" */
+#define HIST_VERSION        1
+#define HIST_BLKMAGIC       0x524b4c42  /* "BLKR" */
+#define HIST_KEYFRAME       1           /* hb_flags: values are absolute */
+#define HIST_KEYINTERVAL    32          /* blocks between keyframes */
+#define HIST_SPARSE         64          /* records per sparse index entry */
+
+struct hist_header {
+    uint32_t    hh_magic;
+    uint32_t    hh_version;
+    uint32_t    hh_strlen;              /* label, rhost, rpath strings */
+    uint32_t    hh_pad;                 /* follow, padded to 8 bytes */
+};
+
+struct hist_block {
+    uint32_t    hb_magic;
+    uint32_t    hb_flags;
+    int64_t     hb_time;                /* time the sweep started */
+    uint32_t    hb_count;               /* number of records (users) */
+    uint32_t    hb_nsparse;             /* number of sparse index entries */
+    uint64_t    hb_len;                 /* bytes following this header */
+    uint64_t    hb_bytes;               /* total bytes used */
+    uint64_t    hb_files;               /* total files used */
+};
+
+struct hist_sparse {
+    uint32_t    hs_uid;
+    uint32_t    hs_offset;              /* of record, from end of index */
+};
+
+struct hist_usage {
+    int                 hu_present;     /* user was in this sweep */
+    unsigned long long  hu_bytes;
+    unsigned long long  hu_files;
+};
+
+typedef struct hist_struct *hist_t;
+
+int         hist_append(char *path, char *label, char *rhost, char *rpath,
+                        time_t when, List qlist);
+
+hist_t      hist_open(char *path);
+void        hist_close(hist_t h);
+const char *hist_label(hist_t h);
+const char *hist_rhost(hist_t h);
+const char *hist_rpath(hist_t h);
+int         hist_count(hist_t h);
+time_t      hist_time(hist_t h, int blk);
+void        hist_totals(hist_t h, int blk, unsigned long *users,
+                        unsigned long long *bytes, unsigned long long *files);
+void        hist_uid(hist_t h, uid_t uid, struct hist_usage *u);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
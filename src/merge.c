@@ -0,0 +1,217 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Merge several snapshots into one stream of records in sorted order.
+ *
+ * Each snapshot's records are sorted on the key (a permutation of record
+ * numbers is sorted; the snapshot itself is read in place), then the
+ * sorted runs are merged through a binary heap.  Ties are broken on
+ * snapshot order and then record order, so merging the snapshots of a
+ * sharded sweep gives the same order as a stable sort of their
+ * concatenation.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "snapshot.h"
+#include "merge.h"
+
+struct run {
+    const uint32_t     *r_uid;
+    const uint64_t     *r_key;          /* NULL for MERGE_UID */
+    int                *r_perm;         /* record numbers in sorted order */
+    int                 r_count;
+    int                 r_pos;          /* next position in r_perm */
+};
+
+#define MERGE_MAGIC 0x3e7a4c01
+struct merge_struct {
+    int                 m_magic;
+    int                 m_reverse;
+    struct run         *m_run;
+    int                 m_nrun;
+    int                *m_heap;         /* run numbers, least first */
+    int                 m_nheap;
+};
+
+/* Compare record a of run ra with record b of run rb: key, then run
+ * number, then record number.  The key comparison is reversed for -r.
+ */
+static int
+cmp_rec(merge_t m, int ra, int a, int rb, int b)
+{
+    struct run *x = &m->m_run[ra], *y = &m->m_run[rb];
+    uint64_t kx, ky;
+
+    if (x->r_key) {
+        kx = x->r_key[a];
+        ky = y->r_key[b];
+    } else {
+        kx = x->r_uid[a];
+        ky = y->r_uid[b];
+    }
+    if (kx != ky)
+        return ((kx < ky) ^ m->m_reverse) ? -1 : 1;
+    if (ra != rb)
+        return ra < rb ? -1 : 1;
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* qsort(3) has no context argument, so sort_run() passes it here.
+ */
+static merge_t sort_merge;
+static int sort_run_no;
+
+static int
+cmp_perm(const void *a, const void *b)
+{
+    return cmp_rec(sort_merge, sort_run_no, *(const int *)a,
+                   sort_run_no, *(const int *)b);
+}
+
+static void
+sort_run(merge_t m, int r)
+{
+    struct run *rp = &m->m_run[r];
+    int i;
+
+    rp->r_perm = xmalloc((rp->r_count + 1) * sizeof(int));
+    for (i = 0; i < rp->r_count; i++)
+        rp->r_perm[i] = i;
+    sort_merge = m;
+    sort_run_no = r;
+    qsort(rp->r_perm, rp->r_count, sizeof(int), cmp_perm);
+}
+
+/* Compare the heads of runs ra and rb.
+ */
+static inline int
+cmp_head(merge_t m, int ra, int rb)
+{
+    return cmp_rec(m, ra, m->m_run[ra].r_perm[m->m_run[ra].r_pos],
+                   rb, m->m_run[rb].r_perm[m->m_run[rb].r_pos]);
+}
+
+static void
+sift_down(merge_t m, int i)
+{
+    int *h = m->m_heap;
+    int c, tmp;
+
+    while ((c = 2 * i + 1) < m->m_nheap) {
+        if (c + 1 < m->m_nheap && cmp_head(m, h[c + 1], h[c]) < 0)
+            c++;
+        if (cmp_head(m, h[c], h[i]) >= 0)
+            break;
+        tmp = h[i];
+        h[i] = h[c];
+        h[c] = tmp;
+        i = c;
+    }
+}
+
+merge_t
+merge_create(snap_t *snap, int nsnap, int order, int reverse)
+{
+    merge_t m = xmalloc(sizeof(struct merge_struct));
+    int i;
+
+    m->m_magic = MERGE_MAGIC;
+    m->m_reverse = reverse ? 1 : 0;
+    m->m_nrun = nsnap;
+    m->m_run = xmalloc((nsnap + 1) * sizeof(struct run));
+    m->m_heap = xmalloc((nsnap + 1) * sizeof(int));
+    m->m_nheap = 0;
+    for (i = 0; i < nsnap; i++) {
+        struct run *rp = &m->m_run[i];
+
+        rp->r_uid = snap_column(snap[i], SNAP_COL_UID);
+        if (order == MERGE_BYTES)
+            rp->r_key = snap_column(snap[i], SNAP_COL_BYTES_USED);
+        else if (order == MERGE_FILES)
+            rp->r_key = snap_column(snap[i], SNAP_COL_FILES_USED);
+        else
+            rp->r_key = NULL;
+        rp->r_count = snap_count(snap[i]);
+        rp->r_pos = 0;
+        sort_run(m, i);
+        if (rp->r_count > 0)
+            m->m_heap[m->m_nheap++] = i;
+    }
+    for (i = m->m_nheap / 2 - 1; i >= 0; i--)
+        sift_down(m, i);
+    return m;
+}
+
+void
+merge_destroy(merge_t m)
+{
+    int i;
+
+    assert(m->m_magic == MERGE_MAGIC);
+    m->m_magic = 0;
+    for (i = 0; i < m->m_nrun; i++)
+        free(m->m_run[i].r_perm);
+    free(m->m_run);
+    free(m->m_heap);
+    free(m);
+}
+
+/* Get the next record in order.  Return the index of its snapshot and
+ * set *rec to its record number, or return -1 when all are done.
+ */
+int
+merge_next(merge_t m, int *rec)
+{
+    struct run *rp;
+    int r;
+
+    assert(m->m_magic == MERGE_MAGIC);
+    if (m->m_nheap == 0)
+        return -1;
+    r = m->m_heap[0];
+    rp = &m->m_run[r];
+    *rec = rp->r_perm[rp->r_pos++];
+    if (rp->r_pos == rp->r_count)
+        m->m_heap[0] = m->m_heap[--m->m_nheap];
+    sift_down(m, 0);
+    return r;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,41 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Merge several snapshots into one stream of records in sorted order.
+ */
+
+typedef struct merge_struct *merge_t;
+
+#define MERGE_UID       0       /* sort on uid */
+#define MERGE_BYTES     1       /* sort on space used */
+#define MERGE_FILES     2       /* sort on files used */
+
+merge_t merge_create(snap_t *snap, int nsnap, int order, int reverse);
+void    merge_destroy(merge_t m);
+int     merge_next(merge_t m, int *rec);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
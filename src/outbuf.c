@@ -0,0 +1,240 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Buffered report output.
+ *
+ * Rows are formatted directly into a large user-space buffer which is
+ * written to the file descriptor in big chunks, bypassing stdio.
+ * Field widths are minimum widths and fields are left-justified,
+ * as with printf "%-Ns", or right-justified if the width is negative.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "util.h"
+#include "outbuf.h"
+
+#define OUTBUF_MAGIC 0x0b0f1e55
+struct outbuf_struct {
+    int     ob_magic;
+    int     ob_fd;
+    char   *ob_buf;
+    int     ob_size;
+    int     ob_len;
+    int     ob_err;         /* errno of first failed write, if any */
+};
+
+static const char digits2[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* Create an output buffer of 'size' bytes for fd.  Any output pending
+ * in stdio is flushed first so it stays in order.
+ */
+outbuf_t
+outbuf_create(int fd, int size)
+{
+    outbuf_t ob = xmalloc(sizeof(struct outbuf_struct));
+
+    assert(size >= 64);
+    fflush(NULL);
+    ob->ob_magic = OUTBUF_MAGIC;
+    ob->ob_fd = fd;
+    ob->ob_buf = xmalloc(size);
+    ob->ob_size = size;
+    ob->ob_len = 0;
+    ob->ob_err = 0;
+
+    return ob;
+}
+
+/* Flush and free the buffer.  Returns -1 with errno set if any write
+ * failed over the life of the buffer.
+ */
+int
+outbuf_destroy(outbuf_t ob)
+{
+    int err;
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    outbuf_flush(ob);
+    err = ob->ob_err;
+    ob->ob_magic = 0;
+    free(ob->ob_buf);
+    free(ob);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int
+outbuf_flush(outbuf_t ob)
+{
+    int n, done = 0;
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    while (done < ob->ob_len && !ob->ob_err) {
+        n = write(ob->ob_fd, ob->ob_buf + done, ob->ob_len - done);
+        if (n < 0) {
+            if (errno != EINTR)
+                ob->ob_err = errno;
+            continue;
+        }
+        done += n;
+    }
+    ob->ob_len = 0;
+    return ob->ob_err ? -1 : 0;
+}
+
+/* Make room for at least n more bytes and return the write position.
+ */
+static inline char *
+reserve(outbuf_t ob, int n)
+{
+    assert(n <= ob->ob_size);
+    if (ob->ob_len + n > ob->ob_size)
+        outbuf_flush(ob);
+    return ob->ob_buf + ob->ob_len;
+}
+
+void
+outbuf_write(outbuf_t ob, const char *s, int len)
+{
+    int n;
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    while (len > 0) {
+        n = len < ob->ob_size ? len : ob->ob_size;
+        memcpy(reserve(ob, n), s, n);
+        ob->ob_len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+void
+outbuf_putc(outbuf_t ob, char c)
+{
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    *reserve(ob, 1) = c;
+    ob->ob_len++;
+}
+
+void
+outbuf_pad(outbuf_t ob, int n)
+{
+    int m;
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    while (n > 0) {
+        m = n < ob->ob_size ? n : ob->ob_size;
+        memset(reserve(ob, m), ' ', m);
+        ob->ob_len += m;
+        n -= m;
+    }
+}
+
+/* Copy len bytes of s into the buffer, padded with spaces to width.
+ * A negative width right-justifies the field.
+ */
+static inline void
+putfield(outbuf_t ob, const char *s, int len, int width)
+{
+    int right = 0;
+    char *p;
+
+    if (width < 0) {
+        width = -width;
+        right = 1;
+    }
+    if (len >= width || width > ob->ob_size) {
+        if (right)
+            outbuf_pad(ob, width - len);
+        outbuf_write(ob, s, len);
+        if (!right)
+            outbuf_pad(ob, width - len);
+        return;
+    }
+    p = reserve(ob, width);
+    if (right) {
+        memset(p, ' ', width - len);
+        memcpy(p + width - len, s, len);
+    } else {
+        memcpy(p, s, len);
+        memset(p + len, ' ', width - len);
+    }
+    ob->ob_len += width;
+}
+
+void
+outbuf_putstr(outbuf_t ob, const char *s, int width)
+{
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    putfield(ob, s, strlen(s), width);
+}
+
+void
+outbuf_putull(outbuf_t ob, unsigned long long val, int width)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    while (val >= 100) {
+        p -= 2;
+        memcpy(p, &digits2[(val % 100) * 2], 2);
+        val /= 100;
+    }
+    if (val >= 10) {
+        p -= 2;
+        memcpy(p, &digits2[val * 2], 2);
+    } else
+        *--p = '0' + val;
+    putfield(ob, p, tmp + sizeof(tmp) - p, width);
+}
+
+void
+outbuf_putsize(outbuf_t ob, unsigned long long size, int width)
+{
+    char tmp[16];
+
+    assert(ob->ob_magic == OUTBUF_MAGIC);
+    putfield(ob, tmp, size2buf(size, tmp), width);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
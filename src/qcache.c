@@ -0,0 +1,294 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * A per-user cache of quota results.
+ *
+ * The cache file is text, one result per line, with tab-separated fields:
+ *   time label rhost rpath uid
+ *   bytes_used bytes_softlim bytes_hardlim bytes_secleft bytes_state
+ *   files_used files_softlim files_hardlim files_secleft files_state
+ * where time is when the result was retrieved from the server.
+ * Results are keyed by (label, rhost, rpath, uid).
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/param.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "qcache.h"
+
+#define QCACHE_HEADER   "# quota cache 1\n"
+
+struct qcache_entry {
+    time_t      ce_time;
+    quota_t     ce_quota;
+};
+
+#define QCACHE_MAGIC 0x9cac4e01
+struct qcache_struct {
+    int         c_magic;
+    List        c_ents;
+};
+
+static void
+free_entry(struct qcache_entry *e)
+{
+    quota_destroy(e->ce_quota);
+    free(e);
+}
+
+/* helper for qcache_open() - parse one line into a new entry, or NULL */
+static struct qcache_entry *
+parse_entry(char *line)
+{
+    char *f[15];
+    char *p = line;
+    struct qcache_entry *e;
+    quota_t q;
+    int i;
+
+    for (i = 0; i < 15; i++) {
+        f[i] = p;
+        if (!(p = strchr(p, i < 14 ? '\t' : '\n')))
+            return NULL;
+        *p++ = '\0';
+    }
+    q = quota_create(f[1], f[2], f[3], 0);
+    q->q_uid = strtoul(f[4], NULL, 10);
+    q->q_bytes_used = strtoull(f[5], NULL, 10);
+    q->q_bytes_softlim = strtoull(f[6], NULL, 10);
+    q->q_bytes_hardlim = strtoull(f[7], NULL, 10);
+    q->q_bytes_secleft = strtoull(f[8], NULL, 10);
+    q->q_bytes_state = strtoul(f[9], NULL, 10);
+    q->q_files_used = strtoull(f[10], NULL, 10);
+    q->q_files_softlim = strtoull(f[11], NULL, 10);
+    q->q_files_hardlim = strtoull(f[12], NULL, 10);
+    q->q_files_secleft = strtoull(f[13], NULL, 10);
+    q->q_files_state = strtoul(f[14], NULL, 10);
+    if (q->q_bytes_state > EXPIRED || q->q_files_state > EXPIRED) {
+        quota_destroy(q);
+        return NULL;
+    }
+    e = xmalloc(sizeof(struct qcache_entry));
+    e->ce_time = strtol(f[0], NULL, 10);
+    e->ce_quota = q;
+    return e;
+}
+
+/* Read the cache at path.  A missing or unreadable cache file is
+ * treated as empty.
+ */
+qcache_t
+qcache_open(char *path)
+{
+    qcache_t c = xmalloc(sizeof(struct qcache_struct));
+    struct qcache_entry *e;
+    char buf[BUFSIZ];
+    FILE *f;
+
+    c->c_magic = QCACHE_MAGIC;
+    c->c_ents = list_create((ListDelF)free_entry);
+    if (!(f = fopen(path, "r")))
+        return c;
+    if (fgets(buf, sizeof(buf), f) && !strcmp(buf, QCACHE_HEADER)) {
+        while (fgets(buf, sizeof(buf), f)) {
+            if ((e = parse_entry(buf)))
+                list_append(c->c_ents, e);
+        }
+    }
+    fclose(f);
+    return c;
+}
+
+void
+qcache_close(qcache_t c)
+{
+    assert(c->c_magic == QCACHE_MAGIC);
+    c->c_magic = 0;
+    list_destroy(c->c_ents);
+    free(c);
+}
+
+/* helper for qcache_get()/qcache_put() */
+static struct qcache_entry *
+find_entry(qcache_t c, char *label, char *rhost, char *rpath, uid_t uid)
+{
+    ListIterator itr;
+    struct qcache_entry *e;
+    quota_t q;
+
+    itr = list_iterator_create(c->c_ents);
+    while ((e = list_next(itr))) {
+        q = e->ce_quota;
+        if (q->q_uid == uid && !strcmp(q->q_label, label)
+                            && !strcmp(q->q_rhost, rhost)
+                            && !strcmp(q->q_rpath, rpath))
+            break;
+    }
+    list_iterator_destroy(itr);
+    return e;
+}
+
+/* Return a new quota for uid on cp from the cache, or NULL if not cached.
+ * The age of the result is returned in *agep.  Grace times are reduced
+ * by the age so they stay meaningful.
+ */
+quota_t
+qcache_get(qcache_t c, confent_t *cp, uid_t uid, time_t *agep)
+{
+    struct qcache_entry *e;
+    quota_t q;
+    time_t age;
+
+    assert(c->c_magic == QCACHE_MAGIC);
+    if (!(e = find_entry(c, cp->cf_label, cp->cf_rhost, cp->cf_rpath, uid)))
+        return NULL;
+    age = time(NULL) - e->ce_time;
+    if (age < 0)
+        age = 0;
+    q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, cp->cf_thresh);
+    q->q_uid = uid;
+    q->q_bytes_used = e->ce_quota->q_bytes_used;
+    q->q_bytes_softlim = e->ce_quota->q_bytes_softlim;
+    q->q_bytes_hardlim = e->ce_quota->q_bytes_hardlim;
+    q->q_bytes_secleft = e->ce_quota->q_bytes_secleft > age
+                       ? e->ce_quota->q_bytes_secleft - age : 0;
+    q->q_bytes_state = e->ce_quota->q_bytes_state;
+    q->q_files_used = e->ce_quota->q_files_used;
+    q->q_files_softlim = e->ce_quota->q_files_softlim;
+    q->q_files_hardlim = e->ce_quota->q_files_hardlim;
+    q->q_files_secleft = e->ce_quota->q_files_secleft > age
+                       ? e->ce_quota->q_files_secleft - age : 0;
+    q->q_files_state = e->ce_quota->q_files_state;
+    *agep = age;
+    return q;
+}
+
+/* Add (a copy of) q to the cache, replacing any previous result.
+ */
+void
+qcache_put(qcache_t c, quota_t q, time_t when)
+{
+    struct qcache_entry *e;
+    quota_t cq;
+
+    assert(c->c_magic == QCACHE_MAGIC);
+    assert(q->q_magic == QUOTA_MAGIC);
+    if (!(e = find_entry(c, q->q_label, q->q_rhost, q->q_rpath, q->q_uid))) {
+        e = xmalloc(sizeof(struct qcache_entry));
+        e->ce_quota = quota_create(q->q_label, q->q_rhost, q->q_rpath, 0);
+        list_append(c->c_ents, e);
+    }
+    e->ce_time = when;
+    cq = e->ce_quota;
+    cq->q_uid = q->q_uid;
+    cq->q_bytes_used = q->q_bytes_used;
+    cq->q_bytes_softlim = q->q_bytes_softlim;
+    cq->q_bytes_hardlim = q->q_bytes_hardlim;
+    cq->q_bytes_secleft = q->q_bytes_secleft;
+    cq->q_bytes_state = q->q_bytes_state;
+    cq->q_files_used = q->q_files_used;
+    cq->q_files_softlim = q->q_files_softlim;
+    cq->q_files_hardlim = q->q_files_hardlim;
+    cq->q_files_secleft = q->q_files_secleft;
+    cq->q_files_state = q->q_files_state;
+}
+
+/* helper for qcache_write() - tabs and newlines would corrupt the file */
+static int
+printable(char *s)
+{
+    return strpbrk(s, "\t\n") == NULL;
+}
+
+/* Write the cache to path, replacing it atomically.  The file is
+ * readable only by its owner.  Returns 0 on success, -1 on failure.
+ */
+int
+qcache_write(qcache_t c, char *path)
+{
+    char tmppath[MAXPATHLEN];
+    ListIterator itr;
+    struct qcache_entry *e;
+    quota_t q;
+    FILE *f;
+    int fd, rc = 0;
+
+    assert(c->c_magic == QCACHE_MAGIC);
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+        return -1;
+    if (!(f = fdopen(fd, "w"))) {
+        close(fd);
+        unlink(tmppath);
+        return -1;
+    }
+    fputs(QCACHE_HEADER, f);
+    itr = list_iterator_create(c->c_ents);
+    while ((e = list_next(itr))) {
+        q = e->ce_quota;
+        if (!printable(q->q_label) || !printable(q->q_rhost)
+                                   || !printable(q->q_rpath))
+            continue;
+        fprintf(f, "%ld\t%s\t%s\t%s\t%lu\t"
+                "%llu\t%llu\t%llu\t%llu\t%d\t%llu\t%llu\t%llu\t%llu\t%d\n",
+                (long)e->ce_time, q->q_label, q->q_rhost, q->q_rpath,
+                (unsigned long)q->q_uid,
+                q->q_bytes_used, q->q_bytes_softlim, q->q_bytes_hardlim,
+                q->q_bytes_secleft, q->q_bytes_state,
+                q->q_files_used, q->q_files_softlim, q->q_files_hardlim,
+                q->q_files_secleft, q->q_files_state);
+    }
+    list_iterator_destroy(itr);
+    if (ferror(f))
+        rc = -1;
+    if (fclose(f) != 0)
+        rc = -1;
+    if (rc == 0 && rename(tmppath, path) < 0)
+        rc = -1;
+    if (rc < 0)
+        unlink(tmppath);
+    return rc;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
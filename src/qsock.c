@@ -0,0 +1,215 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Protocol between quota(1) and quotad-cache(8) - see qsock.h.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "qsock.h"
+
+/* Connect to the daemon at path.  Returns the socket, or -1 if there
+ * is no daemon.
+ */
+int
+qsock_connect(char *path)
+{
+    struct sockaddr_un sun;
+    int fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path))
+        return -1;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* helper for qsock_query() - read one line, without buffering past it */
+static int
+read_line(int fd, char *buf, int len)
+{
+    int n = 0;
+    ssize_t rc;
+
+    while (n < len - 1) {
+        if ((rc = read(fd, buf + n, 1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (rc == 0)
+            return -1;
+        if (buf[n++] == '\n') {
+            buf[n] = '\0';
+            return n;
+        }
+    }
+    return -1;
+}
+
+/* Ask the daemon on fd for uid's quota on cp.  Returns 0 with *qp set
+ * to the result, or to NULL if there is no quota.  Returns 1 if the
+ * daemon declined and the server should be queried directly, or -1 if
+ * the connection to the daemon failed as well.
+ */
+int
+qsock_query(int fd, confent_t *cp, uid_t uid, quota_t *qp)
+{
+    char buf[QSOCK_LINELEN];
+    quota_t q;
+    int n;
+
+    if (strpbrk(cp->cf_label, "\t\n") || strpbrk(cp->cf_rhost, "\t\n")
+                                      || strpbrk(cp->cf_rpath, "\t\n"))
+        return 1;
+    n = snprintf(buf, sizeof(buf), "%lu\t%s\t%s\t%s\n", (unsigned long)uid,
+                 cp->cf_label, cp->cf_rhost, cp->cf_rpath);
+    if (n >= sizeof(buf) || write(fd, buf, n) != n)
+        return -1;
+    if (read_line(fd, buf, sizeof(buf)) < 0)
+        return -1;
+    if (!strcmp(buf, "NONE\n")) {
+        *qp = NULL;
+        return 0;
+    }
+    if (!strcmp(buf, "DENIED\n") || !strcmp(buf, "UNKNOWN\n")
+                                 || !strcmp(buf, "ERROR\n"))
+        return 1;
+    q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, cp->cf_thresh);
+    q->q_uid = uid;
+    if (qsock_parse_reply(buf, q) < 0) {
+        quota_destroy(q);
+        return -1;
+    }
+    *qp = q;
+    return 0;
+}
+
+/* Fill in q from an OK reply line.  Returns 0 on success, -1 if line is
+ * not an OK reply.
+ */
+int
+qsock_parse_reply(char *line, quota_t q)
+{
+    char buf[QSOCK_LINELEN];
+    char *f[11];
+    char *p = buf;
+    int i;
+
+    snprintf(buf, sizeof(buf), "%s", line);
+    for (i = 0; i < 11; i++) {
+        f[i] = p;
+        if (!(p = strchr(p, i < 10 ? '\t' : '\n')))
+            return -1;
+        *p++ = '\0';
+    }
+    if (strcmp(f[0], "OK") != 0)
+        return -1;
+    q->q_bytes_used = strtoull(f[1], NULL, 10);
+    q->q_bytes_softlim = strtoull(f[2], NULL, 10);
+    q->q_bytes_hardlim = strtoull(f[3], NULL, 10);
+    q->q_bytes_secleft = strtoull(f[4], NULL, 10);
+    q->q_bytes_state = strtoul(f[5], NULL, 10);
+    q->q_files_used = strtoull(f[6], NULL, 10);
+    q->q_files_softlim = strtoull(f[7], NULL, 10);
+    q->q_files_hardlim = strtoull(f[8], NULL, 10);
+    q->q_files_secleft = strtoull(f[9], NULL, 10);
+    q->q_files_state = strtoul(f[10], NULL, 10);
+    if (q->q_bytes_state > EXPIRED || q->q_files_state > EXPIRED)
+        return -1;
+    return 0;
+}
+
+/* Split a request line in place.  Returns 0 on success, -1 if malformed.
+ */
+int
+qsock_parse_request(char *line, uid_t *uidp, char **labelp, char **rhostp,
+                    char **rpathp)
+{
+    char *f[4];
+    char *p = line, *end;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        f[i] = p;
+        if (!(p = strchr(p, i < 3 ? '\t' : '\n')))
+            return -1;
+        *p++ = '\0';
+    }
+    *uidp = strtoul(f[0], &end, 10);
+    if (end == f[0] || *end != '\0')
+        return -1;
+    *labelp = f[1];
+    *rhostp = f[2];
+    *rpathp = f[3];
+    return 0;
+}
+
+/* Format the reply for q, or for no quota if q is NULL.
+ */
+void
+qsock_format_reply(quota_t q, char *buf, int len)
+{
+    if (!q) {
+        snprintf(buf, len, "NONE\n");
+        return;
+    }
+    assert(q->q_magic == QUOTA_MAGIC);
+    snprintf(buf, len, "OK\t%llu\t%llu\t%llu\t%llu\t%d"
+             "\t%llu\t%llu\t%llu\t%llu\t%d\n",
+             q->q_bytes_used, q->q_bytes_softlim, q->q_bytes_hardlim,
+             q->q_bytes_secleft, q->q_bytes_state,
+             q->q_files_used, q->q_files_softlim, q->q_files_hardlim,
+             q->q_files_secleft, q->q_files_state);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
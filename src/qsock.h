@@ -0,0 +1,52 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Protocol between quota(1) and quotad-cache(8), over a unix socket.
+ *
+ * Each request is one line of tab-separated fields:
+ *   uid label rhost rpath
+ * and is answered, in order, by one line:
+ *   OK bytes_used bytes_softlim bytes_hardlim bytes_secleft bytes_state
+ *      files_used files_softlim files_hardlim files_secleft files_state
+ * or NONE if the server has no quota for the user, or DENIED, UNKNOWN
+ * or ERROR if the client should query the server itself.
+ */
+
+#ifndef _PATH_QUOTAD_SOCKET
+#define _PATH_QUOTAD_SOCKET "/var/run/quotad-cache.sock"
+#endif
+
+#define QSOCK_LINELEN   (3 * MAXPATHLEN + 64)
+
+int     qsock_connect(char *path);
+int     qsock_query(int fd, confent_t *cp, uid_t uid, quota_t *qp);
+int     qsock_parse_request(char *line, uid_t *uidp, char **labelp,
+                            char **rhostp, char **rpathp);
+void    qsock_format_reply(quota_t q, char *buf, int len);
+int     qsock_parse_reply(char *line, quota_t q);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,135 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Classify quota usage against limits.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "qstate.h"
+
+/* Set (*hi,*lo) to the 128-bit product of k (< 2^32) and x.
+ */
+static inline void
+mul128(unsigned long long k, unsigned long long x,
+       unsigned long long *hi, unsigned long long *lo)
+{
+    unsigned long long plo = k * (x & 0xffffffffULL);
+    unsigned long long pmid = k * (x >> 32);
+
+    *lo = plo + (pmid << 32);
+    *hi = (pmid >> 32) + (*lo < plo);
+}
+
+/* Classify n records at once.  For each i, state[i] is set as follows:
+ *   NONE        no soft or hard limit
+ *   EXPIRED     used exceeds the hard limit
+ *   STARTED     used exceeds the soft limit and timeleft > 0
+ *   NOTSTARTED  used exceeds the soft limit and timeleft <= 0
+ *   UNDER       otherwise
+ * and over[i] is set if thresh is nonzero and used >= thresh percent of hard,
+ * tested exactly as used*100 >= hard*thresh in 128-bit arithmetic.
+ * The loop body has no branches, so there are no mispredictions on mixed
+ * input; gcc vectorizes it at -O3 with 64-bit vector multiplies (-mavx2) but
+ * not at the default -O2.  The state arithmetic relies on the order of the
+ * qstate_t values.
+ */
+void
+qstate_classify(int n, const unsigned long long *restrict used,
+                const unsigned long long *restrict soft,
+                const unsigned long long *restrict hard,
+                const long long *restrict timeleft, int thresh,
+                qstate_t *restrict state, unsigned char *restrict over)
+{
+    unsigned long long t = thresh > 0 ? thresh : 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        unsigned long long u = used[i];
+        unsigned long long s = soft[i];
+        unsigned long long h = hard[i];
+        unsigned long long uhi, ulo, hhi, hlo;
+        unsigned long long overhard = (h != 0) & (u > h);
+        unsigned long long oversoft = (s != 0) & (u > s);
+        unsigned long long started = timeleft[i] > 0;
+        unsigned long long limited = (h | s) != 0;
+        unsigned long long st;
+
+        st = UNDER + oversoft * (1 + started);
+        st += overhard * (EXPIRED - st);
+        state[i] = (qstate_t)(limited * st);
+
+        mul128(100, u, &uhi, &ulo);
+        mul128(t, h, &hhi, &hlo);
+        over[i] = (t != 0) & ((uhi > hhi) | ((uhi == hhi) & (ulo >= hlo)));
+    }
+}
+
+/* Classify a single value.
+ */
+qstate_t
+qstate_get(unsigned long long used, unsigned long long soft,
+           unsigned long long hard, long long timeleft)
+{
+    qstate_t state;
+    unsigned char over;
+
+    qstate_classify(1, &used, &soft, &hard, &timeleft, 0, &state, &over);
+    return state;
+}
+
+/* Return 1 if used has reached thresh percent of hard, 0 otherwise.
+ */
+int
+qstate_over_thresh(unsigned long long used, unsigned long long hard,
+                   int thresh)
+{
+    unsigned long long soft = 0;
+    long long timeleft = 0;
+    qstate_t state;
+    unsigned char over;
+
+    qstate_classify(1, &used, &soft, &hard, &timeleft, thresh, &state, &over);
+    return over;
+}
+
+/* Return the name of a state, as used in reports.
+ */
+const char *
+qstate_str(qstate_t state)
+{
+    static const char *names[] = {
+        "none", "under", "notstarted", "started", "expired"
+    };
+
+    if (state < NONE || state > EXPIRED)
+        return "unknown";
+    return names[state];
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,40 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+typedef enum { NONE, UNDER, NOTSTARTED, STARTED, EXPIRED } qstate_t;
+
+void qstate_classify(int n, const unsigned long long *used,
+                     const unsigned long long *soft,
+                     const unsigned long long *hard,
+                     const long long *timeleft, int thresh,
+                     qstate_t *state, unsigned char *over);
+qstate_t qstate_get(unsigned long long used, unsigned long long soft,
+                    unsigned long long hard, long long timeleft);
+int qstate_over_thresh(unsigned long long used, unsigned long long hard,
+                       int thresh);
+const char *qstate_str(qstate_t state);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -44,23 +44,56 @@
 #include <dirent.h>
 #include <libgen.h>
 #include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/time.h>
 
 #include "list.h"
 #include "getconf.h"
 #include "getquota.h"
+#include "snapshot.h"
+#include "qcache.h"
+#include "qsock.h"
+#include "srvstat.h"
 #include "util.h"
 
+/* How to get quotas for a user.
+ */
+struct query {
+    uid_t       uid;
+    int         usesnap;    /* use snapshots configured in quota.conf */
+    qcache_t    cache;      /* result cache, or NULL */
+    int         ttl;        /* seconds before a cached result is stale */
+    int         refresh;    /* ignore cached results, but update cache */
+    int         stale;      /* set if a stale cached result was used */
+    int         dirty;      /* set if cache has new results to save */
+    srvstat_t   stats;      /* server latencies, kept with the cache */
+    int         sock;       /* connection to quotad-cache, or -1 */
+    double      budget;     /* seconds to spend on servers, 0 = any */
+    double      start;      /* time the queries began */
+    int         skipped;    /* set if a server was skipped for budget */
+};
+
 static void usage(void);
 static void alarm_handler(int arg);
 static void lookup_user_byname(char *user, uid_t *uidp, char **dirp);
 static void lookup_user_byuid(char *user, uid_t *uidp, char **dirp);
 static void lookup_self(char **userp, uid_t *uidp, char **dirp);
-static void get_login_quota(conf_t config, char *homedir, uid_t uid,
+static quota_t get_snap_quota(confent_t *cp, uid_t uid, long *agep);
+static quota_t get_quota(confent_t *cp, struct query *qry);
+static void get_login_quota(conf_t config, char *homedir, struct query *qry,
                             List qlist, int skipnolimit);
-static void get_all_quota(conf_t config, uid_t uid, List qlist,
+static void get_all_quota(conf_t config, struct query *qry, List qlist,
                           int skipnolimit);
+static char *cache_path(uid_t uid);
+static double now(void);
+static void refresh_cache(conf_t config, char *homedir, int lopt,
+                          int skipnolimit, struct query *qry, char *path);
 
-#define OPTIONS "f:rvlt:Td"
+#define OPTIONS "f:rvlt:TdLc:b:s:"
 #if HAVE_GETOPT_LONG
 #define GETOPT(ac,av,opt,lopt) getopt_long(ac,av,opt,lopt,NULL)
 static const struct option longopts[] = {
@@ -71,6 +104,10 @@ static const struct option longopts[] = {
     {"config",           required_argument,  0, 'f'},
     {"selftest",         no_argument,        0, 'T'},
     {"debug",            no_argument,        0, 'd'},
+    {"live",             no_argument,        0, 'L'},
+    {"cache",            required_argument,  0, 'c'},
+    {"budget",           required_argument,  0, 'b'},
+    {"socket",           required_argument,  0, 's'},
     {0, 0, 0, 0},
 };
 #else
@@ -83,7 +120,7 @@ int debug = 0;
 int 
 main(int argc, char *argv[])
 {
-    int vopt = 0, ropt = 0, lopt = 0;
+    int vopt = 0, ropt = 0, lopt = 0, Lopt = 0;
     char *user = NULL;
     char *dir = NULL;
     uid_t uid;
@@ -93,6 +130,14 @@ main(int argc, char *argv[])
     List qlist;
     char *conf_path = _PATH_QUOTA_CONF;
     conf_t config = NULL;
+    struct query qry;
+    char *cpath = NULL;
+    char spath[MAXPATHLEN];
+    int ttl = -1, own;
+    double budget = 0;
+    char *end;
+    long val;
+    char *sock_path = _PATH_QUOTAD_SOCKET;
 
     /* handle args */
     prog = basename(argv[0]);
@@ -102,8 +147,13 @@ main(int argc, char *argv[])
             lopt = 1;
             break;
         case 't':   /* --timeout */
+            val = strtol(optarg, &end, 10);
+            if (*end != '\0' || end == optarg || val <= 0 || val > INT_MAX) {
+                fprintf(stderr, "%s: error parsing timeout\n", prog);
+                exit(1);
+            }
             signal(SIGALRM, alarm_handler);
-            alarm(strtoul(optarg, NULL, 10));
+            alarm(val);
             break;
         case 'r':   /* --realpath */
             ropt = 1;
@@ -125,6 +175,27 @@ main(int argc, char *argv[])
         case 'd':   /* --debug (undocumented) */
             debug = 1;
             break;
+        case 'L':   /* --live */
+            Lopt = 1;
+            break;
+        case 'c':   /* --cache */
+            val = strtol(optarg, &end, 10);
+            if (*end != '\0' || end == optarg || val < 0 || val > INT_MAX) {
+                fprintf(stderr, "%s: error parsing cache ttl\n", prog);
+                exit(1);
+            }
+            ttl = val;
+            break;
+        case 'b':   /* --budget */
+            budget = strtod(optarg, &end);
+            if (*end != '\0' || budget <= 0) {
+                fprintf(stderr, "%s: error parsing budget\n", prog);
+                exit(1);
+            }
+            break;
+        case 's':   /* --socket */
+            sock_path = optarg;
+            break;
         default:
             usage();
         }
@@ -133,6 +204,10 @@ main(int argc, char *argv[])
         user = xstrdup(argv[optind++]);
     if (optind < argc)
         usage();
+    if (budget > 0 && ttl < 0) {
+        fprintf(stderr, "%s: -b requires -c\n", prog);
+        exit(1);
+    }
 
     if (!user)
         lookup_self(&user, &uid, &dir);
@@ -143,12 +218,40 @@ main(int argc, char *argv[])
 
     config = conf_init(conf_path); /* exit/perror on error */
 
+    /* Only root may query another user's quota.  The servers refuse
+     * such queries, so snapshots, the cache and quotad-cache are not used
+     * for them either, lest the answer depend on which one had it.
+     */
+    own = (geteuid() == 0 || geteuid() == uid);
+
+    memset(&qry, 0, sizeof(qry));
+    qry.uid = uid;
+    qry.usesnap = !Lopt && own;
+    qry.ttl = ttl;
+    if (ttl >= 0 && own && (cpath = cache_path(uid))) {
+        qry.cache = qcache_open(cpath);
+        snprintf(spath, sizeof(spath), "%s.stats", cpath);
+        qry.stats = srvstat_open(spath);
+    }
+    qry.refresh = Lopt;
+    qry.sock = Lopt || !own ? -1 : qsock_connect(sock_path);
+    qry.budget = budget;
+    qry.start = now();
+
     /* build list of quotas */
     qlist = list_create((ListDelF)quota_destroy);
     if (lopt)
-        get_login_quota(config, dir, uid, qlist, !vopt);
+        get_login_quota(config, dir, &qry, qlist, !vopt);
     else
-        get_all_quota(config, uid, qlist, !vopt);
+        get_all_quota(config, &qry, qlist, !vopt);
+
+    /* save new results, and refresh stale ones in the background */
+    if (qry.dirty && qcache_write(qry.cache, cpath) < 0 && debug)
+        printf("cache: %s: %s\n", cpath, strerror(errno));
+    if (qry.dirty && srvstat_write(qry.stats, spath) < 0 && debug)
+        printf("stats: %s: %s\n", spath, strerror(errno));
+    if (qry.stale)
+        refresh_cache(config, dir, lopt, !vopt, &qry, cpath);
 
     /* print output */   
     if (vopt) {
@@ -169,6 +272,14 @@ main(int argc, char *argv[])
     }
 
     list_destroy(qlist);
+    if (qry.sock >= 0)
+        close(qry.sock);
+    if (qry.cache)
+        qcache_close(qry.cache);
+    if (qry.stats)
+        srvstat_close(qry.stats);
+    if (cpath)
+        free(cpath);
     if (user)
         free(user);
     if (dir)
@@ -181,7 +292,8 @@ main(int argc, char *argv[])
 static void 
 usage(void)
 {
-    fprintf(stderr, "Usage: %s [-vlr] [-t sec] [-f conffile] [user]\n", prog);
+    fprintf(stderr, "Usage: %s [-vlrL] [-t sec] [-c ttl [-b sec]] [-s socket] "
+            "[-f conffile] [user]\n", prog);
     exit(1);
 }
 
@@ -245,8 +357,249 @@ lookup_user_byname(char *user, uid_t *uidp, char **dirp)
     *dirp = xstrdup(pw->pw_dir);
 }
 
+/* Look up uid in the snapshot configured for cp.  Returns NULL if the
+ * snapshot is missing, stale, of another file system, or lacks uid.
+ */
+static quota_t
+get_snap_quota(confent_t *cp, uid_t uid, long *agep)
+{
+    snap_t snap;
+    quota_t q = NULL;
+    long age;
+    int rec;
+
+    if (!(snap = snap_open(cp->cf_snapshot))) {
+        if (debug)
+            printf("snapshot: %s: %s\n", cp->cf_snapshot, errno == EINVAL
+                   ? "not a quota snapshot" : strerror(errno));
+        return NULL;
+    }
+    age = time(NULL) - snap_time(snap);
+    if (strcmp(snap_rhost(snap), cp->cf_rhost) != 0
+            || strcmp(snap_rpath(snap), cp->cf_rpath) != 0) {
+        if (debug)
+            printf("snapshot: %s: not of %s:%s\n", cp->cf_snapshot,
+                   cp->cf_rhost, cp->cf_rpath);
+    } else if (age > cp->cf_maxage) {
+        if (debug)
+            printf("snapshot: %s: stale (%lds old)\n", cp->cf_snapshot, age);
+    } else if ((rec = snap_lookup(snap, uid)) < 0) {
+        if (debug)
+            printf("snapshot: %s: uid %lu not found\n", cp->cf_snapshot,
+                   (unsigned long)uid);
+    } else {
+        if (debug)
+            printf("snapshot: %s: using record %d\n", cp->cf_snapshot, rec);
+        q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath,
+                         cp->cf_thresh);
+        snap_quota(snap, rec, q);
+        *agep = age;
+    }
+    snap_close(snap);
+    return q;
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1E-6;
+}
+
+/* Return 1 if the server for cp is expected to take longer to answer
+ * than is left of the budget.
+ */
+static int
+over_budget(confent_t *cp, struct query *qry)
+{
+    double rtt;
+
+    if (qry->budget <= 0 || !qry->stats
+            || srvstat_get(qry->stats, cp->cf_rhost, &rtt, NULL, NULL) < 0)
+        return 0;
+    return rtt > qry->budget - (now() - qry->start);
+}
+
+/* Get the quota for qry->uid on cp, from the cache if enabled and
+ * fresh, then from its snapshot if one is configured and usable, then
+ * from a stale cached result, then from quotad-cache if it is running,
+ * otherwise from the server.  A server expected to take longer than the
+ * budget allows is not queried; a cached result is used if there is
+ * one, else cp is skipped, and the cache is refreshed in the background
+ * either way.  Returns NULL on failure or if skipped.
+ */
+static quota_t
+get_quota(confent_t *cp, struct query *qry)
+{
+    quota_fs_t fs;
+    quota_t q, cq = NULL;
+    time_t age;
+    long sage;
+    double t0;
+
+    if (qry->cache && !qry->refresh
+                   && (cq = qcache_get(qry->cache, cp, qry->uid, &age))
+                   && age <= qry->ttl) {
+        if (debug)
+            printf("cache: %s: hit\n", cp->cf_label);
+        return cq;
+    }
+
+    /* A snapshot newer than a stale cached result is used, and cached
+     * with its own time.  When refreshing the cache, a snapshot older
+     * than the ttl would not freshen it, so the server is asked instead.
+     */
+    if (qry->usesnap && cp->cf_snapshot
+                     && (q = get_snap_quota(cp, qry->uid, &sage))) {
+        if ((cq && sage >= age) || (qry->refresh && sage > qry->ttl))
+            quota_destroy(q);
+        else {
+            if (cq)
+                quota_destroy(cq);
+            if (qry->cache && sage > qry->ttl)
+                qry->stale = 1;
+            if (qry->cache) {
+                qcache_put(qry->cache, q, time(NULL) - sage);
+                qry->dirty = 1;
+            }
+            return q;
+        }
+    }
+    if (cq) {
+        if (debug)
+            printf("cache: %s: stale\n", cp->cf_label);
+        qry->stale = 1;
+        return cq;
+    }
+    if (qry->sock >= 0) {
+        switch (qsock_query(qry->sock, cp, qry->uid, &q)) {
+            case 0:
+                if (debug)
+                    printf("quotad: %s: %s\n", cp->cf_label,
+                           q ? "answered" : "no quota");
+                if (q && qry->cache) {
+                    qcache_put(qry->cache, q, time(NULL));
+                    qry->dirty = 1;
+                }
+                return q;
+            case 1:
+                if (debug)
+                    printf("quotad: %s: declined\n", cp->cf_label);
+                break;
+            case -1:
+                if (debug)
+                    printf("quotad: connection lost\n");
+                close(qry->sock);
+                qry->sock = -1;
+                break;
+        }
+    }
+    if (over_budget(cp, qry)) {
+        if (debug)
+            printf("budget: %s: skipping %s\n", cp->cf_label, cp->cf_rhost);
+        qry->stale = 1;
+        if (qry->cache && (q = qcache_get(qry->cache, cp, qry->uid, &age)))
+            return q;
+        qry->skipped = 1;
+        return NULL;
+    }
+    fs = quota_fs_create_conf(cp);
+    q = quota_create_fs(fs);
+    quota_fs_destroy(fs);
+    t0 = now();
+    if (quota_get(qry->uid, q)) {
+        if (qry->stats) {
+            srvstat_put(qry->stats, cp->cf_rhost, now() - t0, 0, 0,
+                        time(NULL));
+            qry->dirty = 1;
+        }
+        quota_destroy(q);
+        return NULL;
+    }
+    if (qry->stats)
+        srvstat_put(qry->stats, cp->cf_rhost, now() - t0, 0, 0, time(NULL));
+    if (qry->cache) {
+        qcache_put(qry->cache, q, time(NULL));
+        qry->dirty = 1;
+    }
+    return q;
+}
+
+/* Return the path of the result cache for uid (caller must free),
+ * in $XDG_RUNTIME_DIR, else $HOME/.cache, or NULL if neither is set.
+ */
+static char *
+cache_path(uid_t uid)
+{
+    char path[MAXPATHLEN];
+    char *dir;
+
+    if ((dir = getenv("XDG_RUNTIME_DIR")) && *dir)
+        snprintf(path, sizeof(path), "%s/quota-%lu", dir, (unsigned long)uid);
+    else if ((dir = getenv("HOME")) && *dir) {
+        snprintf(path, sizeof(path), "%s/.cache", dir);
+        (void)mkdir(path, 0700);
+        snprintf(path, sizeof(path), "%s/.cache/quota-%lu", dir,
+                 (unsigned long)uid);
+    } else
+        return NULL;
+    return xstrdup(path);
+}
+
+/* Fork a detached child to refresh the cache at path from the servers,
+ * while the parent goes on to print the cached results.  Concurrent
+ * refreshes are coalesced by an flock(2) on path.lock.  Does nothing if
+ * there is no cache (path is NULL).
+ */
 static void
-get_login_quota(conf_t config, char *homedir, uid_t uid, List qlist,
+refresh_cache(conf_t config, char *homedir, int lopt, int skipnolimit,
+              struct query *qry, char *path)
+{
+    char lockpath[MAXPATHLEN], spath[MAXPATHLEN];
+    List qlist;
+    int fd;
+
+    if (path == NULL)
+        return;
+    fflush(NULL);
+    if (fork() != 0)    /* parent, or fork failed */
+        return;
+    setsid();
+    if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        if (fd > 2)
+            close(fd);
+    }
+    snprintf(lockpath, sizeof(lockpath), "%s.lock", path);
+    if ((fd = open(lockpath, O_WRONLY | O_CREAT, 0600)) < 0)
+        exit(1);
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+        exit(0);        /* another refresh is in progress */
+
+    /* reread the cache to keep results saved since we read it */
+    qcache_close(qry->cache);
+    qry->cache = qcache_open(path);
+    qry->refresh = 1;
+    qry->budget = 0;
+    qlist = list_create((ListDelF)quota_destroy);
+    if (lopt)
+        get_login_quota(config, homedir, qry, qlist, skipnolimit);
+    else
+        get_all_quota(config, qry, qlist, skipnolimit);
+    if (qry->dirty) {
+        qcache_write(qry->cache, path);
+        snprintf(spath, sizeof(spath), "%s.stats", path);
+        srvstat_write(qry->stats, spath);
+    }
+    exit(0);
+}
+
+static void
+get_login_quota(conf_t config, char *homedir, struct query *qry, List qlist,
                 int skipnolimit)
 {
     confent_t *cp;
@@ -259,16 +612,16 @@ get_login_quota(conf_t config, char *homedir, uid_t uid, List qlist,
     }
     if (skipnolimit && cp->cf_nolimit)
         return;
-    q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, cp->cf_thresh);
-    if (quota_get(uid, q)) {
-        quota_destroy(q);
+    if (!(q = get_quota(cp, qry))) {
+        if (qry->skipped)
+            return;
         exit(1);
     }
     list_append(qlist, q);
 }
 
 static void
-get_all_quota(conf_t config, uid_t uid, List qlist, int skipnolimit)
+get_all_quota(conf_t config, struct query *qry, List qlist, int skipnolimit)
 {
     confent_t *cp;
     quota_t q;
@@ -278,12 +631,8 @@ get_all_quota(conf_t config, uid_t uid, List qlist, int skipnolimit)
     while ((cp = conf_next(itr)) != NULL) {
         if (skipnolimit && cp->cf_nolimit)
             continue;
-        q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, 
-                          cp->cf_thresh);
-        if (quota_get(uid, q)) {
-            quota_destroy(q);
+        if (!(q = get_quota(cp, qry)))
             continue; /* keep going and get the rest */
-        }
         list_append(qlist, q);
     }
     conf_iterator_destroy(itr);
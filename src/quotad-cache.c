@@ -0,0 +1,1186 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * quotad-cache - answer quota(1) from a node-local cache.
+ *
+ * Clients connect to a unix socket and ask for one (file system, uid)
+ * at a time (see qsock.h).  Results are cached for a few seconds, and
+ * a request for a result already being fetched waits for that fetch
+ * instead of starting another, so a crowd of logins costs each server
+ * one query per user.  A user other than root may only ask about their
+ * own uid, as checked with SO_PEERCRED.
+ *
+ * With -u, the daemon also speaks the rquota protocol on a UDP port, so
+ * unmodified rquota clients can use it as a caching proxy in front of
+ * the real servers.  A request names the file system by its rpath (or
+ * label) in quota.conf, and shares the cache with the unix socket.  The
+ * bulk extension in rquota.x is offered too, answering many users of
+ * one file system at once from the same cache.  Callers on a privileged
+ * port are trusted; others may only ask about the uid in their AUTH_UNIX
+ * credential, and may not make bulk requests.
+ *
+ * Fetches are made by a few long-lived worker processes per server,
+ * which keep their RPC clients open between queries.  The daemon itself
+ * never blocks on a server.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#define _GNU_SOURCE             /* struct ucred */
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#if HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <libgen.h>
+#include <assert.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_clnt.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "qsock.h"
+#include "rquota.h"
+
+#define TTL_DEFAULT     30      /* seconds a result is served from cache */
+#define TTL_MAX         86400   /* keeps the poll() timeout in range */
+#define WORKERS_DEFAULT 2       /* worker processes per server */
+#define NBUCKETS        4096
+#define RPC_BUFSIZE     65536   /* a datagram, big enough for bulk */
+
+/* An rquota bulk request, answered once all of its uids are.
+ */
+struct bulk {
+    struct sockaddr_in  b_addr;
+    uint32_t            b_xid;
+    uid_t              *b_uid;
+    char              **b_reply;        /* reply line for each uid */
+    int                 b_n;
+    int                 b_pending;      /* uids not yet answered */
+};
+
+/* A request waiting for an entry: from a unix socket client, or from an
+ * rquota client at wt_addr, or one uid of a bulk request.
+ */
+struct waiter {
+    struct client      *wt_client;      /* NULL for rquota */
+    struct sockaddr_in  wt_addr;
+    uint32_t            wt_xid;
+    struct bulk        *wt_bulk;        /* NULL unless bulk */
+    int                 wt_idx;         /* index into wt_bulk */
+};
+
+/* A cached result, or one being fetched (e_reply == NULL).
+ */
+struct entry {
+    struct entry       *e_next;         /* hash chain */
+    struct entry       *e_qnext;        /* server's queue of fetches */
+    int                 e_fs;           /* index into conf array */
+    uid_t               e_uid;
+    time_t              e_time;         /* when e_reply was fetched */
+    char               *e_reply;        /* reply line */
+    struct waiter      *e_wait;         /* requests waiting for e_reply */
+    int                 e_nwait;
+};
+
+struct client {
+    int                 c_fd;           /* -1 once gone */
+    uid_t               c_uid;          /* from SO_PEERCRED */
+    int                 c_waiting;      /* waiting on an entry */
+    size_t              c_len;          /* bytes in c_buf */
+    char                c_buf[QSOCK_LINELEN];
+};
+
+/* Query passed from parent to worker.
+ */
+struct cache_req {
+    int32_t             cq_fs;
+    uint32_t            cq_uid;
+};
+
+struct worker {
+    pid_t               w_pid;          /* 0 if not running */
+    int                 w_req;          /* write end of request pipe */
+    int                 w_fd;           /* read end of reply pipe */
+    struct entry       *w_cur;          /* entry being fetched, or NULL */
+    size_t              w_len;          /* bytes in w_buf */
+    char                w_buf[QSOCK_LINELEN];
+};
+
+struct server {
+    char               *s_rhost;
+    struct worker      *s_w;
+    struct entry       *s_head;         /* fetches not yet handed out */
+    struct entry       *s_tail;
+};
+
+static void usage(void);
+static void sig_handler(int sig);
+static void dispatch(struct server *s, int lfd);
+static void handle_client(struct client *c, int lfd);
+static void send_rquota(struct waiter *wt, char *reply);
+static void bulk_done(struct bulk *b, int idx, char *reply);
+
+#define OPTIONS "f:s:t:w:u:Fd"
+#if HAVE_GETOPT_LONG
+#define GETOPT(ac,av,opt,lopt) getopt_long(ac,av,opt,lopt,NULL)
+static const struct option longopts[] = {
+    {"config",           required_argument,  0, 'f'},
+    {"socket",           required_argument,  0, 's'},
+    {"ttl",              required_argument,  0, 't'},
+    {"workers",          required_argument,  0, 'w'},
+    {"udp",              required_argument,  0, 'u'},
+    {"foreground",       no_argument,        0, 'F'},
+    {"debug",            no_argument,        0, 'd'},
+    {0, 0, 0, 0},
+};
+#else
+#define GETOPT(ac,av,opt,lopt) getopt(ac,av,opt)
+#endif
+
+char *prog;
+int debug = 0;
+
+static confent_t **conf;
+static int nconf;
+static int *fs_server;                  /* server of each file system */
+static struct server *sv;
+static int nsv;
+static int nworkers = WORKERS_DEFAULT;
+static int ttl = TTL_DEFAULT;
+static struct entry *hash[NBUCKETS];
+static struct client **clients;
+static int nclients;
+static int ufd = -1;                    /* rquota socket, or -1 */
+static volatile sig_atomic_t done = 0;
+
+/* Read the configuration and group its file systems by server.
+ */
+static void
+load_conf(char *path)
+{
+    conf_t config = conf_init(path); /* exit/perror on error */
+    conf_iterator_t itr;
+    confent_t *cp;
+    int i;
+
+    itr = conf_iterator_create(config);
+    while ((cp = conf_next(itr))) {
+        conf = xrealloc(conf, (nconf + 1) * sizeof(*conf));
+        fs_server = xrealloc(fs_server, (nconf + 1) * sizeof(int));
+        conf[nconf] = cp;
+        for (i = 0; i < nsv; i++)
+            if (!strcmp(sv[i].s_rhost, cp->cf_rhost))
+                break;
+        if (i == nsv) {
+            sv = xrealloc(sv, (nsv + 1) * sizeof(*sv));
+            memset(&sv[nsv], 0, sizeof(*sv));
+            sv[nsv].s_rhost = cp->cf_rhost;
+            sv[nsv].s_w = xmalloc(nworkers * sizeof(struct worker));
+            memset(sv[nsv].s_w, 0, nworkers * sizeof(struct worker));
+            nsv++;
+        }
+        fs_server[nconf++] = i;
+    }
+    conf_iterator_destroy(itr);
+    /* config is kept for the life of the daemon */
+}
+
+static int
+find_fs(char *label, char *rhost, char *rpath)
+{
+    int i;
+
+    for (i = 0; i < nconf; i++)
+        if (!strcmp(conf[i]->cf_label, label)
+                && !strcmp(conf[i]->cf_rhost, rhost)
+                && !strcmp(conf[i]->cf_rpath, rpath))
+            return i;
+    return -1;
+}
+
+static unsigned
+bucket(int fs, uid_t uid)
+{
+    return ((unsigned)uid * 2654435761U + fs) % NBUCKETS;
+}
+
+static struct entry *
+find_entry(int fs, uid_t uid)
+{
+    struct entry *e;
+
+    for (e = hash[bucket(fs, uid)]; e; e = e->e_next)
+        if (e->e_fs == fs && e->e_uid == uid)
+            return e;
+    return NULL;
+}
+
+/* Drop results older than the ttl, so the cache holds only users seen
+ * recently.
+ */
+static void
+expire(time_t t)
+{
+    struct entry **ep, *e;
+    int i;
+
+    for (i = 0; i < NBUCKETS; i++) {
+        ep = &hash[i];
+        while ((e = *ep)) {
+            if (e->e_reply && t - e->e_time > ttl) {
+                *ep = e->e_next;
+                free(e->e_reply);
+                free(e->e_wait);
+                free(e);
+            } else
+                ep = &e->e_next;
+        }
+    }
+}
+
+/* Worker: run each query read from rfd and send the reply line to wfd.
+ * The query context of a file system is made on its first query.
+ */
+static void
+cache_worker(int rfd, int wfd)
+{
+    quota_fs_t *fs = xmalloc(nconf * sizeof(quota_fs_t));
+    char buf[QSOCK_LINELEN];
+    struct cache_req req;
+    quota_t q;
+    ssize_t n;
+
+    memset(fs, 0, nconf * sizeof(quota_fs_t));
+    for (;;) {
+        do
+            n = read(rfd, &req, sizeof(req));
+        while (n < 0 && errno == EINTR);
+        if (n != sizeof(req))
+            _exit(n != 0);
+        if (!fs[req.cq_fs])
+            fs[req.cq_fs] = quota_fs_create_conf(conf[req.cq_fs]);
+        q = quota_create_fs(fs[req.cq_fs]);
+        if (quota_get(req.cq_uid, q) == 0)
+            qsock_format_reply(q, buf, sizeof(buf));
+        else
+            qsock_format_reply(NULL, buf, sizeof(buf));
+        quota_destroy(q);
+        if (write_all(wfd, buf, strlen(buf)) < 0)
+            _exit(1);
+    }
+}
+
+/* Fork worker w.  The worker must not hold any other worker's pipes or
+ * any client's socket open.
+ */
+static int
+spawn(struct worker *w, int lfd)
+{
+    int req[2], rep[2];
+    int i, j;
+
+    if (pipe(req) < 0)
+        return -1;
+    if (pipe(rep) < 0) {
+        close(req[0]);
+        close(req[1]);
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    switch ((w->w_pid = fork())) {
+        case -1:
+            w->w_pid = 0;
+            close(req[0]);
+            close(req[1]);
+            close(rep[0]);
+            close(rep[1]);
+            return -1;
+        case 0:
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            close(lfd);
+            if (ufd >= 0)
+                close(ufd);
+            close(req[1]);
+            close(rep[0]);
+            for (i = 0; i < nsv; i++) {
+                for (j = 0; j < nworkers; j++) {
+                    if (sv[i].s_w[j].w_pid) {
+                        close(sv[i].s_w[j].w_req);
+                        close(sv[i].s_w[j].w_fd);
+                    }
+                }
+            }
+            for (i = 0; i < nclients; i++)
+                if (clients[i]->c_fd >= 0)
+                    close(clients[i]->c_fd);
+            cache_worker(req[0], rep[1]);
+            /*NOTREACHED*/
+    }
+    close(req[0]);
+    close(rep[1]);
+    w->w_req = req[1];
+    w->w_fd = rep[0];
+    w->w_cur = NULL;
+    w->w_len = 0;
+    return 0;
+}
+
+static void
+send_reply(struct client *c, char *reply)
+{
+    if (c->c_fd >= 0 && write_all(c->c_fd, reply, strlen(reply)) < 0) {
+        close(c->c_fd);
+        c->c_fd = -1;
+    }
+}
+
+/* Entry e has its answer, or failed if reply is NULL: tell the waiting
+ * clients, and go on with their next requests.
+ */
+static void
+complete(struct entry *e, char *reply, int lfd)
+{
+    struct waiter *wait = e->e_wait;
+    int i, nwait = e->e_nwait;
+
+    e->e_wait = NULL;
+    e->e_nwait = 0;
+    if (reply) {
+        e->e_reply = xstrdup(reply);
+        e->e_time = time(NULL);
+    }
+    for (i = 0; i < nwait; i++) {
+        if (wait[i].wt_client) {
+            send_reply(wait[i].wt_client, reply ? reply : "ERROR\n");
+            wait[i].wt_client->c_waiting = 0;
+        } else if (wait[i].wt_bulk)
+            bulk_done(wait[i].wt_bulk, wait[i].wt_idx, reply);
+        else
+            send_rquota(&wait[i], reply);
+    }
+    if (!reply) {
+        struct entry **ep = &hash[bucket(e->e_fs, e->e_uid)];
+
+        while (*ep != e)
+            ep = &(*ep)->e_next;
+        *ep = e->e_next;
+        free(e);
+    }
+    for (i = 0; i < nwait; i++)
+        if (wait[i].wt_client)
+            handle_client(wait[i].wt_client, lfd);
+    free(wait);
+}
+
+/* Hand queued fetches to idle workers of server s.
+ */
+static void
+dispatch(struct server *s, int lfd)
+{
+    struct cache_req req;
+    struct worker *w;
+    struct entry *e;
+    int i;
+
+    for (i = 0; i < nworkers && s->s_head; i++) {
+        w = &s->s_w[i];
+        if (w->w_pid && w->w_cur)
+            continue;
+        if (!w->w_pid && spawn(w, lfd) < 0) {
+            fprintf(stderr, "%s: fork: %s\n", prog, strerror(errno));
+            break;
+        }
+        e = s->s_head;
+        s->s_head = e->e_qnext;
+        req.cq_fs = e->e_fs;
+        req.cq_uid = e->e_uid;
+        if (write_all(w->w_req, &req, sizeof(req)) < 0) {
+            s->s_head = e;      /* worker died: retried once it is reaped */
+            break;
+        }
+        w->w_cur = e;
+        if (debug)
+            printf("fetch: %s uid %lu\n", conf[e->e_fs]->cf_label,
+                   (unsigned long)e->e_uid);
+    }
+}
+
+/* Return the cached reply for uid on fs if it is fresh.  Otherwise queue
+ * wt to wait for it, and fetch it unless a fetch is already in progress.
+ */
+static char *
+lookup(int fs, uid_t uid, struct waiter *wt, int lfd)
+{
+    struct server *s = &sv[fs_server[fs]];
+    struct waiter *w;
+    struct entry *e;
+    int i;
+
+    if ((e = find_entry(fs, uid))) {
+        if (e->e_reply && time(NULL) - e->e_time <= ttl)
+            return e->e_reply;
+        if (e->e_reply) {
+            free(e->e_reply);
+            e->e_reply = NULL;
+        } else
+            goto wait;          /* coalesce with the fetch in progress */
+    } else {
+        e = xmalloc(sizeof(struct entry));
+        memset(e, 0, sizeof(*e));
+        e->e_fs = fs;
+        e->e_uid = uid;
+        e->e_next = hash[bucket(fs, uid)];
+        hash[bucket(fs, uid)] = e;
+    }
+    e->e_qnext = NULL;
+    if (s->s_head)
+        s->s_tail->e_qnext = e;
+    else
+        s->s_head = e;
+    s->s_tail = e;
+wait:
+    for (i = 0; i < e->e_nwait; i++) {
+        w = &e->e_wait[i];
+        if (!wt->wt_client && !w->wt_client && !wt->wt_bulk && !w->wt_bulk
+                && w->wt_xid == wt->wt_xid
+                && w->wt_addr.sin_addr.s_addr == wt->wt_addr.sin_addr.s_addr
+                && w->wt_addr.sin_port == wt->wt_addr.sin_port)
+            return NULL;        /* an rquota client's retransmission */
+    }
+    e->e_wait = xrealloc(e->e_wait, (e->e_nwait + 1) * sizeof(*wt));
+    e->e_wait[e->e_nwait++] = *wt;
+    dispatch(s, lfd);
+    return NULL;
+}
+
+/* Answer request line from client c, or make it wait for a fetch.
+ */
+static void
+request(struct client *c, char *line, int lfd)
+{
+    char *label, *rhost, *rpath, *reply;
+    struct waiter wt;
+    uid_t uid;
+    int fs;
+
+    if (qsock_parse_request(line, &uid, &label, &rhost, &rpath) < 0
+            || (fs = find_fs(label, rhost, rpath)) < 0) {
+        send_reply(c, "UNKNOWN\n");
+        return;
+    }
+    if (c->c_uid != 0 && c->c_uid != uid) {
+        send_reply(c, "DENIED\n");
+        return;
+    }
+    memset(&wt, 0, sizeof(wt));
+    wt.wt_client = c;
+    if ((reply = lookup(fs, uid, &wt, lfd)))
+        send_reply(c, reply);
+    else
+        c->c_waiting = 1;
+}
+
+/* Send an RPC reply to the rquota client wt.
+ */
+static void
+send_rpc(struct waiter *wt, enum accept_stat stat, xdrproc_t xres, void *res)
+{
+    char buf[RPC_BUFSIZE];
+    struct rpc_msg msg;
+    XDR x;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.rm_xid = wt->wt_xid;
+    msg.rm_direction = REPLY;
+    msg.rm_reply.rp_stat = MSG_ACCEPTED;
+    msg.acpted_rply.ar_verf = _null_auth;
+    msg.acpted_rply.ar_stat = stat;
+    if (stat == SUCCESS) {
+        msg.acpted_rply.ar_results.where = res;
+        msg.acpted_rply.ar_results.proc = xres;
+    } else if (stat == PROG_MISMATCH) {
+        msg.acpted_rply.ar_vers.low = 1;        /* RQUOTAVERS and */
+        msg.acpted_rply.ar_vers.high = 1;       /* RQUOTABULKVERS */
+    }
+    xdrmem_create(&x, buf, sizeof(buf), XDR_ENCODE);
+    if (xdr_replymsg(&x, &msg))
+        sendto(ufd, buf, xdr_getpos(&x), 0, (struct sockaddr *)&wt->wt_addr,
+               sizeof(wt->wt_addr));
+    xdr_destroy(&x);
+}
+
+static unsigned long
+clip(unsigned long long n)
+{
+    /* (uint32_t)(-1) would look like "no quota" to some clients */
+    return n < 0xffffffffULL ? n : 0xfffffffeUL;
+}
+
+/* Answer the rquota client wt from a reply line.  Byte counts are given
+ * in the smallest block size, from 1K up, in which they fit 32 bits.
+ * A failed fetch is not answered, so the client will ask again.
+ */
+static void
+send_rquota(struct waiter *wt, char *reply)
+{
+    getquota_rslt res;
+    struct rquota *rq = &res.getquota_rslt_u.gqr_rquota;
+    unsigned long long max, bsize = 1024;
+    quota_t q;
+
+    if (!reply)
+        return;
+    memset(&res, 0, sizeof(res));
+    q = quota_create("", "", "", 0);
+    if (!strcmp(reply, "DENIED\n"))
+        res.gqr_status = Q_EPERM;
+    else if (qsock_parse_reply(reply, q) < 0)
+        res.gqr_status = Q_NOQUOTA;
+    else {
+        res.gqr_status = Q_OK;
+        max = q->q_bytes_used;
+        if (q->q_bytes_softlim > max)
+            max = q->q_bytes_softlim;
+        if (q->q_bytes_hardlim > max)
+            max = q->q_bytes_hardlim;
+        while (max / bsize >= 0xffffffffULL)
+            bsize <<= 1;
+        rq->rq_bsize = bsize;
+        rq->rq_active = TRUE;
+        rq->rq_curblocks = (q->q_bytes_used + bsize - 1) / bsize;
+        rq->rq_bsoftlimit = q->q_bytes_softlim / bsize;
+        rq->rq_bhardlimit = q->q_bytes_hardlim / bsize;
+        if (q->q_bytes_state == STARTED)
+            rq->rq_btimeleft = q->q_bytes_secleft;
+        rq->rq_curfiles = clip(q->q_files_used);
+        rq->rq_fsoftlimit = clip(q->q_files_softlim);
+        rq->rq_fhardlimit = clip(q->q_files_hardlim);
+        if (q->q_files_state == STARTED)
+            rq->rq_ftimeleft = q->q_files_secleft;
+    }
+    quota_destroy(q);
+    send_rpc(wt, SUCCESS, (xdrproc_t)xdr_getquota_rslt, &res);
+}
+
+/* Convert a reply line to a bulk record for uid.
+ */
+static void
+to_bulk(uid_t uid, char *reply, rquota_bulk *r)
+{
+    quota_t q = quota_create("", "", "", 0);
+
+    memset(r, 0, sizeof(*r));
+    r->rqb_uid = uid;
+    if (reply && !strcmp(reply, "DENIED\n"))
+        r->rqb_status = Q_EPERM;
+    else if (!reply || qsock_parse_reply(reply, q) < 0)
+        r->rqb_status = Q_NOQUOTA;
+    else {
+        r->rqb_status = Q_OK;
+        r->rqb_bytes_used = q->q_bytes_used;
+        r->rqb_bytes_softlim = q->q_bytes_softlim;
+        r->rqb_bytes_hardlim = q->q_bytes_hardlim;
+        if (q->q_bytes_state == STARTED)
+            r->rqb_bytes_timeleft = q->q_bytes_secleft;
+        r->rqb_files_used = q->q_files_used;
+        r->rqb_files_softlim = q->q_files_softlim;
+        r->rqb_files_hardlim = q->q_files_hardlim;
+        if (q->q_files_state == STARTED)
+            r->rqb_files_timeleft = q->q_files_secleft;
+    }
+    quota_destroy(q);
+}
+
+/* Uid idx of bulk request b is answered (reply is NULL if the fetch
+ * failed): once all are, send the reply and free b.  An idx of b->b_n
+ * stands for the request itself, which is pending until it has been
+ * read in full.
+ */
+static void
+bulk_done(struct bulk *b, int idx, char *reply)
+{
+    getquota_bulk_rslt res;
+    struct waiter wt;
+    int i;
+
+    if (idx < b->b_n && reply)
+        b->b_reply[idx] = xstrdup(reply);
+    if (--b->b_pending > 0)
+        return;
+    res.getquota_bulk_rslt_len = b->b_n;
+    res.getquota_bulk_rslt_val = xmalloc((b->b_n + 1) * sizeof(rquota_bulk));
+    for (i = 0; i < b->b_n; i++)
+        to_bulk(b->b_uid[i], b->b_reply[i], &res.getquota_bulk_rslt_val[i]);
+    memset(&wt, 0, sizeof(wt));
+    wt.wt_addr = b->b_addr;
+    wt.wt_xid = b->b_xid;
+    send_rpc(&wt, SUCCESS, (xdrproc_t)xdr_getquota_bulk_rslt, &res);
+    free(res.getquota_bulk_rslt_val);
+    for (i = 0; i < b->b_n; i++)
+        if (b->b_reply[i])
+            free(b->b_reply[i]);
+    free(b->b_reply);
+    free(b->b_uid);
+    free(b);
+}
+
+/* Return the file system an rquota client means by path: the one with
+ * that rpath in quota.conf, else that label.
+ */
+static int
+find_path(char *path)
+{
+    int i;
+
+    for (i = 0; i < nconf; i++)
+        if (!strcmp(conf[i]->cf_rpath, path))
+            return i;
+    for (i = 0; i < nconf; i++)
+        if (!strcmp(conf[i]->cf_label, path))
+            return i;
+    return -1;
+}
+
+/* Read the arguments of a bulk request from x, and answer it or make its
+ * uids wait for their fetches.  Every uid is refused unless the caller is
+ * root (cuid is 0).
+ */
+static void
+read_bulk(XDR *x, struct waiter *wt, long cuid, int lfd)
+{
+    getquota_bulk_args args;
+    struct waiter bw;
+    struct bulk *b;
+    char *reply;
+    u_int count;
+    int fs, i, n;
+
+    memset(&args, 0, sizeof(args));
+    if (!xdr_getquota_bulk_args(x, &args)) {
+        send_rpc(wt, GARBAGE_ARGS, NULL, NULL);
+        return;
+    }
+    /* A range must not wrap past the largest uid.
+     */
+    count = args.gqba_uids.gqba_uids_len ? args.gqba_uids.gqba_uids_len
+                                         : args.gqba_count;
+    if (count > RQ_BULKMAX || (!args.gqba_uids.gqba_uids_len && count > 0
+                    && args.gqba_first + (count - 1) < args.gqba_first)) {
+        send_rpc(wt, GARBAGE_ARGS, NULL, NULL);
+        goto done;
+    }
+    n = count;
+    if (debug)
+        printf("rquota: %s bulk of %d uids\n", args.gqba_pathp, n);
+    b = xmalloc(sizeof(struct bulk));
+    b->b_addr = wt->wt_addr;
+    b->b_xid = wt->wt_xid;
+    b->b_n = n;
+    b->b_pending = n + 1;
+    b->b_uid = xmalloc((n + 1) * sizeof(uid_t));
+    b->b_reply = xmalloc((n + 1) * sizeof(char *));
+    memset(b->b_reply, 0, (n + 1) * sizeof(char *));
+    fs = find_path(args.gqba_pathp);
+    for (i = 0; i < n; i++) {
+        b->b_uid[i] = args.gqba_uids.gqba_uids_len
+                    ? args.gqba_uids.gqba_uids_val[i] : args.gqba_first + i;
+        if (cuid != 0) {
+            bulk_done(b, i, "DENIED\n");
+            continue;
+        }
+        if (fs < 0) {
+            bulk_done(b, i, "UNKNOWN\n");
+            continue;
+        }
+        memset(&bw, 0, sizeof(bw));
+        bw.wt_bulk = b;
+        bw.wt_idx = i;
+        if ((reply = lookup(fs, b->b_uid[i], &bw, lfd)))
+            bulk_done(b, i, reply);
+    }
+    bulk_done(b, n, NULL);
+done:
+    xdr_free((xdrproc_t)xdr_getquota_bulk_args, (char *)&args);
+}
+
+/* Return the uid an rquota caller may ask about: 0 (any) if it sent
+ * from a privileged port, else the uid of its AUTH_UNIX credential, or
+ * -1 if it has none.
+ */
+static long
+caller_uid(struct rpc_msg *msg, struct waiter *wt)
+{
+    struct opaque_auth *cred = &msg->rm_call.cb_cred;
+    struct authunix_parms aup;
+    long uid = -1;
+    XDR x;
+
+    if (ntohs(wt->wt_addr.sin_port) < IPPORT_RESERVED)
+        return 0;
+    if (cred->oa_flavor != AUTH_UNIX)
+        return -1;
+    memset(&aup, 0, sizeof(aup));
+    xdrmem_create(&x, cred->oa_base, cred->oa_length, XDR_DECODE);
+    if (xdr_authunix_parms(&x, &aup))
+        uid = aup.aup_uid;
+    xdr_destroy(&x);
+    xdr_free((xdrproc_t)xdr_authunix_parms, (char *)&aup);
+    return uid;
+}
+
+/* Read an rquota request, and answer it or make it wait for a fetch.
+ */
+static void
+read_rquota(int lfd)
+{
+    char buf[RPC_BUFSIZE];
+    char cred[MAX_AUTH_BYTES], verf[MAX_AUTH_BYTES];
+    socklen_t len = sizeof(struct sockaddr_in);
+    getquota_args args;
+    struct rpc_msg msg;
+    struct waiter wt;
+    char *reply;
+    ssize_t n;
+    long cuid;
+    XDR x;
+    int fs;
+
+    memset(&wt, 0, sizeof(wt));
+    if ((n = recvfrom(ufd, buf, sizeof(buf), 0,
+                      (struct sockaddr *)&wt.wt_addr, &len)) < 0)
+        return;
+    memset(&msg, 0, sizeof(msg));
+    msg.rm_call.cb_cred.oa_base = cred;
+    msg.rm_call.cb_verf.oa_base = verf;
+    xdrmem_create(&x, buf, n, XDR_DECODE);
+    if (!xdr_callmsg(&x, &msg) || msg.rm_direction != CALL)
+        goto done;
+    wt.wt_xid = msg.rm_xid;
+    cuid = caller_uid(&msg, &wt);
+    if (msg.rm_call.cb_prog == RQUOTABULKPROG) {
+        if (msg.rm_call.cb_vers != RQUOTABULKVERS)
+            send_rpc(&wt, PROG_MISMATCH, NULL, NULL);
+        else if (msg.rm_call.cb_proc == NULLPROC)
+            send_rpc(&wt, SUCCESS, (xdrproc_t)xdr_void, NULL);
+        else if (msg.rm_call.cb_proc == RQUOTAPROC_GETQUOTA_BULK)
+            read_bulk(&x, &wt, cuid, lfd);
+        else
+            send_rpc(&wt, PROC_UNAVAIL, NULL, NULL);
+        goto done;
+    }
+    if (msg.rm_call.cb_prog != RQUOTAPROG) {
+        send_rpc(&wt, PROG_UNAVAIL, NULL, NULL);
+        goto done;
+    }
+    if (msg.rm_call.cb_vers != RQUOTAVERS) {
+        send_rpc(&wt, PROG_MISMATCH, NULL, NULL);
+        goto done;
+    }
+    switch (msg.rm_call.cb_proc) {
+        case NULLPROC:
+            send_rpc(&wt, SUCCESS, (xdrproc_t)xdr_void, NULL);
+            goto done;
+        case RQUOTAPROC_GETQUOTA:
+        case RQUOTAPROC_GETACTIVEQUOTA:
+            break;
+        default:
+            send_rpc(&wt, PROC_UNAVAIL, NULL, NULL);
+            goto done;
+    }
+    memset(&args, 0, sizeof(args));
+    if (!xdr_getquota_args(&x, &args)) {
+        send_rpc(&wt, GARBAGE_ARGS, NULL, NULL);
+        goto done;
+    }
+    if (debug)
+        printf("rquota: %s uid %d\n", args.gqa_pathp, args.gqa_uid);
+    if (cuid != 0 && cuid != args.gqa_uid)
+        send_rquota(&wt, "DENIED\n");
+    else if ((fs = find_path(args.gqa_pathp)) < 0)
+        send_rquota(&wt, "UNKNOWN\n");
+    else if ((reply = lookup(fs, args.gqa_uid, &wt, lfd)))
+        send_rquota(&wt, reply);
+    xdr_free((xdrproc_t)xdr_getquota_args, (char *)&args);
+done:
+    xdr_destroy(&x);
+}
+
+/* Run the complete requests buffered from c, until one has to wait.
+ */
+static void
+handle_client(struct client *c, int lfd)
+{
+    char *nl;
+    size_t n;
+
+    while (c->c_fd >= 0 && !c->c_waiting
+                        && (nl = memchr(c->c_buf, '\n', c->c_len))) {
+        char line[QSOCK_LINELEN + 1];
+
+        n = nl - c->c_buf + 1;
+        memcpy(line, c->c_buf, n);
+        line[n] = '\0';
+        memmove(c->c_buf, c->c_buf + n, c->c_len - n);
+        c->c_len -= n;
+        request(c, line, lfd);
+    }
+}
+
+static void
+accept_client(int lfd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    struct client *c;
+    int fd;
+
+    if ((fd = accept(lfd, NULL, NULL)) < 0)
+        return;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    clients = xrealloc(clients, (nclients + 1) * sizeof(*clients));
+    c = xmalloc(sizeof(struct client));
+    c->c_fd = fd;
+    c->c_uid = cred.uid;
+    c->c_waiting = 0;
+    c->c_len = 0;
+    clients[nclients++] = c;
+}
+
+static void
+read_client(struct client *c, int lfd)
+{
+    ssize_t n;
+
+    n = read(c->c_fd, c->c_buf + c->c_len, sizeof(c->c_buf) - c->c_len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        close(c->c_fd);
+        c->c_fd = -1;
+        return;
+    }
+    c->c_len += n;
+    handle_client(c, lfd);
+    if (c->c_len == sizeof(c->c_buf)) {     /* no newline in sight */
+        close(c->c_fd);
+        c->c_fd = -1;
+    }
+}
+
+/* Free clients that are gone and not waiting for a reply.
+ */
+static void
+reap_clients(void)
+{
+    int i, j;
+
+    for (i = 0, j = 0; i < nclients; i++) {
+        if (clients[i]->c_fd < 0 && !clients[i]->c_waiting)
+            free(clients[i]);
+        else
+            clients[j++] = clients[i];
+    }
+    nclients = j;
+}
+
+static void
+read_worker(struct server *s, struct worker *w, int lfd)
+{
+    struct entry *e = w->w_cur;
+    char *nl;
+    ssize_t n;
+
+    n = read(w->w_fd, w->w_buf + w->w_len, sizeof(w->w_buf) - w->w_len - 1);
+    if (n < 0 && errno == EINTR)
+        return;
+    if (n > 0) {
+        w->w_len += n;
+        w->w_buf[w->w_len] = '\0';
+        if (!(nl = strchr(w->w_buf, '\n')))
+            return;
+        nl[1] = '\0';
+        w->w_cur = NULL;
+        w->w_len = 0;
+        complete(e, w->w_buf, lfd);
+    } else {
+        /* the worker died: fail its query, and fork another next time */
+        close(w->w_req);
+        close(w->w_fd);
+        w->w_pid = 0;
+        w->w_cur = NULL;
+        if (e)
+            complete(e, NULL, lfd);
+    }
+    dispatch(s, lfd);
+}
+
+/* Open the rquota socket on port (0 for any), and register it with the
+ * portmapper if one is running.  Returns the port, or exits on failure.
+ */
+static int
+listen_udp(int port, int *registered)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+
+    if ((ufd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        fprintf(stderr, "%s: socket: %s\n", prog, strerror(errno));
+        exit(1);
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+    if (bind(ufd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+            || getsockname(ufd, (struct sockaddr *)&sin, &len) < 0) {
+        fprintf(stderr, "%s: udp port %d: %s\n", prog, port, strerror(errno));
+        exit(1);
+    }
+    port = ntohs(sin.sin_port);
+    pmap_unset(RQUOTAPROG, RQUOTAVERS);
+    pmap_unset(RQUOTABULKPROG, RQUOTABULKVERS);
+    *registered = pmap_set(RQUOTAPROG, RQUOTAVERS, IPPROTO_UDP, port)
+               && pmap_set(RQUOTABULKPROG, RQUOTABULKVERS, IPPROTO_UDP, port);
+    if (debug)
+        printf("rquota: udp port %d%s\n", port,
+               *registered ? "" : " (not registered with portmapper)");
+    return port;
+}
+
+static int
+listen_on(char *path)
+{
+    struct sockaddr_un sun;
+    int fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        fprintf(stderr, "%s: %s: path too long\n", prog, path);
+        exit(1);
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        fprintf(stderr, "%s: socket: %s\n", prog, strerror(errno));
+        exit(1);
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0
+            || chmod(path, 0666) < 0 || listen(fd, 128) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+int 
+main(int argc, char *argv[])
+{
+    char *conf_path = _PATH_QUOTA_CONF;
+    char *sock_path = _PATH_QUOTAD_SOCKET;
+    struct pollfd *pfd = NULL;
+    void **who = NULL;
+    int *kind = NULL;
+    int Fopt = 0, uport = -1, registered = 0;
+    int c, i, j, n, max, lfd;
+    time_t last = time(NULL);
+    char *end;
+    long val;
+    pid_t pid;
+
+    prog = basename(argv[0]);
+    while ((c = GETOPT(argc, argv, OPTIONS, longopts)) != EOF) {
+        switch (c) {
+        case 'f':   /* --config */
+            conf_path = optarg;
+            break;
+        case 's':   /* --socket */
+            sock_path = optarg;
+            break;
+        case 't':   /* --ttl */
+            val = strtol(optarg, &end, 10);
+            if (*end != '\0' || end == optarg || val < 0 || val > TTL_MAX) {
+                fprintf(stderr, "%s: error parsing ttl\n", prog);
+                exit(1);
+            }
+            ttl = val;
+            break;
+        case 'w':   /* --workers */
+            val = strtol(optarg, &end, 10);
+            if (*end != '\0' || end == optarg || val < 1 || val > INT_MAX) {
+                fprintf(stderr, "%s: error parsing workers\n", prog);
+                exit(1);
+            }
+            nworkers = val;
+            break;
+        case 'u':   /* --udp */
+            val = strtol(optarg, &end, 10);
+            if (*end != '\0' || end == optarg || val < 0 || val > 65535) {
+                fprintf(stderr, "%s: error parsing udp port\n", prog);
+                exit(1);
+            }
+            uport = val;
+            break;
+        case 'F':   /* --foreground */
+            Fopt = 1;
+            break;
+        case 'd':   /* --debug */
+            debug = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc)
+        usage();
+
+    if (debug)
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    load_conf(conf_path);
+    lfd = listen_on(sock_path);
+    if (uport >= 0)
+        listen_udp(uport, &registered);
+    if (!Fopt && daemon(0, 0) < 0) {
+        fprintf(stderr, "%s: daemon: %s\n", prog, strerror(errno));
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, sig_handler);
+    signal(SIGINT, sig_handler);
+
+    while (!done) {
+        max = 2 + nclients + nsv * nworkers;
+        pfd = xrealloc(pfd, max * sizeof(*pfd));
+        who = xrealloc(who, max * sizeof(*who));
+        kind = xrealloc(kind, max * sizeof(*kind));
+        pfd[0].fd = lfd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = ufd;        /* ignored by poll if -1 */
+        pfd[1].events = POLLIN;
+        n = 2;
+        for (i = 0; i < nclients; i++) {
+            if (clients[i]->c_fd < 0 || clients[i]->c_waiting)
+                continue;
+            pfd[n].fd = clients[i]->c_fd;
+            pfd[n].events = POLLIN;
+            who[n] = clients[i];
+            kind[n++] = -1;
+        }
+        for (i = 0; i < nsv; i++) {
+            for (j = 0; j < nworkers; j++) {
+                if (!sv[i].s_w[j].w_pid)
+                    continue;
+                pfd[n].fd = sv[i].s_w[j].w_fd;
+                pfd[n].events = POLLIN;
+                who[n] = &sv[i].s_w[j];
+                kind[n++] = i;
+            }
+        }
+        for (i = 0; i < n; i++)
+            pfd[i].revents = 0;
+        if (poll(pfd, n, ttl * 1000 + 1000) < 0 && errno != EINTR) {
+            fprintf(stderr, "%s: poll: %s\n", prog, strerror(errno));
+            break;
+        }
+        for (i = 2; i < n; i++) {
+            if (!pfd[i].revents)
+                continue;
+            if (kind[i] < 0)
+                read_client(who[i], lfd);
+            else
+                read_worker(&sv[kind[i]], who[i], lfd);
+        }
+        if (pfd[1].revents)
+            read_rquota(lfd);
+        if (pfd[0].revents)
+            accept_client(lfd);
+        reap_clients();
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+            ;
+        if (time(NULL) - last > ttl) {
+            last = time(NULL);
+            expire(last);
+        }
+    }
+    unlink(sock_path);
+    if (registered) {
+        pmap_unset(RQUOTAPROG, RQUOTAVERS);
+        pmap_unset(RQUOTABULKPROG, RQUOTABULKVERS);
+    }
+    exit(0);
+}
+
+static void
+sig_handler(int sig)
+{
+    done = 1;
+}
+
+static void 
+usage(void)
+{
+    fprintf(stderr, 
+  "Usage: %s [--options]\n"
+  "  -f,--config            use the specified quota.conf file\n"
+  "  -s,--socket            listen on path (default %s)\n"
+  "  -t,--ttl               seconds to serve a result from cache (default %d)\n"
+  "  -w,--workers           worker processes per server (default %d)\n"
+  "  -u,--udp               also serve the rquota protocol on UDP port\n"
+  "  -F,--foreground        do not detach from the terminal\n"
+      , prog, _PATH_QUOTAD_SOCKET, TTL_DEFAULT, WORKERS_DEFAULT);
+    exit(1);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
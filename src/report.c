@@ -0,0 +1,586 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * User-defined repquota report rows.
+ *
+ * A template such as "%-10name %-11bytes %pct" is compiled once into a
+ * list of emit operations: literal text, and fields with an optional
+ * printf-style width ("-" to left-justify).  Each row is produced by
+ * walking that list.  "%%" is a literal percent sign, and a field name
+ * may be written as %{name} to separate it from following text.
+ *
+ * For machine consumption, rows may instead be emitted as newline
+ * delimited JSON objects or RFC 4180 CSV records, with raw 64-bit byte
+ * and file counts rather than blocksize or human readable units.
+ *
+ * A delta report (REPORT_DELTA) also has the change in usage since a
+ * previous sweep: the %bdelta and %fdelta fields, or the bytes_delta and
+ * files_delta JSON/CSV columns.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "util.h"
+#include "outbuf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "report.h"
+
+extern char *prog;
+
+typedef enum {
+    F_TEXT,
+    F_UID, F_NAME,
+    F_BYTES, F_BSOFT, F_BHARD, F_BGRACE, F_BSTATE, F_BPCT,
+    F_FILES, F_FSOFT, F_FHARD, F_FGRACE, F_FSTATE, F_FPCT,
+    F_BDELTA, F_FDELTA,
+} field_t;
+
+static struct {
+    char       *name;
+    field_t     type;
+    char       *title;
+} fields[] = {
+    { "uid",    F_UID,      "Uid" },
+    { "name",   F_NAME,     "User" },
+    { "bytes",  F_BYTES,    "Space-used" },
+    { "bsoft",  F_BSOFT,    "Space-soft" },
+    { "bhard",  F_BHARD,    "Space-hard" },
+    { "bgrace", F_BGRACE,   "Space-grace" },
+    { "bstate", F_BSTATE,   "Space-state" },
+    { "pct",    F_BPCT,     "Space-pct" },
+    { "files",  F_FILES,    "Files-used" },
+    { "fsoft",  F_FSOFT,    "Files-soft" },
+    { "fhard",  F_FHARD,    "Files-hard" },
+    { "fgrace", F_FGRACE,   "Files-grace" },
+    { "fstate", F_FSTATE,   "Files-state" },
+    { "fpct",   F_FPCT,     "Files-pct" },
+    { "bdelta", F_BDELTA,   "Space-delta" },
+    { "fdelta", F_FDELTA,   "Files-delta" },
+    { NULL,     0,          NULL },
+};
+
+struct op {
+    field_t     op_type;
+    int         op_width;       /* outbuf width: < 0 right-justifies */
+    char       *op_text;        /* F_TEXT: literal text */
+    int         op_len;         /* F_TEXT: length of op_text */
+    char       *op_title;       /* heading */
+};
+
+typedef enum { KIND_TEXT, KIND_JSON, KIND_CSV } kind_t;
+
+#define REPORT_MAGIC 0x4e9e0417
+struct report_struct {
+    int             r_magic;
+    kind_t          r_kind;
+    outbuf_t        r_ob;
+    unsigned long   r_bsize;
+    int             r_flags;
+    struct op      *r_ops;
+    int             r_nops;
+    char           *r_text;     /* storage for literal text */
+};
+
+/* Parse a field name at *sp, advancing past it.  Return the index
+ * into fields[], or -1 if not recognized.
+ */
+static int
+parse_field(char **sp)
+{
+    char *s = *sp;
+    int brace = 0;
+    int i, len = 0;
+
+    if (*s == '{') {
+        brace = 1;
+        s++;
+    }
+    while (islower(s[len]))
+        len++;
+    if (brace && s[len] != '}')
+        return -1;
+    for (i = 0; fields[i].name != NULL; i++) {
+        if (strlen(fields[i].name) == len && !strncmp(s, fields[i].name, len))
+            break;
+    }
+    if (fields[i].name == NULL)
+        return -1;
+    *sp = s + len + brace;
+    return i;
+}
+
+report_t
+report_create(outbuf_t ob, char *template, unsigned long bsize, int flags)
+{
+    report_t r = xmalloc(sizeof(struct report_struct));
+    char *s = template;
+    char *text;
+    struct op *op = NULL;
+    int i, left, width;
+
+    r->r_magic = REPORT_MAGIC;
+    r->r_kind = KIND_TEXT;
+    r->r_ob = ob;
+    r->r_bsize = bsize;
+    r->r_flags = flags;
+    r->r_ops = xmalloc((strlen(template) + 1) * sizeof(struct op));
+    r->r_nops = 0;
+    r->r_text = text = xmalloc(strlen(template) + 1);
+
+    while (*s) {
+        if (s[0] != '%' || s[1] == '%') {
+            if (!op || op->op_type != F_TEXT) {
+                op = &r->r_ops[r->r_nops++];
+                op->op_type = F_TEXT;
+                op->op_width = 0;
+                op->op_text = text;
+                op->op_len = 0;
+                op->op_title = NULL;
+            }
+            *text++ = *s;
+            op->op_len++;
+            s += (s[0] == '%') ? 2 : 1;
+            continue;
+        }
+        s++;
+        left = 0;
+        if (*s == '-') {
+            left = 1;
+            s++;
+        }
+        width = 0;
+        while (isdigit(*s) && width < 1000)
+            width = width * 10 + (*s++ - '0');
+        if ((i = parse_field(&s)) < 0) {
+            fprintf(stderr, "%s: format: unknown field at '%%%s'\n", prog, s);
+            report_destroy(r);
+            return NULL;
+        }
+        if ((fields[i].type == F_BDELTA || fields[i].type == F_FDELTA)
+                                        && !(flags & REPORT_DELTA)) {
+            fprintf(stderr, "%s: format: %%%s is only valid in a delta report\n",
+                    prog, fields[i].name);
+            report_destroy(r);
+            return NULL;
+        }
+        op = &r->r_ops[r->r_nops++];
+        op->op_type = fields[i].type;
+        op->op_width = left ? width : -width;
+        op->op_text = NULL;
+        op->op_len = 0;
+        op->op_title = fields[i].title;
+    }
+    return r;
+}
+
+static report_t
+create_raw(outbuf_t ob, kind_t kind, int flags)
+{
+    report_t r = xmalloc(sizeof(struct report_struct));
+
+    r->r_magic = REPORT_MAGIC;
+    r->r_kind = kind;
+    r->r_ob = ob;
+    r->r_bsize = 1;
+    r->r_flags = flags & REPORT_DELTA;
+    r->r_ops = NULL;
+    r->r_nops = 0;
+    r->r_text = NULL;
+
+    return r;
+}
+
+report_t
+report_create_json(outbuf_t ob, int flags)
+{
+    return create_raw(ob, KIND_JSON, flags);
+}
+
+report_t
+report_create_csv(outbuf_t ob, int flags)
+{
+    return create_raw(ob, KIND_CSV, flags);
+}
+
+void
+report_destroy(report_t r)
+{
+    assert(r->r_magic == REPORT_MAGIC);
+    r->r_magic = 0;
+    if (r->r_ops)
+        free(r->r_ops);
+    if (r->r_text)
+        free(r->r_text);
+    free(r);
+}
+
+/* Column names for CSV heading and JSON keys.
+ */
+static const char *raw_names[] = {
+    "fs", "uid", "name",
+    "bytes_used", "bytes_softlim", "bytes_hardlim",
+    "bytes_secleft", "bytes_state",
+    "files_used", "files_softlim", "files_hardlim",
+    "files_secleft", "files_state",
+    "bytes_delta", "files_delta",           /* REPORT_DELTA only */
+    NULL
+};
+#define RAW_NDELTA  13                      /* index of first delta column */
+
+void
+report_heading(report_t r)
+{
+    struct op *op;
+    int i;
+
+    assert(r->r_magic == REPORT_MAGIC);
+    if (r->r_kind == KIND_JSON)
+        return;
+    if (r->r_kind == KIND_CSV) {
+        for (i = 0; raw_names[i] != NULL; i++) {
+            if (i == RAW_NDELTA && !(r->r_flags & REPORT_DELTA))
+                break;
+            if (i > 0)
+                outbuf_putc(r->r_ob, ',');
+            outbuf_putstr(r->r_ob, raw_names[i], 0);
+        }
+        outbuf_write(r->r_ob, "\r\n", 2);
+        return;
+    }
+    for (i = 0; i < r->r_nops; i++) {
+        op = &r->r_ops[i];
+        if (op->op_type == F_TEXT)
+            outbuf_write(r->r_ob, op->op_text, op->op_len);
+        else
+            outbuf_putstr(r->r_ob, op->op_title, op->op_width);
+    }
+    outbuf_putc(r->r_ob, '\n');
+}
+
+/* helper for report_row() - space used/limit in bsize or human units */
+static inline void
+put_space(report_t r, unsigned long long val, int width)
+{
+    if ((r->r_flags & REPORT_HUMAN))
+        outbuf_putsize(r->r_ob, val, width);
+    else
+        outbuf_putull(r->r_ob, val / r->r_bsize, width);
+}
+
+/* helper for report_row() - integer percentage of hard limit, if any,
+ * clamped to ULLONG_MAX */
+static inline void
+put_pct(report_t r, unsigned long long used, unsigned long long hard,
+        int width)
+{
+    long double pct;
+
+    if (hard == 0)
+        outbuf_putstr(r->r_ob, "-", width);
+    else if (used <= ULLONG_MAX / 100)
+        outbuf_putull(r->r_ob, used * 100 / hard, width);
+    else {
+        pct = (long double)used * 100 / hard;
+        outbuf_putull(r->r_ob, pct < (long double)ULLONG_MAX
+                               ? (unsigned long long)pct : ULLONG_MAX, width);
+    }
+}
+
+/* helper for report_row() - signed change, with a '+' on growth if plus */
+static inline void
+put_delta(outbuf_t ob, long long val, int plus, int width)
+{
+    char buf[24];
+
+    snprintf(buf, sizeof(buf), plus && val > 0 ? "+%lld" : "%lld", val);
+    outbuf_putstr(ob, buf, width);
+}
+
+/* helper for report_row() - change in space in bsize or human units */
+static inline void
+put_space_delta(report_t r, long long val, int width)
+{
+    unsigned long long mag = val < 0 ? -(unsigned long long)val : val;
+    char buf[24];
+
+    if ((r->r_flags & REPORT_HUMAN) && mag > 0) {
+        buf[0] = val < 0 ? '-' : '+';
+        size2buf(mag, buf + 1);
+        outbuf_putstr(r->r_ob, buf, width);
+    } else if ((r->r_flags & REPORT_HUMAN))
+        outbuf_putstr(r->r_ob, "0", width);
+    else
+        put_delta(r->r_ob, val / (long long)r->r_bsize, 1, width);
+}
+
+/* helper for report_row() - seconds left in grace period, if started */
+static inline void
+put_grace(report_t r, qstate_t state, unsigned long long secleft, int width)
+{
+    outbuf_putull(r->r_ob, state == STARTED ? secleft : 0, width);
+}
+
+/* helper for row_json() - JSON string with required escapes */
+static void
+put_json_string(outbuf_t ob, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *p;
+
+    outbuf_putc(ob, '"');
+    for (p = s; *p; p++) {
+        unsigned char c = *p;
+
+        if (c == '"' || c == '\\') {
+            outbuf_putc(ob, '\\');
+            outbuf_putc(ob, c);
+        } else if (c < 0x20) {
+            outbuf_write(ob, "\\u00", 4);
+            outbuf_putc(ob, hex[c >> 4]);
+            outbuf_putc(ob, hex[c & 0xf]);
+        } else
+            outbuf_putc(ob, c);
+    }
+    outbuf_putc(ob, '"');
+}
+
+/* helper for row_csv() - field, quoted if it contains special characters */
+static void
+put_csv_string(outbuf_t ob, const char *s)
+{
+    const char *p;
+
+    if (!strpbrk(s, ",\"\r\n")) {
+        outbuf_putstr(ob, s, 0);
+        return;
+    }
+    outbuf_putc(ob, '"');
+    for (p = s; *p; p++) {
+        if (*p == '"')
+            outbuf_putc(ob, '"');
+        outbuf_putc(ob, *p);
+    }
+    outbuf_putc(ob, '"');
+}
+
+/* helper for row_json() - "key":value pair */
+static inline void
+put_json_ull(outbuf_t ob, int i, unsigned long long val)
+{
+    outbuf_putc(ob, ',');
+    put_json_string(ob, raw_names[i]);
+    outbuf_putc(ob, ':');
+    outbuf_putull(ob, val, 0);
+}
+
+static void
+row_json(quota_t q, long long dbytes, long long dfiles, report_t r)
+{
+    outbuf_t ob = r->r_ob;
+
+    outbuf_putc(ob, '{');
+    put_json_string(ob, raw_names[0]);
+    outbuf_putc(ob, ':');
+    put_json_string(ob, q->q_label);
+    put_json_ull(ob, 1, q->q_uid);
+    outbuf_putc(ob, ',');
+    put_json_string(ob, raw_names[2]);
+    outbuf_putc(ob, ':');
+    if (q->q_name)
+        put_json_string(ob, q->q_name);
+    else
+        outbuf_putstr(ob, "null", 0);
+    put_json_ull(ob, 3, q->q_bytes_used);
+    put_json_ull(ob, 4, q->q_bytes_softlim);
+    put_json_ull(ob, 5, q->q_bytes_hardlim);
+    put_json_ull(ob, 6, q->q_bytes_state == STARTED ? q->q_bytes_secleft : 0);
+    outbuf_putc(ob, ',');
+    put_json_string(ob, raw_names[7]);
+    outbuf_putc(ob, ':');
+    put_json_string(ob, qstate_str(q->q_bytes_state));
+    put_json_ull(ob, 8, q->q_files_used);
+    put_json_ull(ob, 9, q->q_files_softlim);
+    put_json_ull(ob, 10, q->q_files_hardlim);
+    put_json_ull(ob, 11, q->q_files_state == STARTED ? q->q_files_secleft : 0);
+    outbuf_putc(ob, ',');
+    put_json_string(ob, raw_names[12]);
+    outbuf_putc(ob, ':');
+    put_json_string(ob, qstate_str(q->q_files_state));
+    if ((r->r_flags & REPORT_DELTA)) {
+        outbuf_putc(ob, ',');
+        put_json_string(ob, raw_names[13]);
+        outbuf_putc(ob, ':');
+        put_delta(ob, dbytes, 0, 0);
+        outbuf_putc(ob, ',');
+        put_json_string(ob, raw_names[14]);
+        outbuf_putc(ob, ':');
+        put_delta(ob, dfiles, 0, 0);
+    }
+    outbuf_write(ob, "}\n", 2);
+}
+
+static void
+row_csv(quota_t q, long long dbytes, long long dfiles, report_t r)
+{
+    outbuf_t ob = r->r_ob;
+
+    put_csv_string(ob, q->q_label);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_uid, 0);
+    outbuf_putc(ob, ',');
+    put_csv_string(ob, q->q_name ? q->q_name : "");
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_bytes_used, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_bytes_softlim, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_bytes_hardlim, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_bytes_state == STARTED ? q->q_bytes_secleft : 0, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putstr(ob, qstate_str(q->q_bytes_state), 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_files_used, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_files_softlim, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_files_hardlim, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putull(ob, q->q_files_state == STARTED ? q->q_files_secleft : 0, 0);
+    outbuf_putc(ob, ',');
+    outbuf_putstr(ob, qstate_str(q->q_files_state), 0);
+    if ((r->r_flags & REPORT_DELTA)) {
+        outbuf_putc(ob, ',');
+        put_delta(ob, dbytes, 0, 0);
+        outbuf_putc(ob, ',');
+        put_delta(ob, dfiles, 0, 0);
+    }
+    outbuf_write(ob, "\r\n", 2);
+}
+
+/* Report q, with usage changes dbytes and dfiles in a delta report.
+ */
+int
+report_row_delta(quota_t q, long long dbytes, long long dfiles, report_t r)
+{
+    outbuf_t ob = r->r_ob;
+    struct op *op;
+    int i;
+
+    assert(q->q_magic == QUOTA_MAGIC);
+    assert(r->r_magic == REPORT_MAGIC);
+    if (r->r_kind == KIND_JSON) {
+        row_json(q, dbytes, dfiles, r);
+        return 0;
+    }
+    if (r->r_kind == KIND_CSV) {
+        row_csv(q, dbytes, dfiles, r);
+        return 0;
+    }
+    for (i = 0; i < r->r_nops; i++) {
+        op = &r->r_ops[i];
+        switch (op->op_type) {
+            case F_TEXT:
+                outbuf_write(ob, op->op_text, op->op_len);
+                break;
+            case F_UID:
+                outbuf_putull(ob, q->q_uid, op->op_width);
+                break;
+            case F_NAME:
+                if (q->q_name)
+                    outbuf_putstr(ob, q->q_name, op->op_width);
+                else
+                    outbuf_putull(ob, q->q_uid, op->op_width);
+                break;
+            case F_BYTES:
+                put_space(r, q->q_bytes_used, op->op_width);
+                break;
+            case F_BSOFT:
+                put_space(r, q->q_bytes_softlim, op->op_width);
+                break;
+            case F_BHARD:
+                put_space(r, q->q_bytes_hardlim, op->op_width);
+                break;
+            case F_BGRACE:
+                put_grace(r, q->q_bytes_state, q->q_bytes_secleft,
+                          op->op_width);
+                break;
+            case F_BSTATE:
+                outbuf_putstr(ob, qstate_str(q->q_bytes_state), op->op_width);
+                break;
+            case F_BPCT:
+                put_pct(r, q->q_bytes_used, q->q_bytes_hardlim, op->op_width);
+                break;
+            case F_FILES:
+                outbuf_putull(ob, q->q_files_used, op->op_width);
+                break;
+            case F_FSOFT:
+                outbuf_putull(ob, q->q_files_softlim, op->op_width);
+                break;
+            case F_FHARD:
+                outbuf_putull(ob, q->q_files_hardlim, op->op_width);
+                break;
+            case F_FGRACE:
+                put_grace(r, q->q_files_state, q->q_files_secleft,
+                          op->op_width);
+                break;
+            case F_FSTATE:
+                outbuf_putstr(ob, qstate_str(q->q_files_state), op->op_width);
+                break;
+            case F_FPCT:
+                put_pct(r, q->q_files_used, q->q_files_hardlim, op->op_width);
+                break;
+            case F_BDELTA:
+                put_space_delta(r, dbytes, op->op_width);
+                break;
+            case F_FDELTA:
+                put_delta(ob, dfiles, 1, op->op_width);
+                break;
+        }
+    }
+    outbuf_putc(ob, '\n');
+    return 0;
+}
+
+int
+report_row(quota_t q, report_t r)
+{
+    return report_row_delta(q, 0, 0, r);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
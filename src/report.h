@@ -0,0 +1,49 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+typedef struct report_struct *report_t;
+
+#define REPORT_HUMAN    1   /* show space in human readable units */
+#define REPORT_DELTA    2   /* rows have changes since a previous sweep */
+
+#define REPORT_DEFAULT \
+    "%-10name %-11bytes %-11bsoft %-11bhard %-12files %-12fsoft %-12fhard"
+#define REPORT_USAGEONLY \
+    "%-10name %-11bytes %-12files"
+#define REPORT_DELTADEFAULT \
+    "%-10name %-11bytes %-12bdelta %-12files %-12fdelta"
+
+report_t report_create(outbuf_t ob, char *template, unsigned long bsize,
+                       int flags);
+report_t report_create_json(outbuf_t ob, int flags);
+report_t report_create_csv(outbuf_t ob, int flags);
+void     report_destroy(report_t r);
+void     report_heading(report_t r);
+int      report_row(quota_t q, report_t r);
+int      report_row_delta(quota_t q, long long dbytes, long long dfiles,
+                          report_t r);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
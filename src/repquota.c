@@ -42,23 +42,187 @@
 #include <dirent.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <stdint.h>
 
 #include "list.h"
 #include "getconf.h"
+#include "outbuf.h"
 #include "getquota.h"
+#include "qstate.h"
+#include "report.h"
 #include "listint.h"
+#include "uidset.h"
+#include "snapshot.h"
+#include "delta.h"
+#include "history.h"
+#include "summary.h"
+#include "groupby.h"
+#include "filter.h"
+#include "srvstat.h"
+#include "fetch.h"
+#include "merge.h"
+#include "work.h"
 #include "util.h"
 
+/* A partition of the uid's to be queried, so that a sweep can be split
+ * between independent runs on several nodes.
+ */
+struct shard {
+    int         s_index;    /* this shard, 0 .. s_count-1 */
+    int         s_count;    /* number of shards, 0 if not sharded */
+    int         s_range;    /* by range of the -u list rather than hash */
+    uid_t       s_lo;       /* s_range: uid's in this shard */
+    uid_t       s_hi;
+};
+
+/* Progress of a sweep, saved periodically so that an interrupted sweep
+ * can be resumed.  The records so far are saved as a snapshot, and the
+ * position in the uid source beside it in path.pos.
+ */
+struct checkpoint {
+    char       *c_path;
+    const char *c_scan;     /* uid source: "uid", "pw" or "dir" */
+    int         c_interval; /* seconds between checkpoints */
+    time_t      c_start;    /* time the sweep started */
+    time_t      c_last;     /* time of the last checkpoint */
+    long        c_pos;      /* entries of the uid source consumed */
+    long        c_skip;     /* entries consumed before a resume */
+};
+
+/* State shared by the scans.
+ */
+struct sweep {
+    confent_t  *conf;
+    quota_fs_t  fs;         /* query context for conf, made on first use */
+    uid_t      *b_uid;      /* uid's waiting for quota_get_many() */
+    char      **b_name;     /* their known user names, or NULL */
+    char      **b_tag;      /* their "[tag]", or NULL */
+    int         b_n;
+    uidset_t    seen;       /* uid's already queried */
+    List        qlist;      /* results, or NULL if streaming to report */
+    report_t    report;     /* report for streamed results */
+    summary_t   summary;    /* summary for streamed results, or NULL */
+    groupby_t   groupby;    /* per-group totals of streamed results, or NULL */
+    struct qfilter filter;  /* records that fail are dropped */
+    int         getusername;/* look up user names of records kept */
+    struct multi *multi;    /* collect uid's for fetch_all(), or NULL */
+    struct shard shard;     /* only query uid's in this shard */
+    struct checkpoint *ckpt;/* save progress of the scan, or NULL */
+};
+
+/* State for a report on several file systems.  The scan collects the
+ * uid's once, then they are queried on all of the file systems at once.
+ */
+struct multi {
+    confent_t **conf;       /* file systems in report order */
+    int         nconf;
+    uid_t      *uid;        /* uid's to query */
+    char      **name;       /* known user name, or NULL */
+    char      **tag;        /* "[tag]" is shown if no user name */
+    int         nuid;
+    int         size;       /* allocated length of uid, name, tag */
+    quota_t    *q;          /* q[uid index * nconf + fs index], or NULL */
+};
+
+/* Command line options.
+ */
+struct opts {
+    int         dirscan;
+    int         pwscan;
+    unsigned long bsize;
+    List        uids;       /* -u list, or NULL */
+    int         reverse;
+    int         spacesort;
+    int         filessort;
+    int         usageonly;
+    int         noheading;
+    int         nouserlookup;
+    int         human;
+    char       *confpath;
+    char       *format;
+    char       *output;
+    char       *snapfile;   /* snapshot to write */
+    List        fromsnap;   /* snapshots to report from, or NULL */
+    char       *compare;    /* snapshot to compare with */
+    unsigned long mindelta;
+    char       *archive;    /* history archive to append to */
+    char       *history;    /* history archive to report from */
+    int         summary;
+    char       *groupkey;
+    struct qfilter filter;
+    int         all;
+    int         join;
+    char       *shardspec;
+    char       *workdir;
+    int         chunk;
+    int         work;
+    int         lease;
+    struct checkpoint ckpt;
+    int         resume;
+    int         interval;   /* -I was given */
+    struct fetch_opts fopts;
+    char       *statsfile;
+    int         parallel;   /* query through fetch_all() */
+};
+
 static void usage(void);
-static void add_quota(confent_t *cp, List qlist, uid_t uid, char *name);
-static void dirscan(confent_t *conf, List qlist, List uids, int getusername);
-static void pwscan(confent_t *conf, List qlist, List uids, int getusername);
-static void uidscan(confent_t *conf, List qlist, List uids, int getusername);
+static void parse_opts(int argc, char *argv[], struct opts *o);
+static void check_opts(struct opts *o, int nfs);
+static void work_mode(struct opts *o, char *fsname);
+static void multi_report(struct opts *o, struct shard *shard, int nfs,
+                         char **fsnames);
+static void split_sweep(struct opts *o, struct shard *shard, char *fsname);
+static void fs_report(struct opts *o, struct shard *shard, char *fsname);
+static void add_result(struct sweep *sw, quota_t q);
+static void add_quota(struct sweep *sw, uid_t uid, char *name,
+                      const char *tag);
+static void flush_quotas(struct sweep *sw);
+static void sweep_fini(struct sweep *sw);
+static char *user_name(uid_t uid, char *name, const char *tag, char *buf,
+                       int len);
+static void sort_results(List qlist, int sopt, int Fopt, int ropt);
+static void put_space(outbuf_t ob, unsigned long long val,
+                      unsigned long bsize, int hopt, int width);
+static void put_title(outbuf_t ob, const char *what, const char *fsname,
+                      unsigned long bsize, int hopt);
+static void multi_scan(struct multi *m, List uids, struct shard *shard,
+                       int popt, int dopt);
+static void multi_add(struct multi *m, uid_t uid, char *name,
+                      const char *tag);
+static void multi_result(int fs, int idx, quota_t q, struct multi *m);
+static void multi_sections(struct multi *m, outbuf_t ob, report_t report,
+                           unsigned long bsize, int hopt, int Hopt,
+                           int sopt, int Fopt, int ropt, int getusername);
+static void multi_join(struct multi *m, outbuf_t ob, unsigned long bsize,
+                       int hopt, int Hopt, int sopt, int Fopt, int ropt,
+                       int getusername);
+static void fetchscan(struct sweep *sw, List uids, int popt, int dopt,
+                      struct fetch_opts *opts);
+static void dirscan(struct sweep *sw, List uids);
+static void pwscan(struct sweep *sw, List uids);
+static void uidscan(struct sweep *sw, List uids);
+static void snapscan(struct sweep *sw, snap_t snap, List uids);
+static void mergescan(struct sweep *sw, snap_t *snaps, int nsnap, List uids,
+                      int order, int reverse);
+static int parse_shard(char *s, struct shard *sh, List uids);
+static int ckpt_next(struct sweep *sw);
+static int ckpt_resume(struct sweep *sw);
+static void ckpt_remove(struct checkpoint *ck);
+static void work_sweep(char *dir, confent_t *cp, int lease, int getusername);
+static int work_renew(char *dir, char *name, int lease, time_t *touched);
+static int shard_member(struct shard *sh, uid_t uid);
+static void history_report(char *path, char *fsname, List uids,
+                           unsigned long bsize, int hopt, int Hopt);
 
 char *prog;
 int debug = 0;
 
-#define OPTIONS "u:b:dHrsFf:UpTDnh"
+#define OUTBUF_SIZE (256*1024)
+#define CKPT_INTERVAL 60        /* default seconds between checkpoints */
+#define SWEEP_BATCH 800         /* uid's queried at once by a scan */
+
+#define OPTIONS "u:b:dHrsFf:UpTDnho:O:w:S:c:m:a:y:zg:EP:t:M:NAjk:W:C:Xe:K:RI:Q:l:Y:"
 #if HAVE_GETOPT_LONG
 #define GETOPT(ac,av,opt,lopt) getopt_long(ac,av,opt,lopt,NULL)
 static const struct option longopts[] = {
@@ -76,72 +240,166 @@ static const struct option longopts[] = {
     {"debug",            no_argument,        0, 'D'},
     {"nouserlookup",     no_argument,        0, 'n'},
     {"human-readable",   no_argument,        0, 'h'},
+    {"format",           required_argument,  0, 'o'},
+    {"output",           required_argument,  0, 'O'},
+    {"write-snapshot",   required_argument,  0, 'w'},
+    {"from-snapshot",    required_argument,  0, 'S'},
+    {"compare",          required_argument,  0, 'c'},
+    {"min-delta",        required_argument,  0, 'm'},
+    {"append-history",   required_argument,  0, 'a'},
+    {"history",          required_argument,  0, 'y'},
+    {"summary",          no_argument,        0, 'z'},
+    {"group-by",         required_argument,  0, 'g'},
+    {"over-soft",        no_argument,        0, 'E'},
+    {"over-pct",         required_argument,  0, 'P'},
+    {"state",            required_argument,  0, 't'},
+    {"min-bytes",        required_argument,  0, 'M'},
+    {"nonzero",          no_argument,        0, 'N'},
+    {"all",              no_argument,        0, 'A'},
+    {"join",             no_argument,        0, 'j'},
+    {"shard",            required_argument,  0, 'k'},
+    {"workdir",          required_argument,  0, 'W'},
+    {"chunk-size",       required_argument,  0, 'C'},
+    {"work",             no_argument,        0, 'X'},
+    {"lease",            required_argument,  0, 'e'},
+    {"checkpoint",       required_argument,  0, 'K'},
+    {"resume",           no_argument,        0, 'R'},
+    {"checkpoint-interval", required_argument, 0, 'I'},
+    {"max-inflight",     required_argument,  0, 'Q'},
+    {"rate-limit",       required_argument,  0, 'l'},
+    {"server-stats",     required_argument,  0, 'Y'},
     {0, 0, 0, 0},
 };
 #else
 #define GETOPT(ac,av,opt,lopt) getopt(ac,av,opt)
 #endif
 
-int 
+int
 main(int argc, char *argv[])
 {
-    confent_t *conf;
-    int c;
-    int dopt = 0;
-    int popt = 0;
-    unsigned long bsize = 1024*1024;
-    char *fsname = NULL;
-    List qlist;
-    int Fopt = 0;
-    int ropt = 0;
-    int sopt = 0;
-    int Hopt = 0;
-    int Uopt = 0;
-    int nopt = 0;
-    int hopt = 0;
-    List uids = NULL;
-    char *conf_path = _PATH_QUOTA_CONF;
-    conf_t config;
+    struct opts o;
+    struct shard shard;
+    char *fsname;
+    int i;
 
     prog = basename(argv[0]);
+    parse_opts(argc, argv, &o);
+    argc -= optind;
+    argv += optind;
+    check_opts(&o, argc);
+
+    /* A worker in a shared sweep takes the file system from the work
+     * directory.
+     */
+    if (o.work) {
+        work_mode(&o, argc > 0 ? argv[0] : NULL);
+        exit(0);
+    }
+    if (o.history) {
+        if (argc > 1)
+            usage();
+        history_report(o.history, argc > 0 ? argv[0] : NULL, o.uids,
+                       o.bsize, o.human, o.noheading);
+        if (o.uids)
+            listint_destroy(o.uids);
+        exit(0);
+    }
+    if (!o.fopts.fo_ceiling)
+        o.fopts.fo_ceiling = FETCH_CEILING;
+    if (o.statsfile)
+        o.fopts.fo_stats = srvstat_open(o.statsfile);
+    memset(&shard, 0, sizeof(shard));
+    if (o.shardspec && parse_shard(o.shardspec, &shard, o.uids) < 0)
+        exit(1);
+    if (o.all || o.join || argc > 1) {
+        multi_report(&o, &shard, argc, argv);
+        exit(0);
+    }
+    fsname = argc > 0 ? argv[0] : NULL;
+
+    /* Split a shared sweep into chunks for workers to claim, or without
+     * -C, report on a finished one by merging the results of all of its
+     * chunks.
+     */
+    if (o.workdir && o.chunk) {
+        if (!fsname)
+            usage();
+        split_sweep(&o, &shard, fsname);
+        exit(0);
+    }
+    if (o.workdir) {
+        if ((i = work_pending(o.workdir)) > 0) {
+            fprintf(stderr, "%s: %s: %d chunk%s not done\n", prog, o.workdir,
+                    i, i == 1 ? "" : "s");
+            exit(1);
+        }
+        if (!(o.fromsnap = work_results(o.workdir)))
+            exit(1);
+        if (list_count(o.fromsnap) == 0) {
+            fprintf(stderr, "%s: %s: no results\n", prog, o.workdir);
+            exit(1);
+        }
+    }
+    if (!fsname && !o.fromsnap)
+        usage();
+    fs_report(&o, &shard, fsname);
+    return 0;
+}
+
+/* Parse the command line into o.  On return optind is the index of the
+ * first file system argument.
+ */
+static void
+parse_opts(int argc, char *argv[], struct opts *o)
+{
+    unsigned long minbytes;
+    char *end;
+    int c;
+
+    memset(o, 0, sizeof(*o));
+    o->bsize = 1024*1024;
+    o->confpath = _PATH_QUOTA_CONF;
+    o->output = "text";
+    o->lease = WORK_LEASE;
+    o->ckpt.c_interval = CKPT_INTERVAL;
     while ((c = GETOPT(argc, argv, OPTIONS, longopts)) != EOF) {
         switch(c) {
             case 'd':   /* --dirscan */
-                dopt++;
+                o->dirscan++;
                 break;
             case 'p':   /* --pwscan */
-                popt++;
+                o->pwscan++;
                 break;
             case 'b':   /* --blocksize */
-                if (parse_blocksize(optarg, &bsize)) {
-                    fprintf(stderr, "%s: error parsing blocksize\n", prog); 
+                if (parse_blocksize(optarg, &o->bsize)) {
+                    fprintf(stderr, "%s: error parsing blocksize\n", prog);
                     exit(1);
                 }
                 break;
             case 'u':   /* --uid-range */
-                uids = listint_create(optarg);
-                if (uids == NULL) {
+                o->uids = listint_create(optarg);
+                if (o->uids == NULL) {
                     fprintf(stderr, "%s: error parsing uid-range\n", prog);
                     exit(1);
                 }
                 break;
             case 'r':   /* --reverse */
-                ropt++;
+                o->reverse++;
                 break;
             case 'F':   /* --files-sort */
-                Fopt++;
+                o->filessort++;
                 break;
             case 's':   /* --space-sort */
-                sopt++;
+                o->spacesort++;
                 break;
             case 'U':   /* --usage-only */
-                Uopt++;
+                o->usageonly++;
                 break;
             case 'H':   /* --suppress-heading */
-                Hopt++;
+                o->noheading++;
                 break;
             case 'f':   /* --config */
-                conf_path = optarg;
+                o->confpath = optarg;
                 break;
             case 'T':   /* --selftest */
 #ifndef NDEBUG
@@ -156,104 +414,706 @@ main(int argc, char *argv[])
                 debug = 1;
                 break;
             case 'n':   /* --nouserlookup */
-                nopt = 1;
+                o->nouserlookup = 1;
                 break;
             case 'h':   /* --human-readable */
-                hopt = 1;
+                o->human = 1;
+                break;
+            case 'o':   /* --format */
+                o->format = optarg;
+                break;
+            case 'O':   /* --output */
+                o->output = optarg;
+                break;
+            case 'w':   /* --write-snapshot */
+                o->snapfile = optarg;
+                break;
+            case 'S':   /* --from-snapshot */
+                if (!o->fromsnap)
+                    o->fromsnap = list_create(NULL);
+                list_append(o->fromsnap, optarg);
+                break;
+            case 'c':   /* --compare */
+                o->compare = optarg;
+                break;
+            case 'm':   /* --min-delta */
+                if (parse_blocksize(optarg, &o->mindelta)) {
+                    fprintf(stderr, "%s: error parsing min-delta\n", prog);
+                    exit(1);
+                }
+                break;
+            case 'a':   /* --append-history */
+                o->archive = optarg;
+                break;
+            case 'y':   /* --history */
+                o->history = optarg;
+                break;
+            case 'z':   /* --summary */
+                o->summary++;
+                break;
+            case 'g':   /* --group-by */
+                o->groupkey = optarg;
+                break;
+            case 'E':   /* --over-soft */
+                o->filter.f_oversoft = 1;
+                break;
+            case 'P':   /* --over-pct */
+                o->filter.f_overpct = strtoul(optarg, &end, 10);
+                if (*end != '\0' || o->filter.f_overpct <= 0) {
+                    fprintf(stderr, "%s: error parsing over-pct\n", prog);
+                    exit(1);
+                }
+                break;
+            case 't':   /* --state */
+                if (qfilter_parse_state(optarg, &o->filter.f_state) < 0) {
+                    fprintf(stderr, "%s: unknown state: %s\n", prog, optarg);
+                    exit(1);
+                }
+                o->filter.f_hasstate = 1;
+                break;
+            case 'M':   /* --min-bytes */
+                if (parse_blocksize(optarg, &minbytes)) {
+                    fprintf(stderr, "%s: error parsing min-bytes\n", prog);
+                    exit(1);
+                }
+                o->filter.f_minbytes = minbytes;
+                break;
+            case 'N':   /* --nonzero */
+                o->filter.f_nonzero = 1;
+                break;
+            case 'A':   /* --all */
+                o->all++;
+                break;
+            case 'j':   /* --join */
+                o->join++;
+                break;
+            case 'k':   /* --shard */
+                o->shardspec = optarg;
+                break;
+            case 'W':   /* --workdir */
+                o->workdir = optarg;
+                break;
+            case 'C':   /* --chunk-size */
+                o->chunk = strtoul(optarg, &end, 10);
+                if (*end != '\0' || o->chunk <= 0) {
+                    fprintf(stderr, "%s: error parsing chunk-size\n", prog);
+                    exit(1);
+                }
+                break;
+            case 'X':   /* --work */
+                o->work++;
+                break;
+            case 'e':   /* --lease */
+                o->lease = strtoul(optarg, &end, 10);
+                if (*end != '\0' || o->lease <= 0) {
+                    fprintf(stderr, "%s: error parsing lease\n", prog);
+                    exit(1);
+                }
+                break;
+            case 'K':   /* --checkpoint */
+                o->ckpt.c_path = optarg;
+                break;
+            case 'R':   /* --resume */
+                o->resume++;
+                break;
+            case 'I':   /* --checkpoint-interval */
+                o->ckpt.c_interval = strtoul(optarg, &end, 10);
+                if (*end != '\0' || o->ckpt.c_interval < 0) {
+                    fprintf(stderr, "%s: error parsing checkpoint-interval\n",
+                            prog);
+                    exit(1);
+                }
+                o->interval++;
+                break;
+            case 'Q':   /* --max-inflight */
+                o->fopts.fo_ceiling = strtoul(optarg, &end, 10);
+                if (*end != '\0' || o->fopts.fo_ceiling <= 0) {
+                    fprintf(stderr, "%s: error parsing max-inflight\n", prog);
+                    exit(1);
+                }
+                break;
+            case 'l':   /* --rate-limit */
+                o->fopts.fo_rate = strtod(optarg, &end);
+                if (*end != '\0' || o->fopts.fo_rate <= 0) {
+                    fprintf(stderr, "%s: error parsing rate-limit\n", prog);
+                    exit(1);
+                }
+                break;
+            case 'Y':   /* --server-stats */
+                o->statsfile = optarg;
                 break;
             default:
                 usage();
         }
     }
-    if (Fopt && sopt) {
-        fprintf(stderr, "%s: -f and -s are mutually exclusive\n", prog);
+    o->parallel = o->fopts.fo_ceiling || o->fopts.fo_rate > 0 || o->statsfile;
+}
+
+/* helpers for check_opts() - exit if option a was given with option b,
+ * or without it */
+static void
+conflict(int a_set, const char *a, int b_set, const char *b)
+{
+    if (a_set && b_set) {
+        fprintf(stderr, "%s: --%s cannot be used with --%s\n", prog, a, b);
+        exit(1);
+    }
+}
+
+static void
+requires(int a_set, const char *a, int b_set, const char *b)
+{
+    if (a_set && !b_set) {
+        fprintf(stderr, "%s: --%s requires --%s\n", prog, a, b);
         exit(1);
     }
-    if (popt && dopt) {
-        fprintf(stderr, "%s: -p and -d are mutually exclusive\n", prog);
+}
+
+/* helper for check_opts() - exit if option a was given with more than
+ * one file system */
+static void
+one_fs(int a_set, const char *a, int multi)
+{
+    if (a_set && multi) {
+        fprintf(stderr, "%s: --%s cannot be used with more than one "
+                "file system\n", prog, a);
         exit(1);
     }
-    if (!popt && !dopt && !uids) {
-        fprintf(stderr, "%s: need at least one of -pdu\n", prog);
+}
+
+/* Exit with an error if the options in o, with nfs file systems named,
+ * cannot be used together.
+ */
+static void
+check_opts(struct opts *o, int nfs)
+{
+    int notext = strcmp(o->output, "text") != 0;
+    int merge = o->workdir && !o->chunk && !o->work;
+    int multi = o->all || o->join || nfs > 1;
+    struct qfilter *f = &o->filter;
+
+    conflict(o->filessort, "files-sort", o->spacesort, "space-sort");
+    conflict(o->format != NULL, "format", o->usageonly, "usage-only");
+    conflict(notext, "output", o->format != NULL, "format");
+    conflict(notext, "output", o->usageonly, "usage-only");
+    conflict(notext, "output", o->human, "human-readable");
+    conflict(o->pwscan, "pwscan", o->dirscan, "dirscan");
+
+    /* shared sweeps */
+    requires(o->chunk, "chunk-size", o->workdir != NULL, "workdir");
+    requires(o->work, "work", o->workdir != NULL, "workdir");
+    conflict(o->chunk, "chunk-size", o->work, "work");
+    conflict(o->workdir != NULL, "workdir", o->fromsnap != NULL,
+             "from-snapshot");
+    conflict(o->workdir != NULL, "workdir", o->snapfile != NULL,
+             "write-snapshot");
+    one_fs(o->workdir != NULL, "workdir", multi);
+
+    /* checkpoints */
+    requires(o->resume, "resume", o->ckpt.c_path != NULL, "checkpoint");
+    requires(o->interval, "checkpoint-interval", o->ckpt.c_path != NULL,
+             "checkpoint");
+    conflict(o->ckpt.c_path != NULL, "checkpoint", o->fromsnap != NULL,
+             "from-snapshot");
+    conflict(o->ckpt.c_path != NULL, "checkpoint", o->workdir != NULL,
+             "workdir");
+    one_fs(o->ckpt.c_path != NULL, "checkpoint", multi);
+    conflict(o->ckpt.c_path != NULL, "checkpoint", o->fopts.fo_ceiling,
+             "max-inflight");
+    conflict(o->ckpt.c_path != NULL, "checkpoint", o->fopts.fo_rate > 0,
+             "rate-limit");
+    conflict(o->ckpt.c_path != NULL, "checkpoint", o->statsfile != NULL,
+             "server-stats");
+
+    /* reports from snapshots, including the results of a shared sweep */
+    conflict(o->fromsnap != NULL, "from-snapshot", o->pwscan, "pwscan");
+    conflict(o->fromsnap != NULL, "from-snapshot", o->dirscan, "dirscan");
+    conflict(o->fromsnap != NULL, "from-snapshot", o->snapfile != NULL,
+             "write-snapshot");
+    conflict(o->fromsnap != NULL, "from-snapshot", o->shardspec != NULL,
+             "shard");
+    conflict(merge, "workdir", o->pwscan, "pwscan");
+    conflict(merge, "workdir", o->dirscan, "dirscan");
+    conflict(merge, "workdir", o->shardspec != NULL, "shard");
+
+    /* history reports */
+    conflict(o->history != NULL, "history", o->pwscan, "pwscan");
+    conflict(o->history != NULL, "history", o->dirscan, "dirscan");
+    conflict(o->history != NULL, "history", o->fromsnap != NULL,
+             "from-snapshot");
+    conflict(o->history != NULL, "history", o->workdir != NULL, "workdir");
+    conflict(o->history != NULL, "history", o->compare != NULL, "compare");
+    conflict(o->history != NULL, "history", o->snapfile != NULL,
+             "write-snapshot");
+    conflict(o->history != NULL, "history", o->archive != NULL,
+             "append-history");
+    conflict(o->history != NULL, "history", o->format != NULL, "format");
+    conflict(o->history != NULL, "history", notext, "output");
+    if (o->history)
+        return;
+
+    /* summaries and group totals */
+    conflict(o->summary, "summary", o->format != NULL, "format");
+    conflict(o->summary, "summary", notext, "output");
+    conflict(o->summary, "summary", o->usageonly, "usage-only");
+    conflict(o->summary, "summary", o->spacesort, "space-sort");
+    conflict(o->summary, "summary", o->filessort, "files-sort");
+    conflict(o->summary, "summary", o->reverse, "reverse");
+    conflict(o->summary, "summary", o->compare != NULL, "compare");
+    conflict(o->groupkey != NULL, "group-by", o->format != NULL, "format");
+    conflict(o->groupkey != NULL, "group-by", notext, "output");
+    conflict(o->groupkey != NULL, "group-by", o->usageonly, "usage-only");
+    conflict(o->groupkey != NULL, "group-by", o->summary, "summary");
+    conflict(o->groupkey != NULL, "group-by", o->compare != NULL, "compare");
+
+    /* comparisons */
+    conflict(o->compare != NULL, "compare", f->f_oversoft, "over-soft");
+    conflict(o->compare != NULL, "compare", f->f_overpct, "over-pct");
+    conflict(o->compare != NULL, "compare", f->f_hasstate, "state");
+    conflict(o->compare != NULL, "compare", f->f_minbytes != 0, "min-bytes");
+    conflict(o->compare != NULL, "compare", f->f_nonzero, "nonzero");
+    requires(o->mindelta != 0, "min-delta", o->compare != NULL, "compare");
+
+    if (!o->work && !o->pwscan && !o->dirscan && !o->uids && !o->fromsnap
+                 && !merge) {
+        fprintf(stderr, "%s: need one of --pwscan, --dirscan, --uid-range "
+                "or --from-snapshot\n", prog);
         exit(1);
     }
-    if (optind < argc)
-        fsname = argv[optind++];
-    else
-        usage();
-    if (optind < argc)
+
+    /* reports on several file systems */
+    one_fs(o->fromsnap != NULL, "from-snapshot", multi);
+    one_fs(o->snapfile != NULL, "write-snapshot", multi);
+    one_fs(o->compare != NULL, "compare", multi);
+    one_fs(o->archive != NULL, "append-history", multi);
+    one_fs(o->summary, "summary", multi);
+    one_fs(o->groupkey != NULL, "group-by", multi);
+    one_fs(notext, "output", multi);
+    conflict(o->join, "join", o->format != NULL, "format");
+    conflict(o->join, "join", o->usageonly, "usage-only");
+}
+
+/* Work on the shared sweep in o->workdir until all of its chunks are
+ * done.  fsname, if not NULL, must be the file system of the sweep.
+ */
+static void
+work_mode(struct opts *o, char *fsname)
+{
+    confent_t *conf;
+    conf_t config;
+    char *label;
+
+    if (!(label = work_label(o->workdir)))
+        exit(1);
+    if (fsname && strcmp(fsname, label) != 0) {
+        fprintf(stderr, "%s: %s: sweep is of %s, not %s\n",
+                prog, o->workdir, label, fsname);
+        exit(1);
+    }
+    config = conf_init(o->confpath); /* exit/perror on error */
+    if (!(conf = conf_get_bylabel(config, label, 0))) {
+        fprintf(stderr, "%s: %s: not found in quota.conf\n", prog, label);
+        exit(1);
+    }
+    work_sweep(o->workdir, conf, o->lease, !o->nouserlookup);
+    free(label);
+    conf_fini(config);
+}
+
+/* Free the uid's collected by multi_scan().
+ */
+static void
+multi_free_uids(struct multi *m)
+{
+    int i;
+
+    for (i = 0; i < m->nuid; i++) {
+        if (m->name[i])
+            free(m->name[i]);
+        if (m->tag[i])
+            free(m->tag[i]);
+    }
+    free(m->uid);
+    free(m->name);
+    free(m->tag);
+}
+
+/* Write the server statistics gathered by fetch_all() back to their file.
+ */
+static void
+save_stats(struct opts *o)
+{
+    if (!o->fopts.fo_stats)
+        return;
+    if (srvstat_write(o->fopts.fo_stats, o->statsfile) < 0)
+        fprintf(stderr, "%s: %s: %s\n", prog, o->statsfile, strerror(errno));
+    srvstat_close(o->fopts.fo_stats);
+}
+
+/* Report on the nfs file systems named in fsnames, or with -A on all of
+ * those in the config file, as sections or joined.
+ */
+static void
+multi_report(struct opts *o, struct shard *shard, int nfs, char **fsnames)
+{
+    struct multi multi;
+    confent_t *conf;
+    conf_t config;
+    report_t report;
+    outbuf_t ob;
+    char *format;
+    int i;
+
+    if ((o->all && nfs > 0) || (!o->all && nfs == 0))
         usage();
-    config = conf_init(conf_path); /* exit/perror on error */
 
+    /* Resolve all of the labels before querying any of them.
+     */
+    config = conf_init(o->confpath); /* exit/perror on error */
+    memset(&multi, 0, sizeof(multi));
+    if (o->all) {
+        conf_iterator_t itr = conf_iterator_create(config);
+
+        while ((conf = conf_next(itr))) {
+            multi.conf = xrealloc(multi.conf,
+                                  (multi.nconf + 1) * sizeof(conf));
+            multi.conf[multi.nconf++] = conf;
+        }
+        conf_iterator_destroy(itr);
+    } else {
+        multi.conf = xmalloc(nfs * sizeof(conf));
+        for (i = 0; i < nfs; i++) {
+            if (!(conf = conf_get_bylabel(config, fsnames[i], 0))) {
+                fprintf(stderr, "%s: %s: not found in quota.conf\n",
+                        prog, fsnames[i]);
+                exit(1);
+            }
+            multi.conf[multi.nconf++] = conf;
+        }
+    }
+
+    multi_scan(&multi, o->uids, shard, o->pwscan, o->dirscan);
+    multi.q = xmalloc((multi.nuid * multi.nconf + 1) * sizeof(quota_t));
+    memset(multi.q, 0, (multi.nuid * multi.nconf + 1) * sizeof(quota_t));
+    if (fetch_all(multi.conf, multi.nconf, multi.uid, multi.nuid, &o->filter,
+                  &o->fopts, (fetch_f)multi_result, &multi) < 0)
+        exit(1);
+
+    ob = outbuf_create(STDOUT_FILENO, OUTBUF_SIZE);
+    if (o->join)
+        multi_join(&multi, ob, o->bsize, o->human, o->noheading,
+                   o->spacesort, o->filessort, o->reverse, !o->nouserlookup);
+    else {
+        format = o->format ? o->format : o->usageonly ? REPORT_USAGEONLY
+                                                      : REPORT_DEFAULT;
+        report = report_create(ob, format, o->bsize,
+                               o->human ? REPORT_HUMAN : 0);
+        if (!report)
+            exit(1);
+        multi_sections(&multi, ob, report, o->bsize, o->human, o->noheading,
+                       o->spacesort, o->filessort, o->reverse,
+                       !o->nouserlookup);
+        report_destroy(report);
+    }
+    if (outbuf_destroy(ob) < 0) {
+        fprintf(stderr, "%s: write error: %s\n", prog, strerror(errno));
+        exit(1);
+    }
+
+    for (i = 0; i < multi.nuid * multi.nconf; i++)
+        if (multi.q[i])
+            quota_destroy(multi.q[i]);
+    free(multi.q);
+    multi_free_uids(&multi);
+    free(multi.conf);
+    if (o->uids)
+        listint_destroy(o->uids);
+    conf_fini(config);
+    save_stats(o);
+}
+
+/* Split a shared sweep of fsname into chunks in o->workdir for workers
+ * to claim.
+ */
+static void
+split_sweep(struct opts *o, struct shard *shard, char *fsname)
+{
+    struct multi multi;
+    confent_t *conf;
+    conf_t config;
+
+    config = conf_init(o->confpath); /* exit/perror on error */
     if (!(conf = conf_get_bylabel(config, fsname, 0))) {
         fprintf(stderr, "%s: %s: not found in quota.conf\n", prog, fsname);
         exit(1);
     }
-        
-    /* Scan.
-     */
-    qlist = list_create((ListDelF)quota_destroy);
-    if (popt)
-        pwscan(conf, qlist, uids, !nopt);
-    if (dopt) 
-        dirscan(conf, qlist, uids, !nopt);
-    if (!dopt && !popt)
-        uidscan(conf, qlist, uids, !nopt);
+    memset(&multi, 0, sizeof(multi));
+    multi.conf = &conf;
+    multi.nconf = 1;
+    multi_scan(&multi, o->uids, shard, o->pwscan, o->dirscan);
+    if (work_split(o->workdir, conf->cf_label, multi.uid, multi.nuid,
+                   o->chunk) < 0)
+        exit(1);
+    multi_free_uids(&multi);
+    if (o->uids)
+        listint_destroy(o->uids);
+    conf_fini(config);
+}
+
+/* Open the snapshots in paths, which must all be of the same file system,
+ * and of fsname if it is not NULL.  Returns an array of *nsnap snapshots.
+ */
+static snap_t *
+open_snaps(List paths, char *fsname, int *nsnap)
+{
+    snap_t *snaps = xmalloc(list_count(paths) * sizeof(snap_t));
+    const char *rhost = NULL, *rpath = NULL;
+    ListIterator itr;
+    snap_t snap;
+    char *path;
+    int n = 0;
+
+    itr = list_iterator_create(paths);
+    while ((path = list_next(itr))) {
+        if (!(snap = snap_open(path))) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, errno == EINVAL
+                    ? "not a quota snapshot" : strerror(errno));
+            exit(1);
+        }
+        if (fsname && strcmp(fsname, snap_label(snap)) != 0) {
+            fprintf(stderr, "%s: %s: snapshot is of %s, not %s\n",
+                    prog, path, snap_label(snap), fsname);
+            exit(1);
+        }
+        if (n > 0 && (strcmp(rhost, snap_rhost(snap))
+                        || strcmp(rpath, snap_rpath(snap)))) {
+            fprintf(stderr, "%s: %s: snapshot is of %s:%s, not %s:%s\n",
+                    prog, path, snap_rhost(snap), snap_rpath(snap),
+                    rhost, rpath);
+            exit(1);
+        }
+        fsname = (char *)snap_label(snap);
+        rhost = snap_rhost(snap);
+        rpath = snap_rpath(snap);
+        snaps[n++] = snap;
+    }
+    list_iterator_destroy(itr);
+    *nsnap = n;
+    return snaps;
+}
 
+/* Report on one file system, fsname, or that of the snapshots in
+ * o->fromsnap.
+ */
+static void
+fs_report(struct opts *o, struct shard *shard, char *fsname)
+{
+    confent_t *conf = NULL;
+    conf_t config = NULL;
+    struct sweep sw;
+    outbuf_t ob;
+    char *format = o->format;
+    report_t report;
+    snap_t snap = NULL;
+    snap_t *snaps = NULL;
+    int nsnap = 0;
+    snap_t old = NULL;
+    List dlist;
+    char *rhost, *rpath;
+    int i;
+    time_t start;
+
+    if (o->fromsnap) {
+        /* Several snapshots, e.g. of the shards of a sweep, are merged.
+         */
+        snaps = open_snaps(o->fromsnap, fsname, &nsnap);
+        snap = snaps[0];
+        fsname = (char *)snap_label(snap);
+        rhost = (char *)snap_rhost(snap);
+        rpath = (char *)snap_rpath(snap);
+    } else {
+        config = conf_init(o->confpath); /* exit/perror on error */
+
+        if (!(conf = conf_get_bylabel(config, fsname, 0))) {
+            fprintf(stderr, "%s: %s: not found in quota.conf\n", prog, fsname);
+            exit(1);
+        }
+        rhost = conf->cf_rhost;
+        rpath = conf->cf_rpath;
+    }
+    if (o->compare) {
+        if (!(old = snap_open(o->compare))) {
+            fprintf(stderr, "%s: %s: %s\n", prog, o->compare, errno == EINVAL
+                    ? "not a quota snapshot" : strerror(errno));
+            exit(1);
+        }
+        if (strcmp(rhost, snap_rhost(old)) || strcmp(rpath, snap_rpath(old))) {
+            fprintf(stderr, "%s: %s: snapshot is of %s:%s, not %s:%s\n",
+                    prog, o->compare, snap_rhost(old), snap_rpath(old),
+                    rhost, rpath);
+            exit(1);
+        }
+    }
 
-    /* Sort.
+    /* Set up the report first so rows can be streamed as they arrive.
      */
-    if (ropt) {
-        if (sopt)
-            list_sort(qlist, (ListCmpF)quota_cmp_bytes_reverse);
-        else if (Fopt)
-            list_sort(qlist, (ListCmpF)quota_cmp_files_reverse);
-        else
-            list_sort(qlist, (ListCmpF)quota_cmp_uid_reverse);
+    ob = outbuf_create(STDOUT_FILENO, OUTBUF_SIZE);
+    report = NULL;
+    if (o->summary || o->groupkey) {
+        if (!o->noheading)
+            put_title(ob, o->summary ? "Quota summary for "
+                                     : "Usage by group for ",
+                      fsname, o->bsize, o->human);
+    } else if (!strcmp(o->output, "text")) {
+        if (!format && old)
+            format = REPORT_DELTADEFAULT;
+        else if (!format)
+            format = o->usageonly ? REPORT_USAGEONLY : REPORT_DEFAULT;
+        report = report_create(ob, format, o->bsize,
+                               (o->human ? REPORT_HUMAN : 0)
+                               | (old ? REPORT_DELTA : 0));
+        if (!report)
+            exit(1);
+        if (!o->noheading)
+            put_title(ob, "Quota report for ", fsname, o->bsize, o->human);
+    } else if (!strcmp(o->output, "json")) {
+        report = report_create_json(ob, old ? REPORT_DELTA : 0);
+    } else if (!strcmp(o->output, "csv")) {
+        report = report_create_csv(ob, old ? REPORT_DELTA : 0);
     } else {
-        if (sopt)
-            list_sort(qlist, (ListCmpF)quota_cmp_bytes);
-        else if (Fopt)
-            list_sort(qlist, (ListCmpF)quota_cmp_files);
-        else
-            list_sort(qlist, (ListCmpF)quota_cmp_uid);
+        fprintf(stderr, "%s: unknown output type: %s\n", prog, o->output);
+        exit(1);
     }
+    if (report && !o->noheading)
+        report_heading(report);
 
-    /* Report.
+    /* Scan.  JSON and CSV output, summaries and group totals are streamed
+     * unless a sort was requested or the results are needed for a snapshot
+     * or comparison.  A merge of several snapshots is produced in sorted
+     * order, so it is streamed too.  Records that fail a filter are
+     * dropped as they arrive.  User names are not needed for group totals.
      */
-    if (!Hopt) {
+    start = time(NULL);
+    memset(&sw, 0, sizeof(sw));
+    sw.conf = conf;
+    sw.seen = uidset_create();
+    sw.report = report;
+    sw.qlist = NULL;
+    sw.summary = o->summary ? summary_create() : NULL;
+    sw.groupby = NULL;
+    if (o->groupkey
+            && !(sw.groupby = groupby_create(o->groupkey, !o->nouserlookup)))
+        exit(1);
+    if ((!o->summary && !o->groupkey && nsnap <= 1
+                     && !strcmp(o->output, "text"))
+            || (!o->groupkey && nsnap <= 1
+                     && (o->spacesort || o->filessort || o->reverse))
+            || o->snapfile || old || o->archive || o->ckpt.c_path)
+        sw.qlist = list_create((ListDelF)quota_destroy);
+    sw.filter = o->filter;
+    sw.multi = NULL;
+    sw.shard = *shard;
+    sw.getusername = !o->nouserlookup
+                  && (!o->groupkey || o->snapfile || o->ckpt.c_path);
+    sw.ckpt = NULL;
+    if (o->ckpt.c_path) {
+        o->ckpt.c_scan = o->pwscan ? "pw" : o->dirscan ? "dir" : "uid";
+        o->ckpt.c_start = o->ckpt.c_last = start;
+        sw.ckpt = &o->ckpt;
+        if (o->resume && ckpt_resume(&sw) < 0)
+            exit(1);
+        start = o->ckpt.c_start;
+    }
+    if (nsnap > 1)
+        mergescan(&sw, snaps, nsnap, o->uids, o->spacesort ? MERGE_BYTES
+                  : o->filessort ? MERGE_FILES : MERGE_UID, o->reverse);
+    else if (snap)
+        snapscan(&sw, snap, o->uids);
+    else if (o->parallel)
+        fetchscan(&sw, o->uids, o->pwscan, o->dirscan, &o->fopts);
+    else if (o->pwscan)
+        pwscan(&sw, o->uids);
+    else if (o->dirscan)
+        dirscan(&sw, o->uids);
+    else
+        uidscan(&sw, o->uids);
 
-        if (hopt)
-            printf("Quota report for %s\n", fsname);
-        else {
-            char tmpstr[16];
-            size2str(bsize, tmpstr, sizeof(tmpstr));
-            printf("Quota report for %s (blocksize %s)\n", fsname, tmpstr);
+    /* Save results in the order retrieved, so a report from the snapshot
+     * breaks ties in a sort exactly as this one does.
+     */
+    if (o->snapfile && snap_write(o->snapfile, conf, start, sw.qlist) < 0)
+        exit(1);
+    if (o->archive && hist_append(o->archive, fsname, rhost, rpath,
+                                  snap ? snap_time(snap) : start,
+                                  sw.qlist) < 0)
+        exit(1);
+
+    /* Sort and report.  A comparison reports only the changed records,
+     * sorted on the change in usage.  -m applies to files with -F.
+     */
+    if (sw.summary) {
+        if (sw.qlist)
+            list_for_each(sw.qlist, (ListForF)summary_add, sw.summary);
+        summary_report(sw.summary, ob, o->bsize, o->human);
+        summary_destroy(sw.summary);
+    } else if (sw.groupby) {
+        if (sw.qlist)
+            list_for_each(sw.qlist, (ListForF)groupby_add, sw.groupby);
+        groupby_report(sw.groupby, ob, o->bsize, o->human,
+                       o->spacesort ? GROUPBY_BYTES
+                       : o->filessort ? GROUPBY_FILES : GROUPBY_NAME,
+                       o->reverse, !o->noheading);
+        groupby_destroy(sw.groupby);
+    } else if (old) {
+        list_sort(sw.qlist, (ListCmpF)quota_cmp_uid);
+        dlist = delta_join(sw.qlist, old, !o->nouserlookup,
+                           o->filessort ? 0 : o->mindelta,
+                           o->filessort ? o->mindelta : 0);
+        if (o->reverse) {
+            if (o->spacesort)
+                list_sort(dlist, (ListCmpF)delta_cmp_bytes_reverse);
+            else if (o->filessort)
+                list_sort(dlist, (ListCmpF)delta_cmp_files_reverse);
+            else
+                list_sort(dlist, (ListCmpF)delta_cmp_uid_reverse);
+        } else {
+            if (o->spacesort)
+                list_sort(dlist, (ListCmpF)delta_cmp_bytes);
+            else if (o->filessort)
+                list_sort(dlist, (ListCmpF)delta_cmp_files);
         }
+        list_for_each(dlist, (ListForF)delta_report, report);
+        list_destroy(dlist);
+    } else if (sw.qlist) {
+        sort_results(sw.qlist, o->spacesort, o->filessort, o->reverse);
+        list_for_each(sw.qlist, (ListForF)report_row, report);
     }
-    if (Uopt) {
-        if (!Hopt)
-            quota_report_heading_usageonly();
-        if (hopt)
-            list_for_each(qlist, (ListForF)quota_report_usageonly_h, &bsize);
-        else
-            list_for_each(qlist, (ListForF)quota_report_usageonly, &bsize);
-    } else {
-        if (!Hopt)
-            quota_report_heading();
-        if (hopt)
-            list_for_each(qlist, (ListForF)quota_report_h, &bsize);
-        else
-            list_for_each(qlist, (ListForF)quota_report, &bsize);
+    if (report)
+        report_destroy(report);
+    if (outbuf_destroy(ob) < 0) {
+        fprintf(stderr, "%s: write error: %s\n", prog, strerror(errno));
+        exit(1);
     }
+    if (sw.ckpt)
+        ckpt_remove(sw.ckpt);
+    save_stats(o);
 
-    if (qlist)
-        list_destroy(qlist);
-    if (uids)
-        listint_destroy(uids);
-    conf_fini(config);
-
-    return 0;
+    if (sw.qlist)
+        list_destroy(sw.qlist);
+    sweep_fini(&sw);
+    uidset_destroy(sw.seen);
+    if (o->uids)
+        listint_destroy(o->uids);
+    for (i = 0; i < nsnap; i++)
+        snap_close(snaps[i]);
+    if (snaps)
+        free(snaps);
+    if (o->fromsnap)
+        list_destroy(o->fromsnap);
+    if (old)
+        snap_close(old);
+    if (config)
+        conf_fini(config);
 }
 
 static void
@@ -261,6 +1121,10 @@ usage(void)
 {
     fprintf(stderr, 
   "Usage: %s [--options] fs\n"
+  "       %s [--options] -S snapshot [-S snapshot ...] [fs]\n"
+  "       %s [--options] [-j] fs fs ... | -A\n"
+  "       %s -W dir -C n [-pdu ...] fs | -W dir -X [fs] | -W dir [--options]\n"
+  "       %s [-u uid-range] [-b size | -h] -y archive [fs]\n"
   "  -d,--dirscan           report on users who own top level dirs of fs\n"
   "  -p,--pwscan            report on users in the password file\n"
   "  -b,--blocksize         report usage in blocksize units (default 1M)\n"
@@ -269,78 +1133,230 @@ usage(void)
   "  -s,--space-sort        sort on space used (default sort on uid)\n"
   "  -F,--files-sort        sort on files used (default sort on uid)\n"
   "  -U,--usage-only        only report usage, not quota limits\n"
+  "  -o,--format            set report columns, e.g. \"%%name %%bytes %%pct\"\n"
+  "  -O,--output            report as text (default), json, or csv\n"
+  "  -w,--write-snapshot    also save results to a binary snapshot file\n"
+  "  -S,--from-snapshot     report from a snapshot file instead of the server\n"
+  "  -c,--compare           report changes in usage since a snapshot file\n"
+  "  -m,--min-delta         with -c, only report changes of at least size\n"
+  "  -a,--append-history    also append usage to a history archive file\n"
+  "  -y,--history           report usage over time from a history archive\n"
+  "  -z,--summary           report the distribution of usage, not each user\n"
+  "  -g,--group-by          report totals per gid, gecos[:N] or map:file\n"
+  "  -E,--over-soft         only include users over a soft limit\n"
+  "  -P,--over-pct          only include users at or above pct of a hard limit\n"
+  "  -t,--state             only include users with space or files in state\n"
+  "  -M,--min-bytes         only include users using at least size\n"
+  "  -N,--nonzero           only include users using some space or files\n"
+  "  -A,--all               report on all file systems in the config file\n"
+  "  -j,--join              one row per user with a column per file system\n"
+  "  -k,--shard             only query shard i/n of the uid's, by hash or range\n"
+  "  -W,--workdir           report on a sweep shared through a work directory\n"
+  "  -C,--chunk-size        with -W, split the sweep into chunks of n uid's\n"
+  "  -X,--work              with -W, claim and query chunks until all are done\n"
+  "  -e,--lease             seconds before a worker's claim expires (default 300)\n"
+  "  -K,--checkpoint        periodically save progress of the sweep to file\n"
+  "  -R,--resume            with -K, continue the sweep saved in the checkpoint\n"
+  "  -I,--checkpoint-interval  seconds between checkpoints (default 60)\n"
+  "  -Q,--max-inflight      queries in flight to a server at most (default 8)\n"
+  "  -l,--rate-limit        queries per second to a server at most\n"
+  "  -Y,--server-stats      schedule by, and update, server statistics in file\n"
   "  -H,--suppress-heading  suppress report heading\n"
   "  -L,--nolimits          do not include quota limits in report\n"
   "  -n,--nouserlookup      do not try to map uid's to user names\n"
   "  -f,--config            use a config file other than %s\n"
-                , prog, _PATH_QUOTA_CONF);
+                , prog, prog, prog, prog, prog, _PATH_QUOTA_CONF);
     exit(1);
 }
 
-/* Query the quota for uid and add it to qlist if successful.
+/* Queue uid to be queried.  The queries are made SWEEP_BATCH at a time
+ * by flush_quotas(), which must be called at the end of a scan.
  */
 static void
-add_quota(confent_t *cp, List qlist, uid_t uid, char *name)
+add_quota(struct sweep *sw, uid_t uid, char *name, const char *tag)
 {
-    quota_t q;
-
-    if (list_find_first(qlist, (ListFindF)quota_match_uid, &uid))
+    if (!shard_member(&sw->shard, uid) || !uidset_add(sw->seen, uid))
         return;
-    q = quota_create(cp->cf_label, cp->cf_rhost, cp->cf_rpath, cp->cf_thresh);
-    if (quota_get(uid, q)) {
-        quota_destroy(q);
+    if (sw->multi) {
+        multi_add(sw->multi, uid, name, tag);
+        return;
+    }
+    if (!sw->b_uid) {
+        sw->b_uid = xmalloc(SWEEP_BATCH * sizeof(uid_t));
+        sw->b_name = xmalloc(SWEEP_BATCH * sizeof(char *));
+        sw->b_tag = xmalloc(SWEEP_BATCH * sizeof(char *));
+    }
+    sw->b_uid[sw->b_n] = uid;
+    sw->b_name[sw->b_n] = name ? xstrdup(name) : NULL;
+    sw->b_tag[sw->b_n] = tag ? xstrdup((char *)tag) : NULL;
+    if (++sw->b_n == SWEEP_BATCH)
+        flush_quotas(sw);
+}
+
+/* Query the queued uid's and add each quota found to the results, in
+ * the order queued, if it passes the filters.  The user name is only
+ * looked up then: the name queued is used if known, else the passwd
+ * entry, else "[tag]".
+ */
+static void
+flush_quotas(struct sweep *sw)
+{
+    quota_t qv[SWEEP_BATCH];
+    int rcv[SWEEP_BATCH];
+    unsigned char keep[SWEEP_BATCH];
+    char buf[32];
+    int i;
+
+    if (sw->b_n == 0)
         return;
+    if (!sw->fs)
+        sw->fs = quota_fs_create_conf(sw->conf);
+    quota_get_many(sw->fs, sw->b_uid, qv, rcv, sw->b_n);
+    qfilter_match_many(qv, rcv, sw->b_n, &sw->filter, keep);
+    for (i = 0; i < sw->b_n; i++) {
+        if (!keep[i])
+            quota_destroy(qv[i]);
+        else {
+            if (sw->getusername)
+                quota_adduser(qv[i], user_name(sw->b_uid[i], sw->b_name[i],
+                                               sw->b_tag[i], buf,
+                                               sizeof(buf)));
+            add_result(sw, qv[i]);
+        }
+        if (sw->b_name[i])
+            free(sw->b_name[i]);
+        if (sw->b_tag[i])
+            free(sw->b_tag[i]);
+    }
+    sw->b_n = 0;
+}
+
+/* Free the query context and queue of a sweep.
+ */
+static void
+sweep_fini(struct sweep *sw)
+{
+    assert(sw->b_n == 0);
+    if (sw->fs)
+        quota_fs_destroy(sw->fs);
+    if (sw->b_uid) {
+        free(sw->b_uid);
+        free(sw->b_name);
+        free(sw->b_tag);
     }
+}
+
+/* Return name if set, else the user name of uid, else "[tag]" in buf.
+ */
+static char *
+user_name(uid_t uid, char *name, const char *tag, char *buf, int len)
+{
+    struct passwd *pw;
+
     if (name)
-        quota_adduser (q, name);
-    list_append(qlist, q);
+        return name;
+    if ((pw = getpwuid(uid)))
+        return pw->pw_name;
+    snprintf(buf, len, "[%s]", tag);
+    return buf;
+}
+
+/* Add q to the results, or report or summarize it now if streaming.
+ */
+static void
+add_result(struct sweep *sw, quota_t q)
+{
+    if (sw->qlist)
+        list_append(sw->qlist, q);
+    else if (sw->summary) {
+        summary_add(q, sw->summary);
+        quota_destroy(q);
+    } else if (sw->groupby) {
+        groupby_add(q, sw->groupby);
+        quota_destroy(q);
+    } else {
+        report_row(q, sw->report);
+        quota_destroy(q);
+    }
+}
+
+/* Query the uid's found by a scan in parallel, then add the results in
+ * the order the scan found them.
+ */
+static void
+fetchscan(struct sweep *sw, List uids, int popt, int dopt,
+          struct fetch_opts *opts)
+{
+    struct multi m;
+    char buf[32];
+    int i;
+
+    memset(&m, 0, sizeof(m));
+    m.conf = &sw->conf;
+    m.nconf = 1;
+    multi_scan(&m, uids, &sw->shard, popt, dopt);
+    m.q = xmalloc((m.nuid + 1) * sizeof(quota_t));
+    memset(m.q, 0, (m.nuid + 1) * sizeof(quota_t));
+    if (fetch_all(m.conf, 1, m.uid, m.nuid, &sw->filter, opts,
+                  (fetch_f)multi_result, &m) < 0)
+        exit(1);
+    for (i = 0; i < m.nuid; i++) {
+        if (m.q[i]) {
+            if (sw->getusername)
+                quota_adduser(m.q[i], user_name(m.uid[i], m.name[i],
+                                                m.tag[i], buf, sizeof(buf)));
+            add_result(sw, m.q[i]);
+        }
+        if (m.name[i])
+            free(m.name[i]);
+        if (m.tag[i])
+            free(m.tag[i]);
+    }
+    free(m.q);
+    free(m.uid);
+    free(m.name);
+    free(m.tag);
 }
 
 /* Get quotas for all uid's in uids list.
  */
 static void
-uidscan(confent_t *cp, List qlist, List uids, int getusername)
+uidscan(struct sweep *sw, List uids)
 {
-    struct passwd *pw;
     ListIterator itr;
-    quota_t q;
     unsigned long *up;
-    int rc;
-    char name[32];
+    char tag[32];
 
     itr = list_iterator_create(uids);
     while ((up = list_next(itr))) {
-        if (getusername) {
-            if ((pw = getpwuid ((uid_t)*up)))
-                snprintf (name, sizeof(name), "%s", pw->pw_name);
-            else 
-                snprintf (name, sizeof(name), "[%lu]", *up);
-            add_quota(cp, qlist, pw->pw_uid, name);
-        } else
-            add_quota(cp, qlist, (uid_t)*up, NULL);
+        if (!ckpt_next(sw))
+            continue;
+        snprintf(tag, sizeof(tag), "%lu", *up);
+        add_quota(sw, (uid_t)*up, NULL, tag);
     }
     list_iterator_destroy(itr);
+    flush_quotas(sw);
 }
 
 /* Get quotas for all owners of top-level directories, optionally
  * filtered by uids.
  */
 static void
-dirscan(confent_t *cp, List qlist, List uids, int getusername)
+dirscan(struct sweep *sw, List uids)
 {
-    struct passwd *pw;
+    confent_t *cp = sw->conf;
     struct dirent *dp;
     DIR *dir;
     char fqp[MAXPATHLEN];
     struct stat sb;
-    quota_t q;
-    char name[32];
 
     if (!(dir = opendir(cp->cf_rpath))) {
         fprintf(stderr, "%s: could not open %s\n", prog, cp->cf_rpath);
         exit(1);
     }
     while ((dp = readdir(dir))) {
+        if (!ckpt_next(sw))
+            continue;
         if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
             continue;
         snprintf(fqp, sizeof(fqp), "%s/%s", cp->cf_rpath, dp->d_name);
@@ -348,33 +1364,722 @@ dirscan(confent_t *cp, List qlist, List uids, int getusername)
             continue;
         if (uids && !listint_member(uids, sb.st_uid))
             continue;
-        if (getusername) {
-            if ((pw = getpwuid(sb.st_uid)))
-                snprintf (name, sizeof(name), "%s", pw->pw_name);
-            else
-                snprintf (name, sizeof(name), "[%s]", dp->d_name);
-            add_quota(cp, qlist, sb.st_uid, name);
-        } else
-            add_quota(cp, qlist, sb.st_uid, NULL);
+        add_quota(sw, sb.st_uid, NULL, dp->d_name);
     }
     if (closedir(dir) < 0)
         fprintf(stderr, "%s: closedir %s: %m\n", prog, cp->cf_rpath);
+    flush_quotas(sw);
 }
 
 /* Get quotas for all users in the password file, optionally filtered
  * by uids list.
  */
 static void
-pwscan(confent_t *cp, List qlist, List uids, int getusername)
+pwscan(struct sweep *sw, List uids)
 {
     struct passwd *pw;
-    quota_t q;
 
     while ((pw = getpwent()) != NULL) {
+        if (!ckpt_next(sw))
+            continue;
         if (uids && !listint_member(uids, pw->pw_uid))
             continue;
-        add_quota(cp, qlist, pw->pw_uid, getusername ? pw->pw_name : NULL);
+        add_quota(sw, pw->pw_uid, pw->pw_name, NULL);
+    }
+    flush_quotas(sw);
+}
+
+/* Renew the lease on chunk name, last renewed at *touched.  Returns -1
+ * if it is lost: if it has run out, another worker may have reclaimed
+ * the chunk even if it can still be touched.
+ */
+static int
+work_renew(char *dir, char *name, int lease, time_t *touched)
+{
+    if (time(NULL) - *touched >= lease || work_touch(dir, name) < 0)
+        return -1;
+    *touched = time(NULL);
+    return 0;
+}
+
+/* Work on a shared sweep: claim chunks until none are left, query their
+ * uid's, and write the results of each as a snapshot.  The uid's are
+ * queried in batches, and the lease on the chunk renewed after each.  A
+ * batch is doubled while it takes under a quarter of the lease, and
+ * halved when it takes longer.
+ */
+static void
+work_sweep(char *dir, confent_t *cp, int lease, int getusername)
+{
+    struct sweep sw;
+    char name[64], tag[32];
+    char *path;
+    uid_t *uid;
+    time_t start, touched;
+    int i, k, n, rc, lost, batch = 1;
+
+    memset(&sw, 0, sizeof(sw));
+    sw.conf = cp;
+    sw.getusername = getusername;
+    while ((rc = work_claim(dir, lease, name, sizeof(name))) > 0) {
+        if ((n = work_read(dir, name, &uid)) < 0) {
+            if (errno != ENOENT)
+                exit(1);
+            fprintf(stderr, "%s: chunk %s: lease lost, abandoned\n",
+                    prog, name);
+            continue;
+        }
+        sw.seen = uidset_create();
+        sw.qlist = list_create((ListDelF)quota_destroy);
+        start = touched = time(NULL);
+        for (i = lost = 0; i < n && !lost; ) {
+            for (k = 0; k < batch && i < n; k++, i++) {
+                snprintf(tag, sizeof(tag), "%lu", (unsigned long)uid[i]);
+                add_quota(&sw, uid[i], NULL, tag);
+            }
+            flush_quotas(&sw);
+            if (time(NULL) - touched < lease / 4)
+                batch = batch * 2 < SWEEP_BATCH ? batch * 2 : SWEEP_BATCH;
+            else if (batch > 1)
+                batch /= 2;
+            lost = (work_renew(dir, name, lease, &touched) < 0);
+        }
+        if (lost)
+            fprintf(stderr, "%s: chunk %s: lease lost, abandoned\n",
+                    prog, name);
+        else {
+            path = work_result(dir, name);
+            if (snap_write(path, cp, start, sw.qlist) < 0)
+                exit(1);
+            free(path);
+            if (work_done(dir, name) < 0)
+                exit(1);
+        }
+        list_destroy(sw.qlist);
+        uidset_destroy(sw.seen);
+        if (uid)
+            free(uid);
+    }
+    sweep_fini(&sw);
+    if (rc < 0)
+        exit(1);
+}
+
+/* Add record rec of snap to the results if it passes the filters.
+ * *qp is used for it, or allocated if NULL; if the record fails it is
+ * left to be reused for the next.
+ */
+static void
+snap_add(struct sweep *sw, snap_t snap, int rec, quota_t *qp)
+{
+    const char *name;
+
+    if (!*qp)
+        *qp = quota_create((char *)snap_label(snap), (char *)snap_rhost(snap),
+                           (char *)snap_rpath(snap), snap_thresh(snap));
+    snap_quota(snap, rec, *qp);
+    if (!qfilter_match(*qp, &sw->filter))
+        return;
+    if (sw->getusername && (name = snap_name(snap, rec)))
+        quota_adduser(*qp, (char *)name);
+    add_result(sw, *qp);
+    *qp = NULL;
+}
+
+/* Get quotas recorded in a snapshot, optionally filtered by uids list.
+ */
+static void
+snapscan(struct sweep *sw, snap_t snap, List uids)
+{
+    const uint32_t *uid = snap_column(snap, SNAP_COL_UID);
+    quota_t q = NULL;
+    int i, n = snap_count(snap);
+
+    for (i = 0; i < n; i++) {
+        if (uids && !listint_member(uids, uid[i]))
+            continue;
+        snap_add(sw, snap, i, &q);
+    }
+    if (q)
+        quota_destroy(q);
+}
+
+/* Get quotas recorded in several snapshots, e.g. of the shards of a
+ * sweep, in sorted order.  Where shards overlap, the first record for
+ * each uid is kept.
+ */
+static void
+mergescan(struct sweep *sw, snap_t *snaps, int nsnap, List uids, int order,
+          int reverse)
+{
+    merge_t m = merge_create(snaps, nsnap, order, reverse);
+    const uint32_t *uid;
+    quota_t q = NULL;
+    int i, rec;
+
+    while ((i = merge_next(m, &rec)) >= 0) {
+        uid = snap_column(snaps[i], SNAP_COL_UID);
+        if (uids && !listint_member(uids, uid[rec]))
+            continue;
+        if (!uidset_add(sw->seen, uid[rec]))
+            continue;
+        snap_add(sw, snaps[i], rec, &q);
+    }
+    if (q)
+        quota_destroy(q);
+    merge_destroy(m);
+}
+
+static int
+cmp_uid(const void *a, const void *b)
+{
+    uid_t x = *(const uid_t *)a, y = *(const uid_t *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Parse a shard spec, "[hash:|range:]i/n".  Hash shards are spread
+ * evenly across the uid space; range shards are contiguous slices of
+ * the -u list, which is required.
+ */
+static int
+parse_shard(char *s, struct shard *sh, List uids)
+{
+    ListIterator itr;
+    unsigned long *up;
+    uid_t *v;
+    char *end;
+    int n, lo, hi;
+
+    if (!strncmp(s, "range:", 6)) {
+        sh->s_range = 1;
+        s += 6;
+    } else if (!strncmp(s, "hash:", 5))
+        s += 5;
+    sh->s_index = strtoul(s, &end, 10);
+    if (end == s || *end != '/')
+        goto bad;
+    s = end + 1;
+    sh->s_count = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || sh->s_count < 1
+                 || sh->s_index >= sh->s_count)
+        goto bad;
+    if (!sh->s_range)
+        return 0;
+
+    if (!uids) {
+        fprintf(stderr, "%s: range shards require -u\n", prog);
+        return -1;
+    }
+    v = xmalloc((list_count(uids) + 1) * sizeof(uid_t));
+    n = 0;
+    itr = list_iterator_create(uids);
+    while ((up = list_next(itr)))
+        v[n++] = *up;
+    list_iterator_destroy(itr);
+    qsort(v, n, sizeof(uid_t), cmp_uid);
+    lo = (long long)n * sh->s_index / sh->s_count;
+    hi = (long long)n * (sh->s_index + 1) / sh->s_count;
+    if (lo < hi) {
+        sh->s_lo = v[lo];
+        sh->s_hi = v[hi - 1];
+    } else {                    /* more shards than uid's */
+        sh->s_lo = 1;
+        sh->s_hi = 0;
+    }
+    free(v);
+    return 0;
+bad:
+    fprintf(stderr, "%s: error parsing shard\n", prog);
+    return -1;
+}
+
+/* Called before each entry of the uid source.  Returns 0 if the entry was
+ * consumed before the sweep was resumed, so should be skipped.  Otherwise
+ * saves the records so far, querying those queued first, and the position
+ * of this entry if a checkpoint is due.  The snapshot is written before
+ * the position, so a checkpoint interrupted between the two resumes from
+ * an earlier position; the uid's in the snapshot are not queried again, so
+ * this only costs some time.
+ */
+static int
+ckpt_next(struct sweep *sw)
+{
+    struct checkpoint *ck = sw->ckpt;
+    char path[MAXPATHLEN], tmppath[MAXPATHLEN + 16];
+    time_t now;
+    FILE *f;
+
+    if (!ck)
+        return 1;
+    if (ck->c_pos++ < ck->c_skip)
+        return 0;
+    if ((now = time(NULL)) - ck->c_last < ck->c_interval)
+        return 1;
+    ck->c_last = now;
+    flush_quotas(sw);
+    if (snap_write(ck->c_path, sw->conf, ck->c_start, sw->qlist) < 0)
+        return 1;
+    snprintf(path, sizeof(path), "%s.pos", ck->c_path);
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    if (!(f = fopen(tmppath, "w"))) {
+        fprintf(stderr, "%s: %s: %s\n", prog, tmppath, strerror(errno));
+        return 1;
+    }
+    fprintf(f, "%s %ld %s\n", ck->c_scan, ck->c_pos - 1, sw->conf->cf_label);
+    if (fclose(f) != 0 || rename(tmppath, path) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        unlink(tmppath);
+    }
+    return 1;
+}
+
+/* Load the records saved in the checkpoint and arrange for the scan to
+ * skip the entries of the uid source consumed before it was saved.  If
+ * there is no checkpoint, the sweep starts from the beginning.
+ */
+static int
+ckpt_resume(struct sweep *sw)
+{
+    struct checkpoint *ck = sw->ckpt;
+    char path[MAXPATHLEN], buf[MAXPATHLEN + 64], scan[16];
+    char *label = NULL;
+    const uint32_t *uid;
+    snap_t snap;
+    long pos = 0;
+    FILE *f;
+    int i, n;
+
+    snprintf(path, sizeof(path), "%s.pos", ck->c_path);
+    if ((f = fopen(path, "r"))) {
+        if (!fgets(buf, sizeof(buf), f)
+                || sscanf(buf, "%15s %ld %n", scan, &pos, &n) != 2) {
+            fprintf(stderr, "%s: %s: error parsing checkpoint\n", prog, path);
+            fclose(f);
+            return -1;
+        }
+        fclose(f);
+        label = buf + n;
+        label[strcspn(label, "\n")] = '\0';
+        if (strcmp(scan, ck->c_scan) != 0
+                || strcmp(label, sw->conf->cf_label) != 0) {
+            fprintf(stderr, "%s: %s: checkpoint is of a %s scan of %s, not "
+                    "a %s scan of %s\n", prog, ck->c_path, scan, label,
+                    ck->c_scan, sw->conf->cf_label);
+            return -1;
+        }
+    } else if (errno != ENOENT) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return -1;
+    }
+
+    /* Without a position, the records are still worth keeping.
+     */
+    if (!(snap = snap_open(ck->c_path))) {
+        if (errno == ENOENT && !label)
+            return 0;
+        fprintf(stderr, "%s: %s: %s\n", prog, ck->c_path, errno == EINVAL
+                ? "not a quota snapshot" : strerror(errno));
+        return -1;
+    }
+    if (strcmp(snap_label(snap), sw->conf->cf_label) != 0) {
+        fprintf(stderr, "%s: %s: checkpoint is of %s, not %s\n", prog,
+                ck->c_path, snap_label(snap), sw->conf->cf_label);
+        snap_close(snap);
+        return -1;
+    }
+    uid = snap_column(snap, SNAP_COL_UID);
+    for (i = 0; i < snap_count(snap); i++)
+        uidset_add(sw->seen, uid[i]);
+    snapscan(sw, snap, NULL);
+    ck->c_skip = pos;
+    ck->c_start = snap_time(snap);
+    snap_close(snap);
+    return 0;
+}
+
+/* Remove the checkpoint of a finished sweep.
+ */
+static void
+ckpt_remove(struct checkpoint *ck)
+{
+    char path[MAXPATHLEN];
+
+    snprintf(path, sizeof(path), "%s.pos", ck->c_path);
+    if (unlink(path) < 0 && errno != ENOENT)
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+    if (unlink(ck->c_path) < 0 && errno != ENOENT)
+        fprintf(stderr, "%s: %s: %s\n", prog, ck->c_path, strerror(errno));
+}
+
+/* Return 1 if uid belongs to shard sh (always, if not sharded).
+ */
+static int
+shard_member(struct shard *sh, uid_t uid)
+{
+    uint32_t h = uid;
+
+    if (sh->s_count <= 1)
+        return 1;
+    if (sh->s_range)
+        return uid >= sh->s_lo && uid <= sh->s_hi;
+    h ^= h >> 16;               /* murmur3 finalizer */
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h % sh->s_count == sh->s_index;
+}
+
+/* Sort results on uid (default), space used, or files used.
+ */
+static void
+sort_results(List qlist, int sopt, int Fopt, int ropt)
+{
+    if (ropt) {
+        if (sopt)
+            list_sort(qlist, (ListCmpF)quota_cmp_bytes_reverse);
+        else if (Fopt)
+            list_sort(qlist, (ListCmpF)quota_cmp_files_reverse);
+        else
+            list_sort(qlist, (ListCmpF)quota_cmp_uid_reverse);
+    } else {
+        if (sopt)
+            list_sort(qlist, (ListCmpF)quota_cmp_bytes);
+        else if (Fopt)
+            list_sort(qlist, (ListCmpF)quota_cmp_files);
+        else
+            list_sort(qlist, (ListCmpF)quota_cmp_uid);
+    }
+}
+
+/* Print a report title, e.g. "Quota report for /home (blocksize 1.0M)".
+ */
+static void
+put_title(outbuf_t ob, const char *what, const char *fsname,
+          unsigned long bsize, int hopt)
+{
+    outbuf_putstr(ob, what, 0);
+    outbuf_putstr(ob, fsname, 0);
+    if (!hopt) {
+        outbuf_putstr(ob, " (blocksize ", 0);
+        outbuf_putsize(ob, bsize, 0);
+        outbuf_putc(ob, ')');
+    }
+    outbuf_putc(ob, '\n');
+}
+
+/* Collect the uid's to query on several file systems.  With -d, the
+ * owners of the top level directories of all of them are included.
+ */
+static void
+multi_scan(struct multi *m, List uids, struct shard *shard, int popt,
+           int dopt)
+{
+    struct sweep sw;
+    int i;
+
+    memset(&sw, 0, sizeof(sw));
+    sw.seen = uidset_create();
+    sw.multi = m;
+    sw.shard = *shard;
+    if (popt)
+        pwscan(&sw, uids);
+    else if (dopt) {
+        for (i = 0; i < m->nconf; i++) {
+            sw.conf = m->conf[i];
+            dirscan(&sw, uids);
+        }
+    } else
+        uidscan(&sw, uids);
+    uidset_destroy(sw.seen);
+}
+
+static void
+multi_add(struct multi *m, uid_t uid, char *name, const char *tag)
+{
+    if (m->nuid == m->size) {
+        m->size = m->size ? m->size * 2 : 1024;
+        m->uid = xrealloc(m->uid, m->size * sizeof(uid_t));
+        m->name = xrealloc(m->name, m->size * sizeof(char *));
+        m->tag = xrealloc(m->tag, m->size * sizeof(char *));
+    }
+    m->uid[m->nuid] = uid;
+    m->name[m->nuid] = name ? xstrdup(name) : NULL;
+    m->tag[m->nuid] = tag ? xstrdup((char *)tag) : NULL;
+    m->nuid++;
+}
+
+/* fetch_all() callback */
+static void
+multi_result(int fs, int idx, quota_t q, struct multi *m)
+{
+    m->q[idx * m->nconf + fs] = q;
+}
+
+/* Look up the names of users with results, once each however many
+ * file systems they appear on.
+ */
+static void
+multi_names(struct multi *m)
+{
+    char buf[32];
+    int i, fs;
+
+    for (i = 0; i < m->nuid; i++) {
+        if (m->name[i])
+            continue;
+        for (fs = 0; fs < m->nconf; fs++)
+            if (m->q[i * m->nconf + fs])
+                break;
+        if (fs < m->nconf)
+            m->name[i] = xstrdup(user_name(m->uid[i], NULL, m->tag[i],
+                                           buf, sizeof(buf)));
+    }
+}
+
+/* Report each file system in turn, as if by separate runs.
+ */
+static void
+multi_sections(struct multi *m, outbuf_t ob, report_t report,
+               unsigned long bsize, int hopt, int Hopt, int sopt, int Fopt,
+               int ropt, int getusername)
+{
+    List qlist;
+    quota_t q;
+    int i, fs;
+
+    if (getusername)
+        multi_names(m);
+    for (fs = 0; fs < m->nconf; fs++) {
+        qlist = list_create((ListDelF)quota_destroy);
+        for (i = 0; i < m->nuid; i++) {
+            if (!(q = m->q[i * m->nconf + fs]))
+                continue;
+            if (getusername)
+                quota_adduser(q, m->name[i]);
+            list_append(qlist, q);
+            m->q[i * m->nconf + fs] = NULL;
+        }
+        sort_results(qlist, sopt, Fopt, ropt);
+        if (fs > 0)
+            outbuf_putc(ob, '\n');
+        if (!Hopt) {
+            put_title(ob, "Quota report for ", m->conf[fs]->cf_label,
+                      bsize, hopt);
+            report_heading(report);
+        }
+        list_for_each(qlist, (ListForF)report_row, report);
+        list_destroy(qlist);
+    }
+}
+
+/* A row of a joined report. */
+struct jrow {
+    int                 j_idx;          /* uid index */
+    uid_t               j_uid;
+    unsigned long long  j_total;        /* space or files used on all fs */
+};
+
+static int
+jrow_cmp_uid(const void *a, const void *b)
+{
+    const struct jrow *x = a, *y = b;
+
+    return x->j_uid < y->j_uid ? -1 : x->j_uid > y->j_uid ? 1 : 0;
+}
+
+static int
+jrow_cmp_total(const void *a, const void *b)
+{
+    const struct jrow *x = a, *y = b;
+
+    if (x->j_total != y->j_total)
+        return x->j_total < y->j_total ? -1 : 1;
+    return jrow_cmp_uid(a, b);
+}
+
+/* helper for multi_join() - one cell, "-" if no result */
+static void
+put_cell(outbuf_t ob, int present, unsigned long long val,
+         unsigned long bsize, int hopt, int Fopt, int width)
+{
+    if (!present)
+        outbuf_putstr(ob, "-", width);
+    else if (Fopt)
+        outbuf_putull(ob, val, width);
+    else
+        put_space(ob, val, bsize, hopt, width);
+}
+
+/* Report one row per user with space used (files used with -F) on each
+ * file system and in total, sorted on uid or with -s or -F on the total.
+ */
+static void
+multi_join(struct multi *m, outbuf_t ob, unsigned long bsize, int hopt,
+           int Hopt, int sopt, int Fopt, int ropt, int getusername)
+{
+    struct jrow *row = xmalloc((m->nuid + 1) * sizeof(struct jrow));
+    int *width = xmalloc(m->nconf * sizeof(int));
+    char *labels;
+    unsigned long long val;
+    quota_t q;
+    int i, fs, n = 0, len = 1;
+
+    if (getusername)
+        multi_names(m);
+    for (fs = 0; fs < m->nconf; fs++) {
+        width[fs] = strlen(m->conf[fs]->cf_label) + 1;
+        if (width[fs] < 12)
+            width[fs] = 12;
+        len += strlen(m->conf[fs]->cf_label) + 2;
+    }
+    for (i = 0; i < m->nuid; i++) {
+        row[n].j_idx = i;
+        row[n].j_uid = m->uid[i];
+        row[n].j_total = 0;
+        for (fs = 0; fs < m->nconf; fs++) {
+            if ((q = m->q[i * m->nconf + fs]))
+                row[n].j_total += Fopt ? quota_files_used(q)
+                                       : quota_bytes_used(q);
+        }
+        for (fs = 0; fs < m->nconf; fs++)
+            if (m->q[i * m->nconf + fs])
+                break;
+        if (fs < m->nconf)
+            n++;
+    }
+    qsort(row, n, sizeof(struct jrow), (sopt || Fopt) ? jrow_cmp_total
+                                                      : jrow_cmp_uid);
+
+    if (!Hopt) {
+        labels = xmalloc(len);
+        labels[0] = '\0';
+        for (fs = 0; fs < m->nconf; fs++) {
+            if (fs > 0)
+                strcat(labels, ", ");
+            strcat(labels, m->conf[fs]->cf_label);
+        }
+        put_title(ob, Fopt ? "Files used on " : "Space used on ", labels,
+                  bsize, hopt || Fopt);
+        free(labels);
+        outbuf_putstr(ob, "User", 11);
+        for (fs = 0; fs < m->nconf; fs++)
+            outbuf_putstr(ob, m->conf[fs]->cf_label, width[fs]);
+        outbuf_putstr(ob, "Total", 0);
+        outbuf_putc(ob, '\n');
+    }
+    for (i = 0; i < n; i++) {
+        struct jrow *jr = &row[ropt ? n - 1 - i : i];
+
+        if (getusername)
+            outbuf_putstr(ob, m->name[jr->j_idx], 10);
+        else
+            outbuf_putull(ob, jr->j_uid, 10);
+        outbuf_putc(ob, ' ');
+        for (fs = 0; fs < m->nconf; fs++) {
+            q = m->q[jr->j_idx * m->nconf + fs];
+            val = !q ? 0 : Fopt ? quota_files_used(q) : quota_bytes_used(q);
+            put_cell(ob, q != NULL, val, bsize, hopt, Fopt, width[fs] - 1);
+            outbuf_putc(ob, ' ');
+        }
+        put_cell(ob, 1, jr->j_total, bsize, hopt, Fopt, 0);
+        outbuf_putc(ob, '\n');
+    }
+    free(width);
+    free(row);
+}
+
+/* helper for history_report() and multi_join() - space in bsize or human
+ * units */
+static void
+put_space(outbuf_t ob, unsigned long long val, unsigned long bsize, int hopt,
+          int width)
+{
+    if (hopt)
+        outbuf_putsize(ob, val, width);
+    else
+        outbuf_putull(ob, val / bsize, width);
+}
+
+/* helper for history_report() - local date and time of a sweep */
+static void
+put_date(outbuf_t ob, time_t t, int width)
+{
+    char buf[32];
+
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", localtime(&t));
+    outbuf_putstr(ob, buf, width);
+}
+
+/* Report usage over time from a history archive: the totals for each
+ * sweep, or if uids is set, each listed user's usage at each sweep in
+ * which they appear.
+ */
+static void
+history_report(char *path, char *fsname, List uids, unsigned long bsize,
+               int hopt, int Hopt)
+{
+    struct hist_usage *u;
+    unsigned long long bytes, files;
+    unsigned long users, *up;
+    ListIterator itr;
+    outbuf_t ob;
+    hist_t h;
+    int i, n;
+
+    if (!(h = hist_open(path))) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, errno == EINVAL
+                ? "not a quota history archive" : strerror(errno));
+        exit(1);
+    }
+    if (fsname && strcmp(fsname, hist_label(h)) != 0) {
+        fprintf(stderr, "%s: %s: archive is of %s, not %s\n",
+                prog, path, hist_label(h), fsname);
+        exit(1);
+    }
+    n = hist_count(h);
+    ob = outbuf_create(STDOUT_FILENO, OUTBUF_SIZE);
+    if (!Hopt) {
+        put_title(ob, "Usage history for ", hist_label(h), bsize, hopt);
+        outbuf_putstr(ob, "Date", 17);
+        outbuf_putstr(ob, uids ? "Uid" : "Users", 11);
+        outbuf_putstr(ob, "Space-used", 12);
+        outbuf_putstr(ob, "Files-used", 0);
+        outbuf_putc(ob, '\n');
+    }
+    if (!uids) {
+        for (i = 0; i < n; i++) {
+            hist_totals(h, i, &users, &bytes, &files);
+            put_date(ob, hist_time(h, i), 17);
+            outbuf_putull(ob, users, 11);
+            put_space(ob, bytes, bsize, hopt, 12);
+            outbuf_putull(ob, files, 0);
+            outbuf_putc(ob, '\n');
+        }
+    } else {
+        u = xmalloc((n + 1) * sizeof(*u));
+        itr = list_iterator_create(uids);
+        while ((up = list_next(itr))) {
+            hist_uid(h, (uid_t)*up, u);
+            for (i = 0; i < n; i++) {
+                if (!u[i].hu_present)
+                    continue;
+                put_date(ob, hist_time(h, i), 17);
+                outbuf_putull(ob, *up, 11);
+                put_space(ob, u[i].hu_bytes, bsize, hopt, 12);
+                outbuf_putull(ob, u[i].hu_files, 0);
+                outbuf_putc(ob, '\n');
+            }
+        }
+        list_iterator_destroy(itr);
+        free(u);
+    }
+    if (outbuf_destroy(ob) < 0) {
+        fprintf(stderr, "%s: write error: %s\n", prog, strerror(errno));
+        exit(1);
     }
+    hist_close(h);
 }
 
 /*
@@ -61,3 +61,42 @@ program RQUOTAPROG {
 		RQUOTAPROC_GETACTIVEQUOTA(getquota_args) = 2;
 	} = 1;
 } = 100011;
+
+/*
+ * Extension: the quotas of many users of one file system in one call,
+ * as 64-bit byte and file counts.  This is not part of the standard
+ * protocol; clients ask servers that do not offer it one user at a time.
+ */
+const RQ_BULKMAX = 800;			/* users per call, fits a datagram */
+
+struct getquota_bulk_args {
+	string gqba_pathp<RQ_PATHLEN>;	/* path to filesystem of interest */
+	unsigned int gqba_first;	/* uids first .. first + count - 1 */
+	unsigned int gqba_count;	/*   if gqba_uids is empty, */
+	unsigned int gqba_uids<RQ_BULKMAX>; /* else these uids */
+};
+
+struct rquota_bulk {
+	unsigned int rqb_uid;
+	gqr_status rqb_status;		/* the rest valid if Q_OK */
+	unsigned hyper rqb_bytes_used;
+	unsigned hyper rqb_bytes_softlim;
+	unsigned hyper rqb_bytes_hardlim;
+	unsigned hyper rqb_bytes_timeleft; /* as rq_btimeleft */
+	unsigned hyper rqb_files_used;
+	unsigned hyper rqb_files_softlim;
+	unsigned hyper rqb_files_hardlim;
+	unsigned hyper rqb_files_timeleft; /* as rq_ftimeleft */
+};
+
+typedef rquota_bulk getquota_bulk_rslt<RQ_BULKMAX>;
+
+program RQUOTABULKPROG {
+	version RQUOTABULKVERS {
+		/*
+		 * Get quotas of the requested uids, in the order requested
+		 */
+		getquota_bulk_rslt
+		RQUOTAPROC_GETQUOTA_BULK(getquota_bulk_args) = 1;
+	} = 1;
+} = 0x20051011;
@@ -0,0 +1,439 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Write and read binary quota snapshots (see snapshot.h for the format).
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "getconf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "snapshot.h"
+
+extern char *prog;
+
+#define ALIGN8(n)   (((n) + 7) & ~(uint64_t)7)
+
+static const int colwidth[SNAP_NCOLS] = {
+    [SNAP_COL_UID]              = sizeof(uint32_t),
+    [SNAP_COL_NAME]             = sizeof(uint32_t),
+    [SNAP_COL_BYTES_USED]       = sizeof(uint64_t),
+    [SNAP_COL_BYTES_SOFTLIM]    = sizeof(uint64_t),
+    [SNAP_COL_BYTES_HARDLIM]    = sizeof(uint64_t),
+    [SNAP_COL_BYTES_SECLEFT]    = sizeof(uint64_t),
+    [SNAP_COL_FILES_USED]       = sizeof(uint64_t),
+    [SNAP_COL_FILES_SOFTLIM]    = sizeof(uint64_t),
+    [SNAP_COL_FILES_HARDLIM]    = sizeof(uint64_t),
+    [SNAP_COL_FILES_SECLEFT]    = sizeof(uint64_t),
+    [SNAP_COL_BYTES_STATE]      = sizeof(uint8_t),
+    [SNAP_COL_FILES_STATE]      = sizeof(uint8_t),
+    [SNAP_COL_INDEX]            = sizeof(struct snap_index),
+};
+
+#define SNAP_MAGIC_STRUCT 0x5a9e1002
+struct snap_struct {
+    int                 s_magic;
+    void               *s_map;
+    size_t              s_len;
+    struct snap_header *s_hdr;
+    const char         *s_strings;
+};
+
+/*
+ * Writing
+ */
+
+/* helper for snap_write() - append s to the string table, return offset */
+static uint32_t
+add_string(char **tab, uint64_t *len, uint64_t *size, const char *s)
+{
+    uint64_t n = strlen(s) + 1;
+    uint32_t off = *len;
+
+    while (*len + n > *size) {
+        *size *= 2;
+        *tab = xrealloc(*tab, *size);
+    }
+    memcpy(*tab + *len, s, n);
+    *len += n;
+    return off;
+}
+
+/* helper for snap_write() - order index entries by uid */
+static int
+cmp_index(const void *a, const void *b)
+{
+    const struct snap_index *x = a;
+    const struct snap_index *y = b;
+
+    if (x->ix_uid < y->ix_uid)
+        return -1;
+    if (x->ix_uid > y->ix_uid)
+        return 1;
+    return 0;
+}
+
+/* Write the quotas in qlist to a snapshot at path.  The file is written
+ * under a temporary name and renamed into place, so readers never see
+ * a partial snapshot.  Returns 0 on success, -1 on failure.
+ */
+int
+snap_write(char *path, confent_t *cp, time_t when, List qlist)
+{
+    struct snap_header hdr;
+    ListIterator itr;
+    quota_t q;
+    uint64_t strsize = 4096, strlen_ = 0;
+    char *strings = xmalloc(strsize);
+    char *buf = NULL;
+    char tmppath[MAXPATHLEN];
+    uint64_t off;
+    uint32_t i, n = list_count(qlist);
+    int col, fd = -1, rc = -1;
+    struct snap_index *index;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.sh_magic = SNAP_MAGIC;
+    hdr.sh_version = SNAP_VERSION;
+    hdr.sh_time = when;
+    hdr.sh_count = n;
+    hdr.sh_thresh = cp->cf_thresh;
+    hdr.sh_label = add_string(&strings, &strlen_, &strsize, cp->cf_label);
+    hdr.sh_rhost = add_string(&strings, &strlen_, &strsize, cp->cf_rhost);
+    hdr.sh_rpath = add_string(&strings, &strlen_, &strsize, cp->cf_rpath);
+
+    /* Lay out the file.  Names are added to the string table below,
+     * so the columns are laid out first and the strings go last.
+     */
+    off = ALIGN8(sizeof(hdr));
+    for (col = 0; col < SNAP_NCOLS; col++) {
+        hdr.sh_col[col] = off;
+        off = ALIGN8(off + (uint64_t)n * colwidth[col]);
+    }
+    buf = xmalloc(off);
+    memset(buf, 0, off);
+
+    itr = list_iterator_create(qlist);
+    for (i = 0; (q = list_next(itr)); i++) {
+        assert(q->q_magic == QUOTA_MAGIC);
+        ((uint32_t *)(buf + hdr.sh_col[SNAP_COL_UID]))[i] = q->q_uid;
+        ((uint32_t *)(buf + hdr.sh_col[SNAP_COL_NAME]))[i] = q->q_name
+            ? add_string(&strings, &strlen_, &strsize, q->q_name)
+            : SNAP_NONAME;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_BYTES_USED]))[i]
+            = q->q_bytes_used;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_BYTES_SOFTLIM]))[i]
+            = q->q_bytes_softlim;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_BYTES_HARDLIM]))[i]
+            = q->q_bytes_hardlim;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_BYTES_SECLEFT]))[i]
+            = q->q_bytes_secleft;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_FILES_USED]))[i]
+            = q->q_files_used;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_FILES_SOFTLIM]))[i]
+            = q->q_files_softlim;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_FILES_HARDLIM]))[i]
+            = q->q_files_hardlim;
+        ((uint64_t *)(buf + hdr.sh_col[SNAP_COL_FILES_SECLEFT]))[i]
+            = q->q_files_secleft;
+        ((uint8_t *)(buf + hdr.sh_col[SNAP_COL_BYTES_STATE]))[i]
+            = q->q_bytes_state;
+        ((uint8_t *)(buf + hdr.sh_col[SNAP_COL_FILES_STATE]))[i]
+            = q->q_files_state;
+        index = (struct snap_index *)(buf + hdr.sh_col[SNAP_COL_INDEX]);
+        index[i].ix_uid = q->q_uid;
+        index[i].ix_record = i;
+    }
+    list_iterator_destroy(itr);
+    qsort(buf + hdr.sh_col[SNAP_COL_INDEX], n, sizeof(struct snap_index),
+          cmp_index);
+
+    hdr.sh_strings = off;
+    hdr.sh_strings_len = strlen_;
+    hdr.sh_size = off + strlen_;
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    if (write_all(fd, buf, off) < 0 || write_all(fd, strings, strlen_) < 0
+                                    || fsync(fd) < 0) {
+        fprintf(stderr, "%s: write %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    if (close(fd) < 0) {
+        fd = -1;
+        fprintf(stderr, "%s: close %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    fd = -1;
+    if (rename(tmppath, path) < 0) {
+        fprintf(stderr, "%s: rename %s: %s\n", prog, path, strerror(errno));
+        goto done;
+    }
+    rc = 0;
+done:
+    if (fd >= 0)
+        close(fd);
+    if (rc < 0)
+        unlink(tmppath);
+    free(buf);
+    free(strings);
+    return rc;
+}
+
+/*
+ * Reading
+ */
+
+/* helper for snap_open() - check the header describes a sane file */
+static int
+valid_header(struct snap_header *h, size_t len)
+{
+    int col;
+
+    if (len < sizeof(*h) || h->sh_magic != SNAP_MAGIC
+                         || h->sh_version != SNAP_VERSION
+                         || h->sh_size != len)
+        return 0;
+    if (h->sh_strings > len || h->sh_strings_len > len - h->sh_strings
+                            || h->sh_strings_len == 0)
+        return 0;
+    if (h->sh_label >= h->sh_strings_len || h->sh_rhost >= h->sh_strings_len
+                                         || h->sh_rpath >= h->sh_strings_len)
+        return 0;
+    for (col = 0; col < SNAP_NCOLS; col++) {
+        if ((h->sh_col[col] & 7) || h->sh_col[col] > len
+                || (uint64_t)h->sh_count * colwidth[col] > len - h->sh_col[col])
+            return 0;
+    }
+    return 1;
+}
+
+/* helper for snap_open() - check the index refers only to records in the
+ * file, so snap_lookup() never returns one out of range */
+static int
+valid_index(struct snap_header *h)
+{
+    const struct snap_index *index;
+    uint32_t i;
+
+    index = (const struct snap_index *)((char *)h + h->sh_col[SNAP_COL_INDEX]);
+    for (i = 0; i < h->sh_count; i++)
+        if (index[i].ix_record >= h->sh_count)
+            return 0;
+    return 1;
+}
+
+/* Map a snapshot into memory.  Returns NULL with errno set on failure
+ * (EINVAL if the file is not a valid snapshot).
+ */
+snap_t
+snap_open(char *path)
+{
+    snap_t s;
+    struct stat sb;
+    void *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (sb.st_size < sizeof(struct snap_header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    if (!valid_header(map, sb.st_size) || !valid_index(map)
+            || ((char *)map)[sb.st_size - 1] != '\0') {
+        munmap(map, sb.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    s = xmalloc(sizeof(struct snap_struct));
+    s->s_magic = SNAP_MAGIC_STRUCT;
+    s->s_map = map;
+    s->s_len = sb.st_size;
+    s->s_hdr = map;
+    s->s_strings = (char *)map + s->s_hdr->sh_strings;
+
+    return s;
+}
+
+void
+snap_close(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    s->s_magic = 0;
+    munmap(s->s_map, s->s_len);
+    free(s);
+}
+
+int
+snap_count(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_hdr->sh_count;
+}
+
+time_t
+snap_time(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_hdr->sh_time;
+}
+
+const char *
+snap_label(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_strings + s->s_hdr->sh_label;
+}
+
+const char *
+snap_rhost(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_strings + s->s_hdr->sh_rhost;
+}
+
+const char *
+snap_rpath(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_strings + s->s_hdr->sh_rpath;
+}
+
+int
+snap_thresh(snap_t s)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    return s->s_hdr->sh_thresh;
+}
+
+/* Return a pointer to the array of values for col (see snapshot.h).
+ */
+const void *
+snap_column(snap_t s, int col)
+{
+    assert(s->s_magic == SNAP_MAGIC_STRUCT);
+    assert(col >= 0 && col < SNAP_NCOLS);
+    return (char *)s->s_map + s->s_hdr->sh_col[col];
+}
+
+/* Return the record number for uid, or -1 if not present.
+ */
+int
+snap_lookup(snap_t s, uid_t uid)
+{
+    const struct snap_index *index = snap_column(s, SNAP_COL_INDEX);
+    int lo = 0, hi = snap_count(s) - 1, mid;
+
+    while (lo <= hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index[mid].ix_uid < uid)
+            lo = mid + 1;
+        else if (index[mid].ix_uid > uid)
+            hi = mid - 1;
+        else
+            return index[mid].ix_record;
+    }
+    return -1;
+}
+
+/* Return the user name recorded for record rec, or NULL if none.
+ */
+const char *
+snap_name(snap_t s, int rec)
+{
+    const uint32_t *name = snap_column(s, SNAP_COL_NAME);
+
+    assert(rec >= 0 && rec < snap_count(s));
+    if (name[rec] == SNAP_NONAME || name[rec] >= s->s_hdr->sh_strings_len)
+        return NULL;
+    return s->s_strings + name[rec];
+}
+
+/* Fill in q from record rec.  The user name is not set; see snap_name().
+ */
+void
+snap_quota(snap_t s, int rec, quota_t q)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    assert(rec >= 0 && rec < snap_count(s));
+    q->q_uid = ((const uint32_t *)snap_column(s, SNAP_COL_UID))[rec];
+    q->q_bytes_used
+        = ((const uint64_t *)snap_column(s, SNAP_COL_BYTES_USED))[rec];
+    q->q_bytes_softlim
+        = ((const uint64_t *)snap_column(s, SNAP_COL_BYTES_SOFTLIM))[rec];
+    q->q_bytes_hardlim
+        = ((const uint64_t *)snap_column(s, SNAP_COL_BYTES_HARDLIM))[rec];
+    q->q_bytes_secleft
+        = ((const uint64_t *)snap_column(s, SNAP_COL_BYTES_SECLEFT))[rec];
+    q->q_bytes_state
+        = ((const uint8_t *)snap_column(s, SNAP_COL_BYTES_STATE))[rec];
+    q->q_files_used
+        = ((const uint64_t *)snap_column(s, SNAP_COL_FILES_USED))[rec];
+    q->q_files_softlim
+        = ((const uint64_t *)snap_column(s, SNAP_COL_FILES_SOFTLIM))[rec];
+    q->q_files_hardlim
+        = ((const uint64_t *)snap_column(s, SNAP_COL_FILES_HARDLIM))[rec];
+    q->q_files_secleft
+        = ((const uint64_t *)snap_column(s, SNAP_COL_FILES_SECLEFT))[rec];
+    q->q_files_state
+        = ((const uint8_t *)snap_column(s, SNAP_COL_FILES_STATE))[rec];
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
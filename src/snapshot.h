@@ -0,0 +1,100 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Binary quota snapshot file format.
+ *
+ * A snapshot holds the results of one repquota sweep of a file system.
+ * It is designed to be mmap(2)ed and used in place: all values are in
+ * native byte order (sh_magic reads back wrong otherwise), and all
+ * offsets are from the start of the file and 8-byte aligned.
+ *
+ * The file consists of a header, a string table of NUL-terminated strings,
+ * and one array ("column") of sh_count fixed-width values per record
+ * field, followed by an index of (uid, record number) pairs sorted by uid.
+ * Records appear in the order they were retrieved from the server.
+ */
+
+#define SNAP_MAGIC      0x52515350      /* "RQSP" */
+#define SNAP_VERSION    1
+#define SNAP_NONAME     0xffffffff      /* SNAP_COL_NAME: no user name */
+
+enum {
+    SNAP_COL_UID,                       /* uint32_t */
+    SNAP_COL_NAME,                      /* uint32_t string table offset */
+    SNAP_COL_BYTES_USED,                /* uint64_t */
+    SNAP_COL_BYTES_SOFTLIM,             /* uint64_t */
+    SNAP_COL_BYTES_HARDLIM,             /* uint64_t */
+    SNAP_COL_BYTES_SECLEFT,             /* uint64_t */
+    SNAP_COL_FILES_USED,                /* uint64_t */
+    SNAP_COL_FILES_SOFTLIM,             /* uint64_t */
+    SNAP_COL_FILES_HARDLIM,             /* uint64_t */
+    SNAP_COL_FILES_SECLEFT,             /* uint64_t */
+    SNAP_COL_BYTES_STATE,               /* uint8_t qstate_t */
+    SNAP_COL_FILES_STATE,               /* uint8_t qstate_t */
+    SNAP_COL_INDEX,                     /* struct snap_index */
+    SNAP_NCOLS
+};
+
+struct snap_header {
+    uint32_t    sh_magic;
+    uint32_t    sh_version;
+    uint64_t    sh_size;                /* total file size */
+    int64_t     sh_time;                /* time the sweep started */
+    uint32_t    sh_count;               /* number of records */
+    int32_t     sh_thresh;              /* quota.conf warning threshold */
+    uint32_t    sh_label;               /* string table offsets */
+    uint32_t    sh_rhost;
+    uint32_t    sh_rpath;
+    uint32_t    sh_flags;               /* reserved, 0 */
+    uint64_t    sh_strings;             /* file offset of string table */
+    uint64_t    sh_strings_len;
+    uint64_t    sh_col[SNAP_NCOLS];     /* file offsets of columns */
+};
+
+struct snap_index {
+    uint32_t    ix_uid;
+    uint32_t    ix_record;
+};
+
+typedef struct snap_struct *snap_t;
+
+int         snap_write(char *path, confent_t *cp, time_t when, List qlist);
+
+snap_t      snap_open(char *path);
+void        snap_close(snap_t s);
+int         snap_count(snap_t s);
+time_t      snap_time(snap_t s);
+const char *snap_label(snap_t s);
+const char *snap_rhost(snap_t s);
+const char *snap_rpath(snap_t s);
+int         snap_thresh(snap_t s);
+const void *snap_column(snap_t s, int col);
+int         snap_lookup(snap_t s, uid_t uid);
+const char *snap_name(snap_t s, int rec);
+void        snap_quota(snap_t s, int rec, quota_t q);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,238 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Statistics of each server's performance, kept between runs.
+ *
+ * The file is text, one server per line, with tab-separated fields:
+ *   time rhost rtt qps window
+ * where time is when the line was last updated, rtt the mean seconds per
+ * query, qps the queries per second sustained by a sweep, and window the
+ * number of queries in flight it settled at.  A field not yet measured is
+ * 0.  Each new measurement is blended into the old so that one unusual
+ * run does not throw the schedule off.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/param.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <assert.h>
+
+#include "list.h"
+#include "util.h"
+#include "srvstat.h"
+
+#define SRVSTAT_HEADER  "# quota server stats 1\n"
+#define SRVSTAT_WEIGHT  0.3             /* weight of a new measurement */
+
+struct srvstat_entry {
+    time_t      se_time;
+    char       *se_rhost;
+    double      se_rtt;
+    double      se_qps;
+    double      se_window;
+};
+
+#define SRVSTAT_MAGIC 0x5e7957a7
+struct srvstat_struct {
+    int         s_magic;
+    List        s_ents;
+};
+
+static void
+free_entry(struct srvstat_entry *e)
+{
+    free(e->se_rhost);
+    free(e);
+}
+
+/* helper for srvstat_open() - parse one line into a new entry, or NULL */
+static struct srvstat_entry *
+parse_entry(char *line)
+{
+    char *f[5];
+    char *p = line;
+    struct srvstat_entry *e;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        f[i] = p;
+        if (!(p = strchr(p, i < 4 ? '\t' : '\n')))
+            return NULL;
+        *p++ = '\0';
+    }
+    e = xmalloc(sizeof(struct srvstat_entry));
+    e->se_time = strtol(f[0], NULL, 10);
+    e->se_rhost = xstrdup(f[1]);
+    e->se_rtt = strtod(f[2], NULL);
+    e->se_qps = strtod(f[3], NULL);
+    e->se_window = strtod(f[4], NULL);
+    return e;
+}
+
+/* Read the statistics at path.  A missing or unreadable file is treated
+ * as empty.
+ */
+srvstat_t
+srvstat_open(char *path)
+{
+    srvstat_t s = xmalloc(sizeof(struct srvstat_struct));
+    struct srvstat_entry *e;
+    char buf[BUFSIZ];
+    FILE *f;
+
+    s->s_magic = SRVSTAT_MAGIC;
+    s->s_ents = list_create((ListDelF)free_entry);
+    if (!(f = fopen(path, "r")))
+        return s;
+    if (fgets(buf, sizeof(buf), f) && !strcmp(buf, SRVSTAT_HEADER)) {
+        while (fgets(buf, sizeof(buf), f)) {
+            if ((e = parse_entry(buf)))
+                list_append(s->s_ents, e);
+        }
+    }
+    fclose(f);
+    return s;
+}
+
+void
+srvstat_close(srvstat_t s)
+{
+    assert(s->s_magic == SRVSTAT_MAGIC);
+    s->s_magic = 0;
+    list_destroy(s->s_ents);
+    free(s);
+}
+
+static int
+match_rhost(struct srvstat_entry *e, char *rhost)
+{
+    return !strcmp(e->se_rhost, rhost);
+}
+
+/* Get what is known of rhost: seconds per query, queries per second, and
+ * queries in flight, each 0 if not yet measured.  Returns 0 if anything
+ * is known, -1 if not.
+ */
+int
+srvstat_get(srvstat_t s, char *rhost, double *rttp, double *qpsp,
+            double *windowp)
+{
+    struct srvstat_entry *e;
+
+    assert(s->s_magic == SRVSTAT_MAGIC);
+    if (!(e = list_find_first(s->s_ents, (ListFindF)match_rhost, rhost)))
+        return -1;
+    if (rttp)
+        *rttp = e->se_rtt;
+    if (qpsp)
+        *qpsp = e->se_qps;
+    if (windowp)
+        *windowp = e->se_window;
+    return 0;
+}
+
+static double
+blend(double old, double new)
+{
+    if (new <= 0)
+        return old;
+    if (old <= 0)
+        return new;
+    return old + SRVSTAT_WEIGHT * (new - old);
+}
+
+/* Record a measurement of rhost.  Values not measured are passed as 0.
+ */
+void
+srvstat_put(srvstat_t s, char *rhost, double rtt, double qps, double window,
+            time_t when)
+{
+    struct srvstat_entry *e;
+
+    assert(s->s_magic == SRVSTAT_MAGIC);
+    if (!(e = list_find_first(s->s_ents, (ListFindF)match_rhost, rhost))) {
+        e = xmalloc(sizeof(struct srvstat_entry));
+        memset(e, 0, sizeof(struct srvstat_entry));
+        e->se_rhost = xstrdup(rhost);
+        list_append(s->s_ents, e);
+    }
+    e->se_time = when;
+    e->se_rtt = blend(e->se_rtt, rtt);
+    e->se_qps = blend(e->se_qps, qps);
+    e->se_window = blend(e->se_window, window);
+}
+
+/* Write the statistics to path, replacing it atomically.  Returns 0 on
+ * success, -1 on failure.
+ */
+int
+srvstat_write(srvstat_t s, char *path)
+{
+    char tmppath[MAXPATHLEN];
+    ListIterator itr;
+    struct srvstat_entry *e;
+    FILE *f;
+    int fd, rc = 0;
+
+    assert(s->s_magic == SRVSTAT_MAGIC);
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+    if (!(f = fdopen(fd, "w"))) {
+        close(fd);
+        unlink(tmppath);
+        return -1;
+    }
+    fputs(SRVSTAT_HEADER, f);
+    itr = list_iterator_create(s->s_ents);
+    while ((e = list_next(itr))) {
+        if (strpbrk(e->se_rhost, "\t\n"))
+            continue;
+        fprintf(f, "%ld\t%s\t%.6f\t%.3f\t%.2f\n", (long)e->se_time,
+                e->se_rhost, e->se_rtt, e->se_qps, e->se_window);
+    }
+    list_iterator_destroy(itr);
+    if (ferror(f))
+        rc = -1;
+    if (fclose(f) != 0)
+        rc = -1;
+    if (rc == 0 && rename(tmppath, path) < 0)
+        rc = -1;
+    if (rc < 0)
+        unlink(tmppath);
+    return rc;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,258 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Usage distribution summary.
+ *
+ * Records are folded in as they arrive and then discarded, so memory use
+ * does not depend on the number of users.  Totals, extremes, and counts
+ * over limits are exact.  Percentiles come from log-bucketed histograms:
+ * each power of two is split into HIST_SUB buckets, so a percentile is
+ * reported as the upper bound of its bucket, within 1/HIST_SUB of the
+ * true value (values below HIST_SUB are exact).
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "outbuf.h"
+#include "getquota.h"
+#include "qstate.h"
+#include "getquota_private.h"
+#include "summary.h"
+
+#define HIST_SUBBITS    4
+#define HIST_SUB        (1 << HIST_SUBBITS)
+#define HIST_NBUCKETS   ((64 - HIST_SUBBITS + 1) * HIST_SUB)
+
+static const int thresholds[] = { 50, 80, 90, 100 };
+#define NTHRESH (sizeof(thresholds) / sizeof(thresholds[0]))
+
+static const int percentiles[] = { 50, 90, 99 };
+#define NPCT (sizeof(percentiles) / sizeof(percentiles[0]))
+
+/* Summary of one kind of usage (bytes or files). */
+struct usage {
+    unsigned long long  u_total;
+    unsigned long long  u_min;
+    unsigned long long  u_max;
+    unsigned long       u_oversoft;         /* users over soft limit */
+    unsigned long       u_nohard;           /* users with no hard limit */
+    unsigned long       u_over[NTHRESH];    /* users >= thresholds[] */
+    unsigned long       u_hist[HIST_NBUCKETS];
+};
+
+#define SUMMARY_MAGIC 0x5e3a1201
+struct summary_struct {
+    int                 s_magic;
+    unsigned long       s_users;
+    struct usage        s_bytes;
+    struct usage        s_files;
+};
+
+/* Position of the most significant set bit of v (v > 0). */
+static inline int
+msb(unsigned long long v)
+{
+    int n = 0;
+
+    if (v >> 32) { v >>= 32; n += 32; }
+    if (v >> 16) { v >>= 16; n += 16; }
+    if (v >> 8)  { v >>= 8;  n += 8; }
+    if (v >> 4)  { v >>= 4;  n += 4; }
+    if (v >> 2)  { v >>= 2;  n += 2; }
+    if (v >> 1)  { n += 1; }
+    return n;
+}
+
+static inline int
+bucket(unsigned long long v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+        return v;
+    e = msb(v);
+    return ((e - HIST_SUBBITS + 1) << HIST_SUBBITS)
+         + ((v >> (e - HIST_SUBBITS)) & (HIST_SUB - 1));
+}
+
+/* The largest value that falls in bucket b. */
+static unsigned long long
+bucket_max(int b)
+{
+    int shift;
+
+    if (b < HIST_SUB)
+        return b;
+    shift = (b >> HIST_SUBBITS) - 1;
+    return ((((unsigned long long)(b & (HIST_SUB - 1)) | HIST_SUB) << shift)
+            - 1) + (1ULL << shift);
+}
+
+summary_t
+summary_create(void)
+{
+    summary_t s = xmalloc(sizeof(struct summary_struct));
+
+    memset(s, 0, sizeof(struct summary_struct));
+    s->s_magic = SUMMARY_MAGIC;
+    s->s_bytes.u_min = s->s_files.u_min = ~0ULL;
+    return s;
+}
+
+void
+summary_destroy(summary_t s)
+{
+    assert(s->s_magic == SUMMARY_MAGIC);
+    s->s_magic = 0;
+    free(s);
+}
+
+static inline void
+add_usage(struct usage *u, unsigned long long used, unsigned long long soft,
+          unsigned long long hard)
+{
+    int i;
+
+    u->u_total += used;
+    if (used < u->u_min)
+        u->u_min = used;
+    if (used > u->u_max)
+        u->u_max = used;
+    if (soft && used > soft)
+        u->u_oversoft++;
+    if (!hard)
+        u->u_nohard++;
+    else {
+        for (i = 0; i < NTHRESH; i++)
+            if (qstate_over_thresh(used, hard, thresholds[i]))
+                u->u_over[i]++;
+    }
+    u->u_hist[bucket(used)]++;
+}
+
+/* Fold q into the summary.  Usable as a ListForF.
+ */
+int
+summary_add(quota_t q, summary_t s)
+{
+    assert(q->q_magic == QUOTA_MAGIC);
+    assert(s->s_magic == SUMMARY_MAGIC);
+    s->s_users++;
+    add_usage(&s->s_bytes, q->q_bytes_used, q->q_bytes_softlim,
+              q->q_bytes_hardlim);
+    add_usage(&s->s_files, q->q_files_used, q->q_files_softlim,
+              q->q_files_hardlim);
+    return 0;
+}
+
+/* The pct'th percentile of u over n users (n > 0). */
+static unsigned long long
+percentile(struct usage *u, unsigned long n, int pct)
+{
+    unsigned long long rank = ((unsigned long long)n * pct + 99) / 100;
+    unsigned long long seen = 0;
+    unsigned long long val;
+    int b;
+
+    if (rank == 0)
+        rank = 1;
+    for (b = 0; b < HIST_NBUCKETS; b++) {
+        seen += u->u_hist[b];
+        if (seen >= rank)
+            break;
+    }
+    val = bucket_max(b);
+    return val > u->u_max ? u->u_max : val;
+}
+
+/* helper for summary_report() - one line with space and files columns */
+static void
+put_line(outbuf_t ob, const char *label, unsigned long long bytes,
+         unsigned long long files, int space, unsigned long bsize, int human)
+{
+    outbuf_putstr(ob, label, 16);
+    if (space && human)
+        outbuf_putsize(ob, bytes, 16);
+    else if (space)
+        outbuf_putull(ob, bytes / bsize, 16);
+    else
+        outbuf_putull(ob, bytes, 16);
+    outbuf_putull(ob, files, 0);
+    outbuf_putc(ob, '\n');
+}
+
+void
+summary_report(summary_t s, outbuf_t ob, unsigned long bsize, int human)
+{
+    unsigned long n = s->s_users;
+    char label[32];
+    int i;
+
+    assert(s->s_magic == SUMMARY_MAGIC);
+    outbuf_putstr(ob, "Users", 16);
+    outbuf_putull(ob, n, 0);
+    outbuf_putc(ob, '\n');
+    outbuf_putstr(ob, "", 16);
+    outbuf_putstr(ob, "Space", 16);
+    outbuf_putstr(ob, "Files", 0);
+    outbuf_putc(ob, '\n');
+    put_line(ob, "Total", s->s_bytes.u_total, s->s_files.u_total,
+             1, bsize, human);
+    if (n > 0) {
+        put_line(ob, "Mean", s->s_bytes.u_total / n, s->s_files.u_total / n,
+                 1, bsize, human);
+        put_line(ob, "Min", s->s_bytes.u_min, s->s_files.u_min,
+                 1, bsize, human);
+        for (i = 0; i < NPCT; i++) {
+            snprintf(label, sizeof(label), "p%d", percentiles[i]);
+            put_line(ob, label, percentile(&s->s_bytes, n, percentiles[i]),
+                     percentile(&s->s_files, n, percentiles[i]),
+                     1, bsize, human);
+        }
+        put_line(ob, "Max", s->s_bytes.u_max, s->s_files.u_max,
+                 1, bsize, human);
+    }
+    put_line(ob, "Over soft", s->s_bytes.u_oversoft, s->s_files.u_oversoft,
+             0, bsize, human);
+    for (i = 0; i < NTHRESH; i++) {
+        snprintf(label, sizeof(label), ">= %d%% of hard", thresholds[i]);
+        put_line(ob, label, s->s_bytes.u_over[i], s->s_files.u_over[i],
+                 0, bsize, human);
+    }
+    put_line(ob, "No hard limit", s->s_bytes.u_nohard, s->s_files.u_nohard,
+             0, bsize, human);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,164 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * A set of uid's, implemented as an open addressing hash table.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "uidset.h"
+
+#define UIDSET_EMPTY    ((uid_t)-1)     /* marks an unused slot */
+#define UIDSET_MINSIZE  1024            /* must be a power of 2 */
+
+#define UIDSET_MAGIC 0x51d5e701
+struct uidset_struct {
+    int     s_magic;
+    uid_t  *s_tab;
+    int     s_size;
+    int     s_count;
+    int     s_hasempty;                 /* UIDSET_EMPTY is a member */
+};
+
+static inline unsigned int
+hash(uid_t uid, int size)
+{
+    return ((unsigned int)uid * 2654435761U) & (size - 1);
+}
+
+static uid_t *
+alloc_tab(int size)
+{
+    uid_t *tab = xmalloc(size * sizeof(uid_t));
+    int i;
+
+    for (i = 0; i < size; i++)
+        tab[i] = UIDSET_EMPTY;
+    return tab;
+}
+
+uidset_t
+uidset_create(void)
+{
+    uidset_t s = xmalloc(sizeof(struct uidset_struct));
+
+    s->s_magic = UIDSET_MAGIC;
+    s->s_size = UIDSET_MINSIZE;
+    s->s_tab = alloc_tab(s->s_size);
+    s->s_count = 0;
+    s->s_hasempty = 0;
+
+    return s;
+}
+
+void
+uidset_destroy(uidset_t s)
+{
+    assert(s->s_magic == UIDSET_MAGIC);
+    s->s_magic = 0;
+    free(s->s_tab);
+    free(s);
+}
+
+/* Return a pointer to the slot holding uid, or to the empty slot
+ * where it would go.
+ */
+static uid_t *
+lookup(uid_t *tab, int size, uid_t uid)
+{
+    unsigned int i = hash(uid, size);
+
+    while (tab[i] != UIDSET_EMPTY && tab[i] != uid)
+        i = (i + 1) & (size - 1);
+    return &tab[i];
+}
+
+static void
+grow(uidset_t s)
+{
+    int size = s->s_size * 2;
+    uid_t *tab = alloc_tab(size);
+    int i;
+
+    for (i = 0; i < s->s_size; i++) {
+        if (s->s_tab[i] != UIDSET_EMPTY)
+            *lookup(tab, size, s->s_tab[i]) = s->s_tab[i];
+    }
+    free(s->s_tab);
+    s->s_tab = tab;
+    s->s_size = size;
+}
+
+/* Add uid to the set.  Return 1 if it was added, 0 if already present.
+ */
+int
+uidset_add(uidset_t s, uid_t uid)
+{
+    uid_t *slot;
+
+    assert(s->s_magic == UIDSET_MAGIC);
+    if (uid == UIDSET_EMPTY) {
+        if (s->s_hasempty)
+            return 0;
+        s->s_hasempty = 1;
+        s->s_count++;
+        return 1;
+    }
+    slot = lookup(s->s_tab, s->s_size, uid);
+    if (*slot == uid)
+        return 0;
+    *slot = uid;
+    s->s_count++;
+    if (s->s_count * 2 > s->s_size)
+        grow(s);
+    return 1;
+}
+
+int
+uidset_member(uidset_t s, uid_t uid)
+{
+    assert(s->s_magic == UIDSET_MAGIC);
+    if (uid == UIDSET_EMPTY)
+        return s->s_hasempty;
+    return (*lookup(s->s_tab, s->s_size, uid) == uid);
+}
+
+int
+uidset_count(uidset_t s)
+{
+    assert(s->s_magic == UIDSET_MAGIC);
+    return s->s_count;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
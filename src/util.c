@@ -30,32 +30,65 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "util.h"
 
+/* Convert integer size to human readable form in buf, which must hold
+ * at least 16 bytes, and return the string length.
+ * Note: try to display values above 1000 as the next unit,
+ * i.e. 1000-1023MB should be displayed as GB.  Values should never
+ * take up more chars than "999.9G".  The value is shown in tenths,
+ * computed in integer arithmetic and rounded to nearest (ties to even).
+ */
+int
+size2buf(unsigned long long size, char *buf)
+{
+    static const char units[] = "KMGTP";
+    unsigned long long mask, tenths, rem, half;
+    int u, shift, len = 0;
+    char tmp[24];
+    int n = 0;
+
+    if (size == 0) {
+        strcpy(buf, "-0-");
+        return 3;
+    }
+    for (u = 4; u > 0; u--) {
+        if (size >= 1000ULL << (10 * u))
+            break;
+    }
+    shift = 10 * (u + 1);
+    mask = (1ULL << shift) - 1;
+    tenths = (size >> shift) * 10 + (((size & mask) * 10) >> shift);
+    rem = ((size & mask) * 10) & mask;
+    half = 1ULL << (shift - 1);
+    if (rem > half || (rem == half && (tenths & 1)))
+        tenths++;
+
+    tmp[n++] = '0' + tenths % 10;
+    tmp[n++] = '.';
+    tenths /= 10;
+    do {
+        tmp[n++] = '0' + tenths % 10;
+        tenths /= 10;
+    } while (tenths > 0);
+    while (n > 0)
+        buf[len++] = tmp[--n];
+    buf[len++] = units[u];
+    buf[len] = '\0';
+    return len;
+}
+
 /* Convert integer size to string.
  */
 char *
 size2str(unsigned long long size, char *str, int len)
 {
-    float n = (float)size / 1024; /* kilobytes */
-
-    /* Note: try to display values above 1000 as the next unit,
-     * i.e. 1000-1023MB should be displayed as GB.  Values should never
-     * take up more chars than "999.9G".
-     */
-    if (n >= 1000ULL*1024*1024*1024)
-        snprintf(str, len, "%.1fP", n / (1024ULL*1024*1024*1024));
-    else if (n >= 1000*1024*1024)
-        snprintf(str, len, "%.1fT", n / (1024*1024*1024));
-    else if (n >= 1000*1024)
-        snprintf(str, len, "%.1fG", n / (1024*1024));
-    else if (n >= 1000)
-        snprintf(str, len, "%.1fM", n / 1024);
-    else if (n > 0)
-        snprintf(str, len, "%.1fK", n);
-    else
-        snprintf(str, len, "-0-");
+    char tmp[16];
+
+    size2buf(size, tmp);
+    snprintf(str, len, "%s", tmp);
     return str;
 }
 
@@ -83,6 +116,16 @@ xmalloc(size_t size)
     return ptr;
 }
 
+void *
+xrealloc(void *ptr, size_t size)
+{
+    if (!(ptr = realloc(ptr, size))) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
 /* Match a directory against a mountpoint containing it.
  * We must match whole path components, see
  *  https://chaos.llnl.gov/bugzilla/show_bug.cgi?id=301
@@ -157,6 +200,50 @@ parse_blocksize(char *s, unsigned long *b)
     return err;
 }
 
+/* Write all of buf to fd, retrying after signals.  Return 0 on success,
+ * -1 on error.
+ */
+int
+write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read exactly len bytes.  Return 1 on success, 0 on EOF before any
+ * bytes, -1 on error or EOF part way.
+ */
+int
+read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = read(fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            return p == buf ? 0 : -1;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
 /*
  * lsd_* functions are needed by list.[ch].
  */
@@ -22,9 +22,13 @@
  *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
 \*****************************************************************************/
 
+int size2buf(unsigned long long size, char *buf);
 char *size2str(unsigned long long size, char *str, int len);
 char *xstrdup(char *str);
 void *xmalloc(size_t size);
+void *xrealloc(void *ptr, size_t size);
 int match_path(char *dir, const char *mountpoint);
 void test_match_path(void);
 unsigned long parse_blocksize(char *s, unsigned long *b);
+int write_all(int fd, const void *buf, size_t len);
+int read_all(int fd, void *buf, size_t len);
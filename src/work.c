@@ -0,0 +1,382 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Work directory for a sweep shared between cooperating processes, on
+ * one node or several sharing a file system.
+ *
+ *   dir/label          file system label the sweep is of
+ *   dir/todo/NNNNNN    chunks not yet claimed, one uid per line
+ *   dir/claimed/NNNNNN chunks being worked on
+ *   dir/done/NNNNNN    results of finished chunks (snapshots)
+ *
+ * A worker claims a chunk by renaming it from todo to claimed, which
+ * succeeds for exactly one of any processes that try at once.  While it
+ * works it keeps the claimed file's mtime current; a claim whose mtime is
+ * older than the lease is taken to belong to a crashed worker and is
+ * renamed back to todo.  A chunk may then be done twice, which is
+ * harmless since the results are identical and written atomically.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <utime.h>
+
+#include "list.h"
+#include "util.h"
+#include "work.h"
+
+extern char *prog;
+
+#define WORK_PATHMAX    4096
+
+static void
+work_path(char *buf, char *dir, char *sub, char *name)
+{
+    snprintf(buf, WORK_PATHMAX, "%s/%s%s%s", dir, sub, name ? "/" : "",
+             name ? name : "");
+}
+
+/* Write a file atomically: to path.pid, then rename.
+ */
+static FILE *
+open_tmp(char *path, char *tmp)
+{
+    FILE *f;
+
+    snprintf(tmp, WORK_PATHMAX, "%s.%d", path, (int)getpid());
+    if (!(f = fopen(tmp, "w")))
+        fprintf(stderr, "%s: %s: %s\n", prog, tmp, strerror(errno));
+    return f;
+}
+
+static int
+close_tmp(FILE *f, char *path, char *tmp)
+{
+    if (ferror(f) | fclose(f)) {
+        fprintf(stderr, "%s: write %s: %s\n", prog, path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, path) < 0) {
+        fprintf(stderr, "%s: rename %s: %s\n", prog, path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Set up dir for a sweep of label, with uid[0..nuid-1] split into
+ * chunks of up to chunk uid's.  Return 0 on success, -1 on error.
+ */
+int
+work_split(char *dir, char *label, uid_t *uid, int nuid, int chunk)
+{
+    char path[WORK_PATHMAX], tmp[WORK_PATHMAX], name[16];
+    static char *subs[] = { "todo", "claimed", "done" };
+    FILE *f;
+    int i, j;
+
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s: %s\n", prog, dir, strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < 3; i++) {
+        work_path(path, dir, subs[i], NULL);
+        if (mkdir(path, 0777) < 0) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, errno == EEXIST
+                    ? "work directory already set up" : strerror(errno));
+            return -1;
+        }
+    }
+    work_path(path, dir, "label", NULL);
+    if (!(f = open_tmp(path, tmp)))
+        return -1;
+    fprintf(f, "%s\n", label);
+    if (close_tmp(f, path, tmp) < 0)
+        return -1;
+
+    for (i = 0; i < nuid; i += chunk) {
+        snprintf(name, sizeof(name), "%06d", i / chunk);
+        work_path(path, dir, "todo", name);
+        if (!(f = open_tmp(path, tmp)))
+            return -1;
+        for (j = i; j < nuid && j < i + chunk; j++)
+            fprintf(f, "%lu\n", (unsigned long)uid[j]);
+        if (close_tmp(f, path, tmp) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Return the label of the file system dir is a sweep of, or NULL.
+ */
+char *
+work_label(char *dir)
+{
+    char path[WORK_PATHMAX], buf[1024];
+    FILE *f;
+    int n;
+
+    work_path(path, dir, "label", NULL);
+    if (!(f = fopen(path, "r")) || !fgets(buf, sizeof(buf), f)) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path,
+                f ? "empty" : strerror(errno));
+        if (f)
+            fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    n = strlen(buf);
+    if (n > 0 && buf[n - 1] == '\n')
+        buf[n - 1] = '\0';
+    return xstrdup(buf);
+}
+
+/* A chunk name: digits only, which skips "." and temporary files.
+ */
+static int
+is_chunk(const char *name)
+{
+    if (!*name)
+        return 0;
+    while (*name >= '0' && *name <= '9')
+        name++;
+    return *name == '\0';
+}
+
+/* Return any claims older than lease seconds to todo.  Set *held to the
+ * number of live claims.
+ */
+static void
+reclaim(char *dir, int lease, int *held)
+{
+    char path[WORK_PATHMAX], todo[WORK_PATHMAX];
+    struct dirent *dp;
+    struct stat sb;
+    time_t now = time(NULL);
+    DIR *d;
+
+    *held = 0;
+    work_path(path, dir, "claimed", NULL);
+    if (!(d = opendir(path)))
+        return;
+    while ((dp = readdir(d))) {
+        if (!is_chunk(dp->d_name))
+            continue;
+        work_path(path, dir, "claimed", dp->d_name);
+        if (stat(path, &sb) < 0)
+            continue;
+        if (now - sb.st_mtime < lease) {
+            (*held)++;
+            continue;
+        }
+        work_path(todo, dir, "todo", dp->d_name);
+        if (rename(path, todo) == 0)
+            fprintf(stderr, "%s: chunk %s: lease expired, reclaimed\n",
+                    prog, dp->d_name);
+    }
+    closedir(d);
+}
+
+/* Claim a chunk and copy its name to name.  The chunk is touched before
+ * it is moved, so reclaim() never sees a fresh claim as expired.  If none
+ * are left to claim but others hold live claims, wait in case they
+ * expire.  Return 1 if a
+ * chunk was claimed, 0 if all are done or claimed, -1 on error.
+ */
+int
+work_claim(char *dir, int lease, char *name, int len)
+{
+    char path[WORK_PATHMAX], claimed[WORK_PATHMAX];
+    struct dirent *dp;
+    DIR *d;
+    int held;
+
+    for (;;) {
+        reclaim(dir, lease, &held);
+        work_path(path, dir, "todo", NULL);
+        if (!(d = opendir(path))) {
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+            return -1;
+        }
+        while ((dp = readdir(d))) {
+            if (!is_chunk(dp->d_name))
+                continue;
+            work_path(path, dir, "todo", dp->d_name);
+            work_path(claimed, dir, "claimed", dp->d_name);
+            if (utime(path, NULL) == 0 && rename(path, claimed) == 0) {
+                snprintf(name, len, "%s", dp->d_name);
+                closedir(d);
+                return 1;
+            }
+        }
+        closedir(d);
+        if (held == 0)
+            return 0;
+        sleep(1);
+    }
+}
+
+/* Read the uid's of claimed chunk name into a new array *uidp.  Return
+ * the count, or -1 on error.  If the chunk has been reclaimed, errno is
+ * ENOENT and nothing is printed.
+ */
+int
+work_read(char *dir, char *name, uid_t **uidp)
+{
+    char path[WORK_PATHMAX];
+    unsigned long u;
+    uid_t *uid = NULL;
+    int n = 0, size = 0;
+    FILE *f;
+
+    work_path(path, dir, "claimed", name);
+    if (!(f = fopen(path, "r"))) {
+        if (errno != ENOENT)
+            fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return -1;
+    }
+    while (fscanf(f, "%lu", &u) == 1) {
+        if (n == size) {
+            size = size ? size * 2 : 256;
+            uid = xrealloc(uid, size * sizeof(uid_t));
+        }
+        uid[n++] = u;
+    }
+    fclose(f);
+    *uidp = uid;
+    return n;
+}
+
+/* Renew the lease on claimed chunk name.  Return -1 if it was lost.
+ */
+int
+work_touch(char *dir, char *name)
+{
+    char path[WORK_PATHMAX];
+
+    work_path(path, dir, "claimed", name);
+    return utime(path, NULL);
+}
+
+/* Return the path the result of chunk name is to be written to.
+ */
+char *
+work_result(char *dir, char *name)
+{
+    char path[WORK_PATHMAX];
+
+    work_path(path, dir, "done", name);
+    return xstrdup(path);
+}
+
+/* Release the claim on chunk name once its result is written.
+ */
+int
+work_done(char *dir, char *name)
+{
+    char path[WORK_PATHMAX];
+
+    work_path(path, dir, "claimed", name);
+    if (unlink(path) < 0 && errno != ENOENT) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+count_chunks(char *dir, char *sub)
+{
+    char path[WORK_PATHMAX];
+    struct dirent *dp;
+    DIR *d;
+    int n = 0;
+
+    work_path(path, dir, sub, NULL);
+    if (!(d = opendir(path)))
+        return 0;
+    while ((dp = readdir(d)))
+        if (is_chunk(dp->d_name))
+            n++;
+    closedir(d);
+    return n;
+}
+
+/* Return the number of chunks not yet done.
+ */
+int
+work_pending(char *dir)
+{
+    return count_chunks(dir, "todo") + count_chunks(dir, "claimed");
+}
+
+static int
+cmp_str(char *x, char *y)
+{
+    return strcmp(x, y);
+}
+
+/* Return a list of the paths of the results, in chunk order, or NULL if
+ * the directory cannot be read.
+ */
+List
+work_results(char *dir)
+{
+    char path[WORK_PATHMAX];
+    struct dirent *dp;
+    List l;
+    DIR *d;
+
+    work_path(path, dir, "done", NULL);
+    if (!(d = opendir(path))) {
+        fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+        return NULL;
+    }
+    l = list_create((ListDelF)free);
+    while ((dp = readdir(d))) {
+        if (!is_chunk(dp->d_name))
+            continue;
+        work_path(path, dir, "done", dp->d_name);
+        list_append(l, xstrdup(path));
+    }
+    closedir(d);
+    list_sort(l, (ListCmpF)cmp_str);
+    return l;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
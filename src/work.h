@@ -0,0 +1,43 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ * Work directory for a sweep shared between cooperating processes.
+ */
+
+#define WORK_LEASE      300     /* default seconds before a claim expires */
+
+int   work_split(char *dir, char *label, uid_t *uid, int nuid, int chunk);
+char *work_label(char *dir);
+int   work_claim(char *dir, int lease, char *name, int len);
+int   work_read(char *dir, char *name, uid_t **uidp);
+int   work_touch(char *dir, char *name);
+char *work_result(char *dir, char *name);
+int   work_done(char *dir, char *name);
+int   work_pending(char *dir);
+List  work_results(char *dir);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
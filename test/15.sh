@@ -0,0 +1,4 @@
+#!/bin/sh
+
+# will assert on failure
+./tstate
@@ -0,0 +1,8 @@
+#!/bin/sh
+
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+$PATH_REPQUOTA -n -h -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -U -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -U -h -H -s -f x.conf -u 100-106 /foo
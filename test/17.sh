@@ -0,0 +1,9 @@
+#!/bin/sh
+
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+$PATH_REPQUOTA -n -f x.conf -u 100-106 -o '%uid %name %bytes %bhard %pct' /foo
+$PATH_REPQUOTA -n -H -h -f x.conf -u 100-106 \
+    -o '%6uid|%-10bstate|%{bgrace}s|%fstate %fpct%%' /foo
+$PATH_REPQUOTA -n -f x.conf -u 100-106 -o '%bogus' /foo || echo "exit $?"
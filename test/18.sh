@@ -0,0 +1,7 @@
+#!/bin/sh
+
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+$PATH_REPQUOTA -n -O json -f x.conf -u 106,100-102,100 /foo
+$PATH_REPQUOTA -n -O csv -F -r -f x.conf -u 100-106 /foo
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+rm -f x.snap
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 100-106 /foo
+wc -c <x.snap
+$PATH_REPQUOTA -H -w /nonexistent/x.snap -f x.conf -u 100 /foo || echo "exit $?"
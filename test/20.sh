@@ -0,0 +1,17 @@
+#!/bin/sh
+
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+rm -f x.snap
+$PATH_REPQUOTA -n -H -s -w x.snap -f x.conf -u 100-106 /foo >/dev/null
+$PATH_REPQUOTA -S x.snap
+$PATH_REPQUOTA -S x.snap -s -r -U
+$PATH_REPQUOTA -S x.snap -n -h -u 101-103 /foo
+$PATH_REPQUOTA -S x.snap -b 1k -F
+$PATH_REPQUOTA -S x.snap -O csv -H
+$PATH_REPQUOTA -S x.snap /bar || echo "exit $?"
+$PATH_REPQUOTA -S x.conf || echo "exit $?"
+off=`od -An -j160 -N4 -tu4 x.snap | tr -d ' '`
+printf '\377\377\377\377' | dd of=x.snap bs=1 seek=`expr $off + 4` conv=notrunc 2>/dev/null
+$PATH_REPQUOTA -S x.snap || echo "exit $?"
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Answer quota from a snapshot configured in quota.conf.
+cat >x.conf <<EOT
+/foo:test:nothing:90:snapshot=x.snap
+/bar:test:nothing:0:nolimit,maxage=60,snapshot=y.snap
+/baz:test:elsewhere:0:snapshot=x.snap,bogus
+EOT
+./tconf x.conf
+rm -f x.snap '(null).lock'
+echo "=== no snapshot ==="
+$PATH_QUOTA -d -v -f x.conf 101
+$PATH_REPQUOTA -n -H -f x.conf -u 100-103 -w x.snap /foo >/dev/null
+echo "=== snapshot ==="
+$PATH_QUOTA -d -v -f x.conf 101
+echo "=== uid not in snapshot ==="
+$PATH_QUOTA -d -f x.conf 104
+echo "=== live ==="
+$PATH_QUOTA -d -L -v -f x.conf 101
+echo "=== snapshot, no cache ==="
+$PATH_QUOTA -v -f x.conf 101 >/dev/null
+sleep 1
+ls *.lock 2>/dev/null || echo "no lock file"
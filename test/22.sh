@@ -0,0 +1,26 @@
+#!/bin/sh
+# Per-user result cache.
+cat >x.conf <<EOT
+/foo:test:nothing:90
+/bar:test:nothing:0:nolimit
+EOT
+XDG_RUNTIME_DIR=`pwd`
+export XDG_RUNTIME_DIR
+rm -f quota-101 quota-101.lock quota-101.stats
+echo "=== miss ==="
+$PATH_QUOTA -d -c 60 -v -f x.conf 101
+cut -f2- quota-101
+echo "=== hit ==="
+$PATH_QUOTA -d -c 60 -v -f x.conf 101
+echo "=== stale, refreshed in background ==="
+printf '# quota cache 1\n1\t/foo\ttest\tnothing\t101\t5\t0\t0\t0\t0\t7\t0\t0\t0\t0\n' >quota-101
+$PATH_QUOTA -d -c 60 -v -f x.conf 101
+i=0
+while grep -q "^1	" quota-101 && test $i -lt 100; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+cut -f2- quota-101
+echo "=== live ==="
+$PATH_QUOTA -d -c 60 -L -f x.conf 101
+rm -f quota-101 quota-101.lock quota-101.stats
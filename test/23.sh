@@ -0,0 +1,14 @@
+#!/bin/sh
+# Delta report against a previous snapshot.
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+rm -f x.snap
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 100,102,104 /foo >/dev/null
+$PATH_REPQUOTA -n -c x.snap -f x.conf -u 101-106 /foo
+$PATH_REPQUOTA -n -H -s -r -h -c x.snap -f x.conf -u 101-106 /foo
+$PATH_REPQUOTA -n -H -F -m 100000 -c x.snap -f x.conf -u 101-106 /foo
+$PATH_REPQUOTA -n -H -m 1k -o "%uid %bdelta %fdelta" -c x.snap -f x.conf -u 101-106 /foo
+$PATH_REPQUOTA -n -O csv -c x.snap -f x.conf -u 101-106 /foo
+$PATH_REPQUOTA -n -O json -c x.snap -f x.conf -u 100 /foo
+$PATH_REPQUOTA -n -o "%bdelta" -f x.conf -u 100 /foo || echo "exit $?"
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Usage history archive.  Dates vary, so they are cut from the report.
+cat >x.conf <<EOT
+/foo:test:nothing:0
+EOT
+rm -f x.snap x.hist
+$PATH_REPQUOTA -n -H -w x.snap -a x.hist -f x.conf -u 100,102,104 /foo >/dev/null
+$PATH_REPQUOTA -n -H -a x.hist -f x.conf -u 100-106 /foo >/dev/null
+$PATH_REPQUOTA -n -H -a x.hist -f x.conf -u 101,103 /foo >/dev/null
+$PATH_REPQUOTA -n -H -S x.snap -a x.hist >/dev/null
+wc -c <x.hist
+$PATH_REPQUOTA -y x.hist | head -2
+$PATH_REPQUOTA -H -y x.hist | cut -c18-
+$PATH_REPQUOTA -H -h -y x.hist -u 100-103 /foo | cut -c18-
+$PATH_REPQUOTA -y x.hist /bar || echo "exit $?"
+$PATH_REPQUOTA -y x.conf || echo "exit $?"
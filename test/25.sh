@@ -0,0 +1,11 @@
+#!/bin/sh
+# Usage distribution summary.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+EOF
+rm -f x.snap
+$PATH_REPQUOTA -n -z -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -z -h -w x.snap -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -z -b 1k -S x.snap
+$PATH_REPQUOTA -n -z -f x.conf -u 200 /foo
+$PATH_REPQUOTA -n -z -s -f x.conf -u 100 /foo || echo "exit $?"
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Per-group totals.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+EOF
+cat >x.map <<EOF
+# uid group
+100 alpha
+101 beta
+102 alpha   # trailing comment
+103 gamma
+104 beta
+101 alpha
+EOF
+rm -f x.snap
+$PATH_REPQUOTA -n -g map:x.map -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -s -g map:x.map -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -F -r -h -g map:x.map -w x.snap -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -g map:x.map -S x.snap
+$PATH_REPQUOTA -n -g bogus -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -g map:x.nonexistent -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -z -g gid -f x.conf -u 100 /foo || echo "exit $?"
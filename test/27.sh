@@ -0,0 +1,18 @@
+#!/bin/sh
+# Record filters.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+EOF
+rm -f x.snap
+$PATH_REPQUOTA -n -H -N -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -E -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -P 90 -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -t expired -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -M 1g -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -N -E -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 100-106 /foo >/dev/null
+$PATH_REPQUOTA -n -H -N -s -S x.snap
+$PATH_REPQUOTA -n -z -E -S x.snap
+$PATH_REPQUOTA -n -t bogus -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -P x -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -N -c x.snap -f x.conf -u 100 /foo || echo "exit $?"
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Several file systems in one pass.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+/bar:test:other:0
+/a-much-longer-label:test:third:0
+EOF
+$PATH_REPQUOTA -n -U -f x.conf -u 100-103 /foo /bar
+$PATH_REPQUOTA -n -H -s -r -f x.conf -u 100-106 /bar /foo
+$PATH_REPQUOTA -n -j -f x.conf -u 100-106 -A
+$PATH_REPQUOTA -n -j -F -r -f x.conf -u 100-106 /foo /bar
+$PATH_REPQUOTA -n -j -h -s -N -f x.conf -u 100-106 /foo /bar
+$PATH_REPQUOTA -n -j -H -E -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -g gid -f x.conf -u 100 /foo /bar || echo "exit $?"
+$PATH_REPQUOTA -n -j -U -f x.conf -u 100 /foo /bar || echo "exit $?"
+$PATH_REPQUOTA -n -f x.conf -u 100 /foo /nope || echo "exit $?"
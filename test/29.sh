@@ -0,0 +1,21 @@
+#!/bin/sh
+# Sharded sweeps and merged snapshots.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+EOF
+rm -f x0.snap x1.snap x2.snap
+for i in 0 1 2; do
+    $PATH_REPQUOTA -n -H -k $i/3 -w x$i.snap -f x.conf -u 100-106 /foo
+    echo --
+done
+$PATH_REPQUOTA -n -S x0.snap -S x1.snap -S x2.snap
+$PATH_REPQUOTA -n -H -s -r -S x2.snap -S x0.snap -S x1.snap
+$PATH_REPQUOTA -n -H -F -S x2.snap -S x0.snap -S x1.snap -S x2.snap
+$PATH_REPQUOTA -n -O csv -S x0.snap -S x1.snap -S x2.snap -u 101-104
+for i in 0 1 2; do
+    $PATH_REPQUOTA -n -H -k range:$i/3 -f x.conf -u 100-106 /foo
+    echo --
+done
+$PATH_REPQUOTA -n -k 3/3 -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -k range:0/2 -p -f x.conf /foo || echo "exit $?"
+$PATH_REPQUOTA -n -k 0/2 -S x0.snap || echo "exit $?"
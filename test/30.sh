@@ -0,0 +1,29 @@
+#!/bin/sh
+# Sweep shared between worker processes through a work directory.
+cat >x.conf <<EOF
+/foo:test:nothing:0
+EOF
+rm -rf x.work
+$PATH_REPQUOTA -n -W x.work -C 2 -f x.conf -u 100-106 /foo
+ls x.work/todo
+cat x.work/todo/000001
+$PATH_REPQUOTA -n -W x.work -C 2 -f x.conf -u 100-106 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -W x.work -f x.conf || echo "exit $?"
+$PATH_REPQUOTA -n -W x.work -X -f x.conf /bar || echo "exit $?"
+$PATH_REPQUOTA -n -W x.work -X -f x.conf &
+$PATH_REPQUOTA -n -W x.work -X -f x.conf &
+$PATH_REPQUOTA -n -W x.work -X -f x.conf /foo &
+wait
+ls x.work/todo x.work/claimed x.work/done
+$PATH_REPQUOTA -n -W x.work
+$PATH_REPQUOTA -n -H -s -r -u 101-104 -W x.work
+
+# a crashed worker's chunk is reclaimed once its lease expires
+rm -rf x.work
+$PATH_REPQUOTA -n -W x.work -C 3 -f x.conf -u 100-106 /foo
+mv x.work/todo/000001 x.work/claimed/
+touch -d "2000-01-01" x.work/claimed/000001
+$PATH_REPQUOTA -n -W x.work -X -e 60 -f x.conf
+ls x.work/claimed x.work/done
+$PATH_REPQUOTA -n -H -W x.work
+rm -rf x.work
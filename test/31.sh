@@ -0,0 +1,32 @@
+#!/bin/sh
+# Checkpointed sweeps and resume.
+cat >x.conf <<EOF2
+/foo:test:nothing:0
+/bar:test:nothing:0
+EOF2
+rm -f x.snap x.snap.pos
+# A checkpoint is removed when the sweep finishes.
+$PATH_REPQUOTA -n -H -K x.snap -I 0 -f x.conf -u 100-106 /foo
+ls x.snap x.snap.pos 2>/dev/null
+echo --
+# Resume a sweep that saved 100-102 and had consumed five uid's.
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 100-102 /foo
+echo "uid 5 /foo" >x.snap.pos
+$PATH_REPQUOTA -n -H -K x.snap -R -f x.conf -u 100-106 /foo
+ls x.snap x.snap.pos 2>/dev/null
+echo --
+# Without a position, the saved uid's are not queried again.
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 104 /foo
+$PATH_REPQUOTA -n -H -s -K x.snap -R -f x.conf -u 100-106 /foo
+echo --
+# Resume with no checkpoint starts from the beginning.
+$PATH_REPQUOTA -n -H -K x.snap -R -f x.conf -u 105-106 /foo
+echo --
+$PATH_REPQUOTA -n -H -w x.snap -f x.conf -u 100 /foo
+echo "pw 1 /foo" >x.snap.pos
+$PATH_REPQUOTA -n -H -K x.snap -R -f x.conf -u 100-106 /foo || echo "exit $?"
+echo "uid 1 /foo" >x.snap.pos
+$PATH_REPQUOTA -n -H -K x.snap -R -f x.conf -u 100-106 /bar || echo "exit $?"
+rm -f x.snap x.snap.pos
+$PATH_REPQUOTA -n -R -f x.conf -u 100-106 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -K x.snap -A -f x.conf -u 100-106 || echo "exit $?"
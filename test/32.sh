@@ -0,0 +1,15 @@
+#!/bin/sh
+# Queries in flight to a server under AIMD control.
+
+# will assert on failure
+./taimd
+
+cat >x.conf <<EOF2
+/foo:test:nothing:0
+/bar:test:nothing:0
+EOF2
+$PATH_REPQUOTA -n -H -Q 4 -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -s -l 1000 -f x.conf -u 100-106 /foo
+$PATH_REPQUOTA -n -H -Q 2 -j -f x.conf -u 100-106 /foo /bar
+$PATH_REPQUOTA -n -Q 0 -f x.conf -u 100 /foo || echo "exit $?"
+$PATH_REPQUOTA -n -Q 2 -K x.snap -f x.conf -u 100 /foo || echo "exit $?"
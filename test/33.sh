@@ -0,0 +1,37 @@
+#!/bin/sh
+# Per-server statistics for scheduling and the quota login budget.
+cat >x.conf <<EOF2
+/foo:test:nothing:90
+/bar:test:nothing:0
+EOF2
+rm -f x.stats
+$PATH_REPQUOTA -n -H -Y x.stats -j -f x.conf -u 100-103 /foo /bar
+head -1 x.stats
+awk -F'\t' 'NR > 1 { print $2, NF, ($3 > 0), ($5 >= 1) }' x.stats
+$PATH_REPQUOTA -n -H -Y x.stats -s -f x.conf -u 100-103 /foo
+awk -F'\t' 'NR > 1 { print $2, NF }' x.stats
+
+XDG_RUNTIME_DIR=`pwd`
+export XDG_RUNTIME_DIR
+rm -f quota-101 quota-101.lock quota-101.stats
+echo "=== unknown server is queried ==="
+$PATH_QUOTA -d -c 60 -b 5 -f x.conf 101
+awk -F'\t' 'NR > 1 { print $2, NF }' quota-101.stats
+echo "=== slow server is skipped, cache filled in background ==="
+rm -f quota-101
+printf '# quota server stats 1\n1\ttest\t10.0\t0\t0\n' >quota-101.stats
+$PATH_QUOTA -d -c 60 -b 5 -v -f x.conf 101
+i=0
+while test ! -f quota-101 && test $i -lt 100; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+cut -f2- quota-101
+echo "=== slow server, cached result used ==="
+printf '# quota server stats 1\n1\ttest\t10.0\t0\t0\n' >quota-101.stats
+$PATH_QUOTA -d -c 0 -b 5 -L -f x.conf 101
+$PATH_QUOTA -b 5 -f x.conf 101 || echo "exit $?"
+sleep 1
+rm -f quota-101 quota-101.lock quota-101.stats
+$PATH_QUOTA -c abc -f x.conf 101 || echo "exit $?"
+$PATH_QUOTA -t 10x -f x.conf 101 || echo "exit $?"
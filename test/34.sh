@@ -0,0 +1,32 @@
+#!/bin/sh
+# Hedged queries across a list of servers, with trquotad on loopback.
+# The file count in each answer identifies the server that gave it.
+start() {
+    rm -f x$1.port
+    ./trquotad -p x$1.port -i $1 -t 30 $2 &
+    eval pid$1=$!
+    i=0
+    while test ! -s x$1.port && test $i -lt 50; do
+        sleep 0.1
+        i=`expr $i + 1`
+    done
+    eval port$1=`cat x$1.port`
+}
+query() {
+    echo "=== $1 ==="
+    cat >x.conf <<EOF2
+/foo:$2:/export:0
+EOF2
+    $PATH_REPQUOTA -n -H -f x.conf -u `id -u` /foo | awk '{ $1 = ""; print }'
+}
+start 1 "-d 3000"
+start 2
+start 3 "-n 1"
+query "single server at a port" "127.0.0.1@$port2"
+query "slow first server, second answers" "127.0.0.1@$port1,127.0.0.1@$port2"
+query "dead first server, second answers" "127.0.0.1@1,127.0.0.1@$port2"
+query "lost request is retried" "127.0.0.1@$port3"
+query "no server" "127.0.0.1@1,127.0.0.1@2" || echo "exit $?"
+kill $pid1 $pid2 $pid3 2>/dev/null
+wait
+rm -f x1.port x2.port x3.port
@@ -0,0 +1,41 @@
+#!/bin/sh
+# quotad-cache: results cached and shared between quota runs.
+cat >x.conf <<EOF2
+/foo:test:nothing:90
+/bar:test:nothing:0
+EOF2
+cat >x2.conf <<EOF2
+/foo:test:nothing:90
+/bar:test:nothing:0
+/baz:test:other:0
+EOF2
+rm -f x.sock x.log
+$PATH_QUOTAD_CACHE -F -d -t 60 -f x.conf -s x.sock >x.log 2>&1 &
+pid=$!
+i=0
+while test ! -S x.sock && test $i -lt 50; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+echo "=== first query is fetched ==="
+$PATH_QUOTA -d -v -s x.sock -f x.conf 101
+echo "=== second is answered from the cache ==="
+$PATH_QUOTA -d -v -s x.sock -f x.conf 102 >/dev/null
+$PATH_QUOTA -d -v -s x.sock -f x.conf 101 | grep quotad
+echo "=== concurrent queries are fetched once ==="
+pids=
+for i in 1 2 3 4 5; do
+    $PATH_QUOTA -v -s x.sock -f x.conf 103 >/dev/null &
+    pids="$pids $!"
+done
+wait $pids
+echo "=== unknown file system is queried directly ==="
+$PATH_QUOTA -d -v -s x.sock -f x2.conf 101 | grep quotad
+echo "=== no daemon ==="
+$PATH_QUOTA -d -v -s x.nosock -f x.conf 101 | grep -c quotad
+kill $pid
+wait $pid
+echo "=== fetches ==="
+cat x.log
+test -S x.sock && echo "socket left behind"
+rm -f x.log x2.conf
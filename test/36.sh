@@ -0,0 +1,37 @@
+#!/bin/sh
+# quotad-cache as a caching rquota proxy, with trqclient on loopback.
+cat >x.conf <<EOF2
+/foo:test:/export/foo:90
+/bar:test:/export/bar:0
+EOF2
+rm -f x.sock x.log
+$PATH_QUOTAD_CACHE -F -d -t 60 -u 0 -f x.conf -s x.sock >x.log 2>&1 &
+pid=$!
+i=0
+while ! grep -q "udp port" x.log && test $i -lt 50; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+port=`sed -n 's/^rquota: udp port \([0-9]*\).*/\1/p' x.log`
+echo "=== by rpath ==="
+./trqclient 127.0.0.1 $port /export/foo 100 101 102 103 105 106 999
+echo "=== by label, cached ==="
+./trqclient 127.0.0.1 $port /foo 101 102
+echo "=== unknown path ==="
+./trqclient 127.0.0.1 $port /export/baz 101
+echo "=== unprivileged port ==="
+./trqclient -u 101 127.0.0.1 $port /export/foo 101 102
+./trqclient -b -u 101 127.0.0.1 $port /export/foo 101 102
+./trqclient -b -u 0 127.0.0.1 $port /export/foo 101 102
+echo "=== through the NFS backend ==="
+cat >x2.conf <<EOF2
+/proxied:127.0.0.1@$port:/export/bar:0
+EOF2
+$PATH_REPQUOTA -n -H -f x2.conf -u 101,104,105 /proxied
+kill $pid
+wait $pid
+echo "=== fetches ==="
+grep -v "udp port" x.log
+rm -f x.log x2.conf
+$PATH_QUOTAD_CACHE -F -t 99999999999 -f x.conf -s x.sock || echo "exit $?"
+$PATH_QUOTAD_CACHE -F -u 70000 -f x.conf -s x.sock || echo "exit $?"
@@ -0,0 +1,33 @@
+#!/bin/sh
+# The bulk GETQUOTA extension, served by quotad-cache on loopback.
+cat >x.conf <<EOF2
+/foo:test:/export/foo:90
+EOF2
+rm -f x.sock x.log
+$PATH_QUOTAD_CACHE -F -d -t 60 -u 0 -f x.conf -s x.sock >x.log 2>&1 &
+pid=$!
+i=0
+while ! grep -q "udp port" x.log && test $i -lt 50; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+port=`sed -n 's/^rquota: udp port \([0-9]*\).*/\1/p' x.log`
+echo "=== range ==="
+./trqclient -b 127.0.0.1 $port /export/foo 99-107
+echo "=== list, cached, with a duplicate ==="
+./trqclient -b 127.0.0.1 $port /export/foo 103 101 103
+echo "=== unknown path ==="
+./trqclient -b 127.0.0.1 $port /export/baz 101 102
+echo "=== too many ==="
+./trqclient -b 127.0.0.1 $port /export/foo 1-801 2>&1 | sed 's/;.*//'
+echo "=== count over 2^31 ==="
+./trqclient -b 127.0.0.1 $port /export/foo 0-2147483647 2>&1 | sed 's/;.*//'
+echo "=== range wraps past the largest uid ==="
+./trqclient -b 127.0.0.1 $port /export/foo 4294967000-203 2>&1 | sed 's/;.*//'
+echo "=== per-uid and bulk share the cache ==="
+./trqclient 127.0.0.1 $port /export/foo 105
+kill $pid
+wait $pid
+echo "=== fetches ==="
+grep -v "udp port" x.log
+rm -f x.log
@@ -0,0 +1,39 @@
+#!/bin/sh
+# repquota's batched queries: one bulk call through quotad-cache, and
+# one call per uid to a server without the extension (trquotad).
+cat >x.conf <<EOF2
+/foo:test:/export/foo:90
+/bar:test:/export/bar:0
+EOF2
+rm -f x.sock x.log x.port
+$PATH_QUOTAD_CACHE -F -d -t 60 -u 0 -f x.conf -s x.sock >x.log 2>&1 &
+pid=$!
+./trquotad -p x.port -i 7 -t 30 &
+tpid=$!
+i=0
+while (! grep -q "udp port" x.log || test ! -s x.port) && test $i -lt 50; do
+    sleep 0.1
+    i=`expr $i + 1`
+done
+port=`sed -n 's/^rquota: udp port \([0-9]*\).*/\1/p' x.log`
+tport=`cat x.port`
+echo "=== bulk through quotad-cache ==="
+cat >x2.conf <<EOF2
+/proxied:127.0.0.1@$port:/export/foo:0
+/proxied2:127.0.0.1@$port:/export/bar:0
+/plain:127.0.0.1@$tport:/export:0
+EOF2
+$PATH_REPQUOTA -n -H -f x2.conf -u 100,101,102,103,104,105,106,999 /proxied \
+    2>&1 | sed "s/@$port/@PORT/"
+echo "=== several file systems, bulk once the server is seen to offer it ==="
+$PATH_REPQUOTA -n -H -f x2.conf -u 100,101,102,103,104,105,106 \
+    /proxied /proxied2
+echo "=== per uid to a server without bulk ==="
+$PATH_REPQUOTA -D -n -H -f x2.conf -u 100,101,102 /plain \
+    | grep -v "^hedge:" \
+    | sed -e "s/@$tport/@PORT/" -e 's/:.*rq_curfiles=\([0-9]*\).*/: curfiles=\1/'
+kill $pid $tpid
+wait $pid $tpid
+echo "=== fetches ==="
+grep -v "udp port" x.log | sort
+rm -f x.log x.port x2.conf
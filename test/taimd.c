@@ -0,0 +1,106 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aimd.h"
+
+/* Send and answer n queries, one window at a time, each taking rtt.
+ */
+static double
+rounds(aimd_t a, int n, double t, double rtt)
+{
+    double sent[64];
+    int i, k;
+
+    while (n > 0) {
+        for (k = 0; k < 64 && n > 0 && aimd_wait(a, t) == 0; k++, n--) {
+            aimd_sent(a, t);
+            sent[k] = t;
+        }
+        assert(k > 0);
+        t += rtt;
+        for (i = 0; i < k; i++)
+            aimd_reply(a, sent[i], rtt);
+    }
+    return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+    aimd_t a;
+    double t, w;
+    int i;
+
+    /* the window starts at one and grows by one per window of replies */
+    a = aimd_create(8, 0);
+    assert(aimd_window(a) == 1);
+    aimd_sent(a, 0);
+    assert(aimd_wait(a, 0) < 0);
+    aimd_reply(a, 0, 0.001);
+    assert(aimd_window(a) == 2);
+    t = rounds(a, 2, 1, 0.001);
+    assert(aimd_window(a) > 2.8 && aimd_window(a) < 3);
+
+    /* ... up to the ceiling */
+    t = rounds(a, 1000, t, 0.001);
+    assert(aimd_window(a) == 8);
+    assert(aimd_inflight(a) == 0);
+
+    /* a burst of timeouts of queries sent together halves it once */
+    for (i = 0; i < 8; i++)
+        aimd_sent(a, t);
+    for (i = 0; i < 8; i++)
+        aimd_timeout(a, t, t + 25);
+    assert(aimd_window(a) == 4);
+
+    /* each later timeout halves it again, but not below one */
+    for (i = 0, t += 26; i < 4; i++, t += 26) {
+        aimd_sent(a, t);
+        aimd_timeout(a, t, t + 25);
+    }
+    assert(aimd_window(a) == 1);
+
+    /* a reply much slower than the fastest seen is congestion too */
+    t = rounds(a, 100, t + 100, 0.001);
+    w = aimd_window(a);
+    assert(w > 4);
+    aimd_sent(a, t);
+    aimd_reply(a, t, 0.050);
+    assert(aimd_window(a) == w / 2);
+
+    /* ... but not below the floor, so scheduling noise is ignored */
+    w = aimd_window(a);
+    aimd_sent(a, t + 1);
+    aimd_reply(a, t + 1, 0.004);
+    assert(aimd_window(a) > w);
+    aimd_destroy(a);
+
+    /* the rate limit allows a query every 1/rate seconds ... */
+    a = aimd_create(8, 10);
+    assert(aimd_wait(a, 0) == 0);
+    aimd_sent(a, 0);
+    aimd_reply(a, 0, 0.001);
+    w = aimd_wait(a, 0.02);
+    assert(w > 0.08 - 1E-9 && w < 0.08 + 1E-9);
+    assert(aimd_wait(a, 0.1) == 0);
+    aimd_sent(a, 0.1);
+    aimd_reply(a, 0.1, 0.001);
+
+    /* ... with bursts of at most one second's worth after a pause */
+    for (i = 0; i < 20 && aimd_wait(a, 100) == 0; i++) {
+        aimd_sent(a, 100);
+        aimd_reply(a, 100, 0.001);
+    }
+    assert(i == 10);
+    aimd_destroy(a);
+
+    exit(0);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -53,10 +53,15 @@ print_conf_ent(char *key, confent_t *e)
 {
     if (key)
         printf("%s: ", key);
-    if (e)
-        printf("%s:%s:%s:%d\n",
+    if (e) {
+        printf("%s:%s:%s:%d",
                e->cf_label, e->cf_rhost, e->cf_rpath, e->cf_thresh);
-    else
+        if (e->cf_nolimit)
+            printf(" nolimit");
+        if (e->cf_snapshot)
+            printf(" snapshot=%s maxage=%d", e->cf_snapshot, e->cf_maxage);
+        printf("\n");
+    } else
         printf("not found\n");
 }
 
@@ -0,0 +1,198 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/* trqclient - ask an rquota server at a given port for some uids' quota
+ * and print the raw results, for tests.  With -b, use the bulk extension,
+ * for a list of uids or a range first-last.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+
+#include "rquota.h"
+
+static void bulk(CLIENT *cl, char *path, int n, char **ids);
+static void usage(void);
+
+static struct timeval total = { 10, 0 };
+
+int main(int argc, char *argv[])
+{
+    struct timeval wait = { 1, 0 };
+    struct sockaddr_in sin;
+    getquota_args args;
+    getquota_rslt res;
+    struct rquota *rq = &res.getquota_rslt_u.gqr_rquota;
+    struct sockaddr_in lsin;
+    int sock = RPC_ANYSOCK;
+    CLIENT *cl;
+    int i, c, bopt = 0;
+    long uopt = -1;
+
+    while ((c = getopt(argc, argv, "bu:")) != EOF) {
+        switch (c) {
+            case 'b':
+                bopt = 1;
+                break;
+            case 'u':   /* send as uid from an unprivileged port */
+                uopt = strtol(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 4)
+        usage();
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(strtoul(argv[1], NULL, 10));
+    if (inet_aton(argv[0], &sin.sin_addr) == 0)
+        usage();
+    if (uopt >= 0) {
+        memset(&lsin, 0, sizeof(lsin));
+        lsin.sin_family = AF_INET;
+        if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0
+                || bind(sock, (struct sockaddr *)&lsin, sizeof(lsin)) < 0) {
+            perror("trqclient: socket");
+            exit(1);
+        }
+    }
+    if (bopt)
+        cl = clntudp_bufcreate(&sin, RQUOTABULKPROG, RQUOTABULKVERS, wait,
+                               &sock, 65536, 65536);
+    else
+        cl = clntudp_create(&sin, RQUOTAPROG, RQUOTAVERS, wait, &sock);
+    if (!cl) {
+        clnt_pcreateerror("trqclient");
+        exit(1);
+    }
+    if (uopt >= 0)
+        cl->cl_auth = authunix_create("trqclient", uopt, uopt, 0, NULL);
+    else
+        cl->cl_auth = authunix_create_default();
+    if (bopt) {
+        bulk(cl, argv[2], argc - 3, argv + 3);
+        argc = 3;
+    }
+    for (i = 3; i < argc; i++) {
+        args.gqa_pathp = argv[2];
+        args.gqa_uid = strtoul(argv[i], NULL, 10);
+        memset(&res, 0, sizeof(res));
+        if (clnt_call(cl, RQUOTAPROC_GETQUOTA,
+                      (xdrproc_t)xdr_getquota_args, (caddr_t)&args,
+                      (xdrproc_t)xdr_getquota_rslt, (caddr_t)&res,
+                      total) != RPC_SUCCESS) {
+            clnt_perror(cl, "trqclient");
+            exit(1);
+        }
+        if (res.gqr_status != Q_OK) {
+            printf("%d status %d\n", args.gqa_uid, res.gqr_status);
+            continue;
+        }
+        printf("%d bsize %d blocks %lu %lu %lu %lu files %lu %lu %lu %lu\n",
+               args.gqa_uid, rq->rq_bsize,
+               (unsigned long)rq->rq_curblocks,
+               (unsigned long)rq->rq_bsoftlimit,
+               (unsigned long)rq->rq_bhardlimit,
+               (unsigned long)rq->rq_btimeleft,
+               (unsigned long)rq->rq_curfiles,
+               (unsigned long)rq->rq_fsoftlimit,
+               (unsigned long)rq->rq_fhardlimit,
+               (unsigned long)rq->rq_ftimeleft);
+    }
+    auth_destroy(cl->cl_auth);
+    clnt_destroy(cl);
+    exit(0);
+}
+
+static void
+bulk(CLIENT *cl, char *path, int n, char **ids)
+{
+    getquota_bulk_args args;
+    getquota_bulk_rslt res;
+    rquota_bulk *r;
+    u_int *uid;
+    char *p;
+    int i;
+
+    memset(&args, 0, sizeof(args));
+    args.gqba_pathp = path;
+    if (n == 1 && (p = strchr(ids[0], '-'))) {
+        args.gqba_first = strtoul(ids[0], NULL, 10);
+        args.gqba_count = strtoul(p + 1, NULL, 10) - args.gqba_first + 1;
+    } else {
+        uid = malloc(n * sizeof(u_int));
+        for (i = 0; i < n; i++)
+            uid[i] = strtoul(ids[i], NULL, 10);
+        args.gqba_uids.gqba_uids_len = n;
+        args.gqba_uids.gqba_uids_val = uid;
+    }
+    memset(&res, 0, sizeof(res));
+    if (clnt_call(cl, RQUOTAPROC_GETQUOTA_BULK,
+                  (xdrproc_t)xdr_getquota_bulk_args, (caddr_t)&args,
+                  (xdrproc_t)xdr_getquota_bulk_rslt, (caddr_t)&res,
+                  total) != RPC_SUCCESS) {
+        clnt_perror(cl, "trqclient");
+        exit(1);
+    }
+    for (i = 0; i < res.getquota_bulk_rslt_len; i++) {
+        r = &res.getquota_bulk_rslt_val[i];
+        if (r->rqb_status != Q_OK) {
+            printf("%u status %d\n", r->rqb_uid, r->rqb_status);
+            continue;
+        }
+        printf("%u bytes %llu %llu %llu %llu files %llu %llu %llu %llu\n",
+               r->rqb_uid,
+               (unsigned long long)r->rqb_bytes_used,
+               (unsigned long long)r->rqb_bytes_softlim,
+               (unsigned long long)r->rqb_bytes_hardlim,
+               (unsigned long long)r->rqb_bytes_timeleft,
+               (unsigned long long)r->rqb_files_used,
+               (unsigned long long)r->rqb_files_softlim,
+               (unsigned long long)r->rqb_files_hardlim,
+               (unsigned long long)r->rqb_files_timeleft);
+    }
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: trqclient [-b] [-u uid] addr port path uid...\n");
+    exit(1);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,162 @@
+/*****************************************************************************\
+ *  Copyright (C) 2001-2008 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Quota, a remote quota program.
+ *  For details, see <http://www.llnl.gov/linux/quota/>.
+ *  
+ *  Quota is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Quota is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Quota; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/* trquotad - a stand-in rquotad for tests, on the loopback interface.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+
+#include "rquota.h"
+
+static void dispatch(struct svc_req *rqstp, SVCXPRT *xprt);
+static void usage(void);
+
+static int delay = 0;       /* milliseconds to wait before each reply */
+static int drop = 0;        /* requests to ignore before replying */
+static int id = 1;          /* returned as the file count */
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    char *portfile = NULL;
+    int lifetime = 60;
+    SVCXPRT *xprt;
+    FILE *f;
+    int c, fd;
+
+    while ((c = getopt(argc, argv, "p:d:n:i:t:")) != EOF) {
+        switch (c) {
+            case 'p':
+                portfile = optarg;
+                break;
+            case 'd':
+                delay = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                drop = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                id = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                lifetime = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (!portfile)
+        usage();
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("socket");
+        exit(1);
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+            || getsockname(fd, (struct sockaddr *)&sin, &len) < 0) {
+        perror("bind");
+        exit(1);
+    }
+    if (!(xprt = svcudp_create(fd))
+            || !svc_register(xprt, RQUOTAPROG, RQUOTAVERS, dispatch, 0)) {
+        fprintf(stderr, "trquotad: cannot create service\n");
+        exit(1);
+    }
+    if (!(f = fopen(portfile, "w"))) {
+        perror(portfile);
+        exit(1);
+    }
+    fprintf(f, "%d\n", ntohs(sin.sin_port));
+    fclose(f);
+
+    alarm(lifetime);
+    svc_run();
+    exit(1);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "Usage: trquotad -p portfile [-d msec] [-n drop] [-i id] [-t sec]\n");
+    exit(1);
+}
+
+static void
+dispatch(struct svc_req *rqstp, SVCXPRT *xprt)
+{
+    getquota_args args;
+    getquota_rslt res;
+
+    switch (rqstp->rq_proc) {
+        case NULLPROC:
+            svc_sendreply(xprt, (xdrproc_t)xdr_void, NULL);
+            return;
+        case RQUOTAPROC_GETQUOTA:
+        case RQUOTAPROC_GETACTIVEQUOTA:
+            break;
+        default:
+            svcerr_noproc(xprt);
+            return;
+    }
+    memset(&args, 0, sizeof(args));
+    if (!svc_getargs(xprt, (xdrproc_t)xdr_getquota_args, (caddr_t)&args)) {
+        svcerr_decode(xprt);
+        return;
+    }
+    if (drop > 0)
+        drop--;
+    else {
+        if (delay)
+            usleep(delay * 1000);
+        memset(&res, 0, sizeof(res));
+        res.gqr_status = Q_OK;
+        res.getquota_rslt_u.gqr_rquota.rq_bsize = 1024;
+        res.getquota_rslt_u.gqr_rquota.rq_active = TRUE;
+        res.getquota_rslt_u.gqr_rquota.rq_bhardlimit = 2000;
+        res.getquota_rslt_u.gqr_rquota.rq_bsoftlimit = 1000;
+        res.getquota_rslt_u.gqr_rquota.rq_curblocks = 100;
+        res.getquota_rslt_u.gqr_rquota.rq_curfiles = id;
+        svc_sendreply(xprt, (xdrproc_t)xdr_getquota_rslt, (caddr_t)&res);
+    }
+    svc_freeargs(xprt, (xdrproc_t)xdr_getquota_args, (caddr_t)&args);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,175 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#include "qstate.h"
+
+static void check(void);
+static void bench(int n);
+static void usage(void);
+
+int main(int argc, char *argv[])
+{
+    int c;
+    int n = 0;
+
+    while ((c = getopt(argc, argv, "b:")) != EOF) {
+        switch (c) {
+            case 'b':
+                n = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (n > 0)
+        bench(n);
+    else
+        check();
+    exit(0);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: tstate [-b count]\n");
+    exit(1);
+}
+
+/* The per-record classifier that getquota_nfs.c used before qstate.c.
+ */
+static qstate_t
+ref_state(unsigned long long used, unsigned long long soft,
+          unsigned long long hard, long long timeleft)
+{
+    qstate_t state;
+
+    if (!hard && !soft)
+        state = NONE;
+    else if (hard && used > hard)
+        state = EXPIRED;
+    else if (soft && used > soft)
+        state = timeleft > 0 ? STARTED : NOTSTARTED;
+    else
+        state = UNDER;
+
+    return state;
+}
+
+/* Exact as long as used*100 and hard*thresh fit in a double's mantissa.
+ */
+static int
+ref_over(unsigned long long used, unsigned long long hard, int thresh)
+{
+    return thresh && (double)used * 100 >= (double)hard * thresh;
+}
+
+static unsigned long long
+rnd(unsigned long long max)
+{
+    unsigned long long r = ((unsigned long long)random() << 31) ^ random();
+
+    return max ? r % max : r;
+}
+
+static void
+check(void)
+{
+    unsigned long long used, soft, hard;
+    long long timeleft;
+    int i, thresh;
+
+    /* random small values, many near the limits */
+    srandom(1);
+    for (i = 0; i < 1000000; i++) {
+        hard = rnd(4) ? rnd(1ULL << 40) : 0;
+        soft = rnd(4) ? rnd(hard ? hard + 1 : 1ULL << 40) : 0;
+        used = rnd(2) ? rnd(hard * 2 + 2) : hard - rnd(hard / 4 + 1);
+        timeleft = (long long)rnd(3) - 1;
+        thresh = rnd(3) ? rnd(101) : 0;
+        assert(qstate_get(used, soft, hard, timeleft)
+                    == ref_state(used, soft, hard, timeleft));
+        assert(qstate_over_thresh(used, hard, thresh)
+                    == ref_over(used, hard, thresh));
+    }
+
+    /* boundaries of the integer threshold test */
+    assert(qstate_over_thresh(90, 100, 90) == 1);
+    assert(qstate_over_thresh(89, 100, 90) == 0);
+    assert(qstate_over_thresh(95, 105, 90) == 1);   /* 94.5 */
+    assert(qstate_over_thresh(94, 105, 90) == 0);
+    assert(qstate_over_thresh(0, 0, 90) == 1);      /* as before */
+    assert(qstate_over_thresh(0, 0, 0) == 0);
+    assert(qstate_over_thresh(ULLONG_MAX, ULLONG_MAX, 100) == 1);
+    assert(qstate_over_thresh(ULLONG_MAX - 1, ULLONG_MAX, 100) == 0);
+    assert(qstate_over_thresh(ULLONG_MAX, ULLONG_MAX, 99) == 1);
+    assert(qstate_over_thresh(ULLONG_MAX / 100 * 99, ULLONG_MAX, 99) == 0);
+    assert(qstate_over_thresh(ULLONG_MAX, ULLONG_MAX, 101) == 0);
+    assert(qstate_over_thresh(ULLONG_MAX, ULLONG_MAX / 2, 300) == 0);
+    assert(qstate_over_thresh(300, 100, 300) == 1);
+    assert(qstate_over_thresh(299, 100, 300) == 0);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1E-6;
+}
+
+static void
+bench(int n)
+{
+    unsigned long long *used = malloc(n * sizeof(*used));
+    unsigned long long *soft = malloc(n * sizeof(*soft));
+    unsigned long long *hard = malloc(n * sizeof(*hard));
+    long long *timeleft = malloc(n * sizeof(*timeleft));
+    qstate_t *state = malloc(n * sizeof(*state));
+    unsigned char *over = malloc(n * sizeof(*over));
+    unsigned long count = 0;
+    double t0, t1, t2;
+    int i;
+
+    assert(used && soft && hard && timeleft && state && over);
+    srandom(1);
+    for (i = 0; i < n; i++) {
+        hard[i] = rnd(4) ? rnd(1ULL << 44) : 0;
+        soft[i] = hard[i] - hard[i] / 10;
+        used[i] = rnd(hard[i] + hard[i] / 5 + 1);
+        timeleft[i] = rnd(2) ? 86400 : 0;
+    }
+
+    t0 = now();
+    for (i = 0; i < n; i++) {
+        state[i] = ref_state(used[i], soft[i], hard[i], timeleft[i]);
+        over[i] = used[i] >= hard[i] * (90/100.0);
+    }
+    t1 = now();
+    qstate_classify(n, used, soft, hard, timeleft, 90, state, over);
+    t2 = now();
+
+    for (i = 0; i < n; i++)
+        count += over[i] + (state[i] == EXPIRED);
+    printf("%d records (%lu flagged)\n", n, count);
+    printf("per-record: %.3fs (%.1f ns/record)\n", t1 - t0, (t1 - t0)*1E9/n);
+    printf("batch:      %.3fs (%.1f ns/record)\n", t2 - t1, (t2 - t1)*1E9/n);
+
+    free(used);
+    free(soft);
+    free(hard);
+    free(timeleft);
+    free(state);
+    free(over);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */